@@ -7,6 +7,10 @@ import pipeline
 
 QUEUE_NAME = os.getenv("QUEUE_NAME")
 STORE = os.getenv("STORE", "/store")
+# "loose" for one xz file per key, "pack" to append to the pack files of dolospy.PackWriter
+STORE_FORMAT = os.getenv("STORE_FORMAT", "loose")
+
+writer = None
 
 hits = 0
 misses = 0
@@ -15,6 +19,17 @@ misses = 0
 async def object_storage(msg):
     global hits, misses
 
+    if writer is not None:
+        for key, obj in msg:
+            # Blocks only while the compression queue is full
+            writer.put(key, obj)
+            if key[0] == "0":
+                stats = writer.stats()
+                print(f"HITS {stats.hits} / MISSES {stats.misses}", file=sys.stderr)
+        # The message is acknowledged on return, so its objects must be written and synced by then
+        await asyncio.to_thread(writer.flush)
+        return
+
     for key, obj in msg:
         if not os.path.exists(f"{STORE}/{key}"):
             # No async functions available :(
@@ -38,6 +53,12 @@ if __name__ == "__main__":
         print("Missing environment variable 'AMQP_URI'", file=sys.stderr)
         exit(1)
 
+    if STORE_FORMAT == "pack":
+        import dolospy
+
+        # Keys of loose objects written before the switch count as stored
+        writer = dolospy.PackWriter(STORE, seedLoose=True)
+
     pipeline.run(
         pipeline.consumer(
             os.environ["AMQP_URI"],
@@ -0,0 +1,538 @@
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "../src/binary.h"
+#include "../src/hashing.h"
+#include "../src/index.h"
+#include "../src/postings.h"
+#include "../src/store.h"
+#include "../src/tokenizer.h"
+#include "../src/zpack.h"
+#include "perf.h"
+
+namespace {
+    struct Result {
+        std::string name;
+        uint64_t operations;
+        double seconds;
+        dolos::CounterValues counters;
+    };
+
+    dolos::PerfCounters &perfCounters() {
+        static dolos::PerfCounters counters;
+        return counters;
+    }
+
+    // Threads started by fn are counted too
+    Result measure(const std::string &name, const std::function<uint64_t()> &fn) {
+        auto &counters = perfCounters();
+        counters.start();
+        const auto start = std::chrono::steady_clock::now();
+        const auto operations = fn();
+        const auto stop = std::chrono::steady_clock::now();
+        return {
+            .name = name,
+            .operations = operations,
+            .seconds = std::chrono::duration<double>(stop - start).count(),
+            .counters = counters.stop(),
+        };
+    }
+
+    void reportHeader() {
+        if (const auto &counters = perfCounters(); !counters.available()) {
+            std::cerr << "No hardware counters, reporting wall time only: " << counters.unavailableReason()
+                    << std::endl;
+        }
+        std::cout << std::left << std::setw(40) << "benchmark" << std::right << std::setw(16) << "operations"
+                << std::setw(12) << "ns/op" << std::setw(12) << "cycles/op" << std::setw(8) << "IPC"
+                << std::setw(12) << "LLC/op" << std::setw(12) << "dTLB/op" << std::setw(12) << "br-miss/op"
+                << std::endl;
+    }
+
+    // Counters are reported per operation, "-" where the counter is unavailable
+    void report(const Result &result) {
+        const auto operations = static_cast<double>(std::max<uint64_t>(1, result.operations));
+        const auto perOperation = [&](const dolos::Counter counter, const int precision) {
+            std::ostringstream out;
+            if (const auto value = result.counters[static_cast<size_t>(counter)]) {
+                out << std::fixed << std::setprecision(precision) << static_cast<double>(*value) / operations;
+            } else {
+                out << "-";
+            }
+            return out.str();
+        };
+
+        std::string ipc = "-";
+        const auto &cycles = result.counters[static_cast<size_t>(dolos::Counter::Cycles)];
+        const auto &instructions = result.counters[static_cast<size_t>(dolos::Counter::Instructions)];
+        if (cycles && instructions && *cycles > 0) {
+            std::ostringstream out;
+            out << std::fixed << std::setprecision(2) << static_cast<double>(*instructions) / *cycles;
+            ipc = out.str();
+        }
+
+        std::cout << std::left << std::setw(40) << result.name
+                << std::right << std::setw(12) << result.operations << " ops"
+                << std::setw(12) << std::fixed << std::setprecision(1) << result.seconds * 1e9 / operations
+                << std::setw(12) << perOperation(dolos::Counter::Cycles, 1)
+                << std::setw(8) << ipc
+                << std::setw(12) << perOperation(dolos::Counter::LlcMisses, 3)
+                << std::setw(12) << perOperation(dolos::Counter::DtlbMisses, 3)
+                << std::setw(12) << perOperation(dolos::Counter::BranchMisses, 3)
+                << std::endl;
+    }
+
+    // Drops the clean pages of the file from the page cache, so the next run starts cold
+    void evict(const std::string &path) {
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return;
+        }
+        fdatasync(fd);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+
+    int madviseBenchmark(const std::string &path, const size_t queryCount) {
+        std::vector<uint64_t> queries;
+        {
+            const dolos::MappedIndex index(path);
+            const auto hashes = index.allHashes();
+            if (hashes.empty()) {
+                std::cerr << "Index " << path << " is empty" << std::endl;
+                return 1;
+            }
+            std::mt19937_64 rng(42);
+            std::uniform_int_distribution<size_t> pick(0, hashes.size() - 1);
+            queries.reserve(queryCount);
+            for (size_t i = 0; i < queryCount; i++) {
+                // Every fourth query misses, like most fingerprints of a bundle do
+                queries.emplace_back(i % 4 == 3 ? rng() : hashes[pick(rng)]);
+            }
+        }
+
+        const std::vector<std::pair<std::string, dolos::MadvisePolicy>> policies = {
+            {"normal", {.hashes = dolos::Advice::Normal, .postings = dolos::Advice::Normal}},
+            {"random", {}},
+            {"sequential", {.hashes = dolos::Advice::Sequential, .postings = dolos::Advice::Sequential}},
+            {"random+hugepages", {.hugePages = true}},
+            {"random+willneed", {.willNeed = true}},
+            {"random+hugepages+willneed", {.hugePages = true, .willNeed = true}},
+        };
+
+        uint64_t checksum = 0;
+        const auto lookups = [&](const dolos::MappedIndex &index) {
+            return [&] {
+                std::vector<dolos::Run> buffer;
+                for (const auto hash: queries) {
+                    for (const auto [first, last]: index.lookup(hash, buffer)) {
+                        checksum += first + last;
+                    }
+                }
+                return static_cast<uint64_t>(queries.size());
+            };
+        };
+
+        reportHeader();
+        for (const auto &[name, policy]: policies) {
+            evict(path);
+            const dolos::MappedIndex index(path, policy);
+            report(measure("lookup " + name + " (cold)", lookups(index)));
+            report(measure("lookup " + name + " (warm)", lookups(index)));
+        }
+
+        std::cerr << "checksum " << checksum << std::endl;
+        return 0;
+    }
+
+    // Random object lookups in a pack store directory or a .zpack, cold and warm for each advice of the object data.
+    // Pack stores only read the stored bytes, so decompression does not hide the page faults; zpack lookups
+    // decompress their frame.
+    int packsBenchmark(const std::string &path, const size_t queryCount) {
+        const bool zpack = path.ends_with(".zpack");
+        std::vector<std::string> files, keys;
+        if (zpack) {
+            files.emplace_back(path);
+            keys = dolos::ZstdPack(path).keys();
+        } else {
+            for (const auto &entry: std::filesystem::directory_iterator(path)) {
+                if (entry.path().filename().string().starts_with("pack-")) {
+                    files.emplace_back(entry.path().string());
+                }
+            }
+            keys = dolos::PackReader(path).keys();
+        }
+        if (keys.empty()) {
+            std::cerr << "No objects in " << path << std::endl;
+            return 1;
+        }
+
+        std::mt19937_64 rng(42);
+        std::uniform_int_distribution<size_t> pick(0, keys.size() - 1);
+        std::vector<std::string> queries;
+        queries.reserve(queryCount);
+        for (size_t i = 0; i < queryCount; i++) {
+            queries.emplace_back(keys[pick(rng)]);
+        }
+
+        uint64_t checksum = 0;
+        reportHeader();
+        for (const auto advice: {"normal", "random", "sequential", "willneed"}) {
+            for (const auto &file: files) {
+                evict(file);
+            }
+            const auto run = [&](auto lookup) {
+                return [&queries, &checksum, lookup] {
+                    for (const auto &key: queries) {
+                        checksum += lookup(key);
+                    }
+                    return static_cast<uint64_t>(queries.size());
+                };
+            };
+            std::function<uint64_t()> lookups;
+            std::unique_ptr<dolos::ZstdPack> zstdPack;
+            std::unique_ptr<dolos::PackReader> packReader;
+            if (zpack) {
+                zstdPack = std::make_unique<dolos::ZstdPack>(path, dolos::parseAdvice(advice));
+                lookups = run([&](const std::string &key) { return zstdPack->get(key).value_or("").size(); });
+            } else {
+                packReader = std::make_unique<dolos::PackReader>(path, dolos::parseAdvice(advice));
+                lookups = run([&](const std::string &key) {
+                    const auto data = packReader->compressed(key);
+                    return std::accumulate(data.begin(), data.end(), uint64_t{0});
+                });
+            }
+            report(measure(std::string("get ") + advice + " (cold)", lookups));
+            report(measure(std::string("get ") + advice + " (warm)", lookups));
+        }
+
+        std::cerr << "checksum " << checksum << std::endl;
+        return 0;
+    }
+
+    // Posting lists of an index as runs (version 3) and compressed (version 4): size, and the time per run of the
+    // fused decode into the countShared difference array, over all lists in order and for random hashes
+    int postingsBenchmark(const std::string &path, const size_t queryCount) {
+        const dolos::MappedIndex index(path);
+        const auto hashCount = index.hashCount();
+        if (hashCount == 0) {
+            std::cerr << "Index " << path << " is empty" << std::endl;
+            return 1;
+        }
+
+        std::vector<uint64_t> offsets;
+        std::vector<dolos::Run> postings;
+        std::vector<uint32_t> slots;
+        std::vector<uint8_t> lists;
+        std::vector<dolos::Run> buffer;
+        size_t inlineSlots = 0;
+        for (const auto hash: index.allHashes()) {
+            const auto runs = index.lookup(hash, buffer);
+            offsets.emplace_back(postings.size());
+            postings.insert(postings.end(), runs.begin(), runs.end());
+            slots.emplace_back(dolos::encodePostings(runs, lists));
+            inlineSlots += (slots.back() & dolos::listSlot) == 0;
+        }
+        offsets.emplace_back(postings.size());
+        lists.resize(lists.size() + dolos::listPadding, 0);
+
+        const auto runBytes = offsets.size() * sizeof(uint64_t) + postings.size() * sizeof(dolos::Run);
+        const auto compressedBytes = slots.size() * sizeof(uint32_t) + lists.size();
+        std::cerr << hashCount << " hashes, " << postings.size() << " runs, " << std::fixed << std::setprecision(1)
+                << 100.0 * static_cast<double>(inlineSlots) / static_cast<double>(hashCount) << "% inline\n"
+                << "offsets + postings: " << runBytes << " B as runs, " << compressedBytes << " B compressed ("
+                << std::setprecision(2) << static_cast<double>(runBytes) / static_cast<double>(compressedBytes)
+                << "x), index file " << index.fileSize() << " B" << std::endl;
+
+        std::mt19937_64 rng(42);
+        std::uniform_int_distribution<size_t> pick(0, hashCount - 1);
+        std::vector<size_t> queries(queryCount);
+        for (auto &query: queries) {
+            query = pick(rng);
+        }
+
+        std::vector<uint32_t> counts(index.groupCount());
+        uint64_t checksum = 0;
+        const auto runsOf = [&](const size_t i) {
+            return std::span(postings).subspan(offsets[i], offsets[i + 1] - offsets[i]);
+        };
+        const auto accumulateRuns = [&](const size_t i) {
+            for (const auto [first, last]: runsOf(i)) {
+                counts[first] += 1;
+                if (last + 1u < counts.size()) {
+                    counts[last + 1] -= 1;
+                }
+            }
+            return runsOf(i).size();
+        };
+        const auto workloads = [&](const std::string &order, const std::function<size_t(size_t)> &hashAt,
+                                   const size_t count) {
+            const std::vector<std::pair<std::string, std::function<uint64_t(size_t)>>> decoders = {
+                {"runs", accumulateRuns},
+                {"scalar", [&](const size_t i) {
+                    dolos::accumulatePostings(slots[i], lists, counts, false);
+                    return runsOf(i).size();
+                }},
+                {"ssse3", [&](const size_t i) {
+                    dolos::accumulatePostings(slots[i], lists, counts, dolos::vectorizedPostings());
+                    return runsOf(i).size();
+                }},
+            };
+            for (const auto &[name, decode]: decoders) {
+                std::ranges::fill(counts, 0);
+                report(measure("postings " + name + " (" + order + ")", [&] {
+                    uint64_t runs = 0;
+                    for (size_t i = 0; i < count; i++) {
+                        runs += decode(hashAt(i));
+                    }
+                    return runs;
+                }));
+                checksum += std::accumulate(counts.begin(), counts.end(), uint64_t{0});
+            }
+        };
+
+        reportHeader();
+        workloads("in order", [](const size_t i) { return i; }, hashCount);
+        workloads("random", [&](const size_t i) { return queries[i]; }, queries.size());
+        std::cerr << "checksum " << checksum << std::endl;
+        return 0;
+    }
+
+    // Random but syntactically valid JavaScript, a few kB per file like a typical library module
+    std::string syntheticSource(std::mt19937_64 &rng, const size_t functions) {
+        const std::vector<std::string> identifiers = {
+            "value", "items", "result", "options", "node", "index", "key", "callback", "data", "config",
+        };
+        const auto pick = [&](const std::vector<std::string> &values) {
+            return values[rng() % values.size()];
+        };
+        const auto name = [&] {
+            return pick(identifiers) + std::to_string(rng() % 100);
+        };
+
+        std::ostringstream out;
+        for (size_t f = 0; f < functions; f++) {
+            out << "function " << name() << "(" << name() << ", " << name() << ") {\n";
+            for (size_t statement = 0, count = 3 + rng() % 8; statement < count; statement++) {
+                switch (rng() % 6) {
+                    case 0:
+                        out << "  var " << name() << " = " << name() << " + " << rng() % 1000 << ";\n";
+                        break;
+                    case 1:
+                        out << "  if (" << name() << " > " << name() << ") { return " << name() << "; }\n";
+                        break;
+                    case 2:
+                        out << "  for (let i = 0; i < " << name() << ".length; i++) { " << name() << "(i); }\n";
+                        break;
+                    case 3:
+                        out << "  " << name() << " = { " << name() << ": " << name() << ", " << name()
+                                << ": [" << rng() % 10 << ", " << rng() % 10 << "] };\n";
+                        break;
+                    case 4:
+                        out << "  " << name() << "." << name() << "(" << name() << ", () => " << name() << ");\n";
+                        break;
+                    default:
+                        out << "  while (" << name() << ") { " << name() << " -= 1; }\n";
+                        break;
+                }
+            }
+            out << "  return " << name() << ";\n}\n";
+        }
+        return out.str();
+    }
+
+    // Keeps the results of the workloads alive
+    std::atomic<uint64_t> scalingChecksum{0};
+
+    struct ScalingRun {
+        Result result;
+        double systemSeconds;
+        long contextSwitches;
+    };
+
+    // Runs fn(item) for every item on the given number of threads and records the voluntary context switches and
+    // system time of the whole process. Threads blocking on a contended lock (malloc arenas, tree-sitter, the index)
+    // sleep in futex, which shows up as both.
+    ScalingRun runOnThreads(const std::string &name, const unsigned threads, const size_t items,
+                            const std::function<uint64_t(size_t)> &fn) {
+        rusage before{}, after{};
+        getrusage(RUSAGE_SELF, &before);
+        const auto result = measure(name, [&] {
+            std::atomic<size_t> next{0};
+            const auto work = [&] {
+                uint64_t local = 0;
+                for (size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < items;) {
+                    local += fn(i);
+                }
+                scalingChecksum += local;
+            };
+            {
+                std::vector<std::jthread> workers;
+                for (unsigned t = 1; t < threads; t++) {
+                    workers.emplace_back(work);
+                }
+                work();
+            }
+            return static_cast<uint64_t>(items);
+        });
+        getrusage(RUSAGE_SELF, &after);
+
+        const auto seconds = [](const timeval &time) {
+            return static_cast<double>(time.tv_sec) + static_cast<double>(time.tv_usec) / 1e6;
+        };
+        return {
+            .result = result,
+            .systemSeconds = seconds(after.ru_stime) - seconds(before.ru_stime),
+            .contextSwitches = after.ru_nvcsw - before.ru_nvcsw,
+        };
+    }
+
+    // Counters cover all worker threads, so cycles per file rising with the thread count points at contention
+    // rather than a lack of cores. "-" where the counter is unavailable.
+    void reportScaling(const ScalingRun &run, const unsigned threads, const double baseline) {
+        const auto throughput = static_cast<double>(run.result.operations) / run.result.seconds;
+        const auto speedup = throughput / baseline;
+        const auto &cycles = run.result.counters[static_cast<size_t>(dolos::Counter::Cycles)];
+        const auto &instructions = run.result.counters[static_cast<size_t>(dolos::Counter::Instructions)];
+        std::string cyclesPerFile = "-", ipc = "-";
+        if (cycles) {
+            std::ostringstream out;
+            out << std::fixed << std::setprecision(0)
+                    << static_cast<double>(*cycles) / static_cast<double>(std::max<uint64_t>(1, run.result.operations));
+            cyclesPerFile = out.str();
+        }
+        if (cycles && instructions && *cycles > 0) {
+            std::ostringstream out;
+            out << std::fixed << std::setprecision(2) << static_cast<double>(*instructions) / *cycles;
+            ipc = out.str();
+        }
+        std::cout << std::left << std::setw(28) << run.result.name << std::right << std::setw(8) << threads
+                << std::setw(14) << std::fixed << std::setprecision(0) << throughput
+                << std::setw(10) << std::setprecision(2) << speedup
+                << std::setw(11) << std::setprecision(0) << speedup / threads * 100 << "%"
+                << std::setw(10) << std::setprecision(1)
+                << run.systemSeconds / (run.result.seconds * threads) * 100 << "%"
+                << std::setw(12) << std::setprecision(3)
+                << static_cast<double>(run.contextSwitches) / static_cast<double>(run.result.operations)
+                << std::setw(14) << cyclesPerFile << std::setw(8) << ipc
+                << std::endl;
+    }
+
+    int scalingBenchmark(const size_t fileCount, unsigned maxThreads) {
+        if (maxThreads == 0) {
+            maxThreads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        std::vector<unsigned> threadCounts;
+        for (unsigned threads = 1; threads < maxThreads; threads *= 2) {
+            threadCounts.emplace_back(threads);
+        }
+        threadCounts.emplace_back(maxThreads);
+
+        std::mt19937_64 rng(42);
+        std::vector<std::string> corpus;
+        corpus.reserve(fileCount);
+        for (size_t i = 0; i < fileCount; i++) {
+            corpus.emplace_back(syntheticSource(rng, 20 + rng() % 40));
+        }
+
+        // Shared frozen index: every fourth file as one version of a package, queried by all threads at once
+        dolos::Index index(17, 23);
+        for (size_t i = 0; i < corpus.size(); i += 4) {
+            index.addToGroup("v" + std::to_string(i / 4), std::span(corpus[i].data(), corpus[i].size()));
+        }
+        const auto binaryPath = std::filesystem::temp_directory_path() / ("dolosbench-" + std::to_string(getpid())
+                                                                          + ".index.bin");
+        {
+            std::ofstream file(binaryPath, std::ios::binary);
+            file << dolos::serializeBinary(index);
+        }
+        const dolos::MappedIndex mapped(binaryPath);
+        std::filesystem::remove(binaryPath);
+
+        std::vector<dolos::TokenizedFile> tokens;
+        tokens.reserve(corpus.size());
+        for (const auto &source: corpus) {
+            tokens.emplace_back(dolos::tokenize(std::span(source.data(), source.size())));
+        }
+
+        const std::vector<std::pair<std::string, std::function<uint64_t(size_t)>>> workloads = {
+            {"tokenize", [&](const size_t i) {
+                return dolos::tokenize(std::span(corpus[i].data(), corpus[i].size())).size();
+            }},
+            {"tokenize+fingerprint", [&](const size_t i) {
+                const auto fileTokens = dolos::tokenize(std::span(corpus[i].data(), corpus[i].size()));
+                return dolos::fingerprint(fileTokens, 17, 23).size();
+            }},
+            {"matchTokens (Index)", [&](const size_t i) {
+                return index.matchTokens(tokens[i]).size();
+            }},
+            {"matchTokens (MappedIndex)", [&](const size_t i) {
+                return mapped.matchTokens(tokens[i]).size();
+            }},
+        };
+
+        std::cerr << corpus.size() << " synthetic files, index with " << index.groupCount() << " groups and "
+                << index.index.size() << " hashes" << std::endl;
+        std::cout << std::left << std::setw(28) << "workload" << std::right << std::setw(8) << "threads"
+                << std::setw(14) << "files/s" << std::setw(10) << "speedup" << std::setw(12) << "efficiency"
+                << std::setw(11) << "sys time" << std::setw(12) << "vcsw/file" << std::setw(14) << "cycles/file"
+                << std::setw(8) << "IPC" << std::endl;
+
+        for (const auto &[name, fn]: workloads) {
+            double baseline = 0;
+            for (const auto threads: threadCounts) {
+                const auto run = runOnThreads(name, threads, corpus.size(), fn);
+                if (threads == 1) {
+                    baseline = static_cast<double>(run.result.operations) / run.result.seconds;
+                }
+                reportScaling(run, threads, baseline);
+            }
+        }
+
+        std::cerr << "checksum " << scalingChecksum << std::endl;
+        return 0;
+    }
+}
+
+int main(int argc, char **argv) {
+    const std::string command = argc > 1 ? argv[1] : "";
+    if (command == "madvise" && argc > 2) {
+        return madviseBenchmark(argv[2], argc > 3 ? std::stoull(argv[3]) : 1'000'000);
+    }
+    if (command == "postings" && argc > 2) {
+        return postingsBenchmark(argv[2], argc > 3 ? std::stoull(argv[3]) : 1'000'000);
+    }
+    if (command == "packs" && argc > 2) {
+        return packsBenchmark(argv[2], argc > 3 ? std::stoull(argv[3]) : 100'000);
+    }
+    if (command == "scaling") {
+        return scalingBenchmark(argc > 2 ? std::stoull(argv[2]) : 2000, argc > 3 ? std::stoul(argv[3]) : 0);
+    }
+    if (argc < 2 || command == "madvise" || command == "postings" || command == "packs") {
+        std::cerr << "Usage: " << argv[0] << " madvise index.bin [queries]\n"
+                << "       " << argv[0] << " postings index.bin [queries]\n"
+                << "       " << argv[0] << " packs <store directory | file.zpack> [queries]\n"
+                << "       " << argv[0] << " scaling [files] [maxThreads]" << std::endl;
+        return 1;
+    }
+
+    std::cerr << "Unknown benchmark " << command << std::endl;
+    return 1;
+}
@@ -0,0 +1,124 @@
+#include "perf.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace dolos {
+    const char *counterName(const Counter counter) {
+        switch (counter) {
+            case Counter::Cycles: return "cycles";
+            case Counter::Instructions: return "instructions";
+            case Counter::LlcMisses: return "LLC misses";
+            case Counter::DtlbMisses: return "dTLB misses";
+            case Counter::BranchMisses: return "branch misses";
+        }
+        return "unknown";
+    }
+
+    static constexpr uint64_t cacheEvent(const uint64_t cache, const uint64_t op, const uint64_t result) {
+        return cache | op << 8 | result << 16;
+    }
+
+    static perf_event_attr counterAttributes(const Counter counter) {
+        perf_event_attr attr{};
+        attr.size = sizeof(attr);
+        attr.disabled = 1;
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        switch (counter) {
+            case Counter::Cycles:
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = PERF_COUNT_HW_CPU_CYCLES;
+                break;
+            case Counter::Instructions:
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+                break;
+            case Counter::LlcMisses:
+                attr.type = PERF_TYPE_HW_CACHE;
+                attr.config = cacheEvent(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_OP_READ,
+                                         PERF_COUNT_HW_CACHE_RESULT_MISS);
+                break;
+            case Counter::DtlbMisses:
+                attr.type = PERF_TYPE_HW_CACHE;
+                attr.config = cacheEvent(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ,
+                                         PERF_COUNT_HW_CACHE_RESULT_MISS);
+                break;
+            case Counter::BranchMisses:
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+                break;
+        }
+        return attr;
+    }
+
+    PerfCounters::PerfCounters() {
+        int lastError = 0;
+        for (size_t i = 0; i < counterCount; i++) {
+            auto attr = counterAttributes(static_cast<Counter>(i));
+            fds[i] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+            if (fds[i] < 0) {
+                lastError = errno;
+            }
+        }
+        if (!available()) {
+            reason = std::string("perf_event_open failed: ") + std::strerror(lastError);
+            if (lastError == EACCES || lastError == EPERM) {
+                reason += " (check /proc/sys/kernel/perf_event_paranoid or the container's seccomp profile)";
+            } else if (lastError == ENOENT || lastError == EOPNOTSUPP) {
+                reason += " (no hardware PMU exposed, e.g. in a VM)";
+            }
+        }
+    }
+
+    PerfCounters::~PerfCounters() {
+        for (const int fd: fds) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+    }
+
+    bool PerfCounters::available() const {
+        return std::ranges::any_of(fds, [](const int fd) { return fd >= 0; });
+    }
+
+    void PerfCounters::start() {
+        for (const int fd: fds) {
+            if (fd >= 0) {
+                ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+                ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+    }
+
+    CounterValues PerfCounters::stop() {
+        for (const int fd: fds) {
+            if (fd >= 0) {
+                ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+            }
+        }
+
+        CounterValues values;
+        for (size_t i = 0; i < counterCount; i++) {
+            // value, time enabled, time running
+            uint64_t data[3] = {};
+            if (fds[i] < 0 || read(fds[i], data, sizeof(data)) != sizeof(data) || data[2] == 0) {
+                continue;
+            }
+            values[i] = data[2] < data[1]
+                            ? static_cast<uint64_t>(static_cast<double>(data[0]) * data[1] / data[2])
+                            : data[0];
+        }
+        return values;
+    }
+}
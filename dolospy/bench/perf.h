@@ -0,0 +1,46 @@
+#ifndef PERF_H
+#define PERF_H
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string>
+
+namespace dolos {
+    enum class Counter { Cycles, Instructions, LlcMisses, DtlbMisses, BranchMisses };
+
+    constexpr size_t counterCount = 5;
+
+    const char *counterName(Counter counter);
+
+    // Counter values of one measurement, empty for counters the kernel refused to open
+    using CounterValues = std::array<std::optional<uint64_t>, counterCount>;
+
+    // Hardware counters of the calling thread and the threads it starts while counting, read with perf_event_open.
+    // Counters are opened one by one, so a container or VM that lacks some of them (or perf_event_paranoid that
+    // forbids all of them) only removes those columns.
+    class PerfCounters {
+        std::array<int, counterCount> fds;
+        std::string reason;
+
+    public:
+        PerfCounters();
+
+        PerfCounters(const PerfCounters &) = delete;
+        PerfCounters &operator=(const PerfCounters &) = delete;
+
+        ~PerfCounters();
+
+        bool available() const;
+
+        // Why no counter could be opened, empty if at least one is available
+        const std::string &unavailableReason() const { return reason; }
+
+        void start();
+
+        // Values since start(), scaled up if the kernel had to multiplex the counters
+        CounterValues stop();
+    };
+}
+
+#endif //PERF_H
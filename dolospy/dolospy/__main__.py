@@ -17,13 +17,25 @@ def __main():
     logger = __logging.getLogger(__package__)
 
     parser = __argparse.ArgumentParser()
-    parser.add_argument("command", choices=["preindexer"], help="command to execute")
+    parser.add_argument("command", choices=["preindexer", "convert"], help="command to execute")
     parser.add_argument("--preprocessor-url", type=str, help="http url to reach the preprocessor script")
     parser.add_argument(
         "--worker", type=int, default=0, help="number of worker processes. If non-positive, use number of CPU cores"
     )
     parser.add_argument("-k", type=int, default=27, help="length of k-grams")
     parser.add_argument("-w", type=int, default=15, help="window size")
+    parser.add_argument(
+        "--format",
+        choices=["json", "binary"],
+        default="json",
+        help="index file format written by the preindexer. Binary indexes are memory-mapped when loaded",
+    )
+    parser.add_argument(
+        "--memory",
+        type=int,
+        default=0,
+        help="build binary indexes by external sorting, buffering at most this many MiB of fingerprints per worker",
+    )
     parser.add_argument(
         "--log-level",
         choices=["DEBUG", "INFO", "WARNING", "ERROR", "CRITICAL"],
@@ -36,6 +48,8 @@ def __main():
 
     if args.command == "preindexer":
         __preindexer(args, logger)
+    elif args.command == "convert":
+        __convert(args, logger)
 
 def __preindexer(args: __argparse.Namespace, logger: __logging.Logger):
     import collections
@@ -99,8 +113,14 @@ def __preindexer_worker(args: __argparse.Namespace, logger: __logging.Logger, pk
     start = time.time()
 
     index_dir = os.getenv("INDEX_DIR")
-    output = os.path.join(index_dir, f"{pkg}.index.json")
-    index = Index(args.k, args.w)
+    suffix = "index.bin" if args.format == "binary" else "index.json"
+    output = os.path.join(index_dir, f"{pkg}.{suffix}")
+    external = args.format == "binary" and args.memory > 0
+    if external:
+        # Sorted runs go next to the indexes, which has room for them unlike a tmpfs /tmp
+        index = ExternalIndexBuilder(args.k, args.w, index_dir, memoryBudget=args.memory << 20, threads=1)
+    else:
+        index = Index(args.k, args.w)
 
     for vers in verss:
         logger.debug(f"Preprocessing {pkg} {vers}")
@@ -110,13 +130,43 @@ def __preindexer_worker(args: __argparse.Namespace, logger: __logging.Logger, pk
             continue
         code = resp.json()
         logger.debug(f"Tokenizing and indexing {pkg} {vers} (size {len(code)})")
-        index.addToGroup(vers, code)
+        if external:
+            index.add(index.addGroup(vers), code)
+        else:
+            index.addToGroup(vers, code)
 
     logger.debug(f"Writing {output.rsplit('/', 1)[-1]}")
-    with open(output, "w") as f:
-        f.write(index.serialize())
+    if external:
+        index.finish(output)
+    elif args.format == "binary":
+        # Write next to the target and rename, so a serving process never maps a partial file
+        with open(output + ".tmp", "wb") as f:
+            f.write(index.serializeBinary())
+        os.replace(output + ".tmp", output)
+    else:
+        with open(output + ".tmp", "w") as f:
+            f.write(index.serialize())
+        os.replace(output + ".tmp", output)
 
     return time.time() - start
 
+def __convert(args: __argparse.Namespace, logger: __logging.Logger):
+    import os
+
+    from tqdm import tqdm
+
+    index_dir = os.getenv("INDEX_DIR")
+    logger.info(f"Converting JSON indexes in INDEX_DIR={index_dir!r} to binary")
+
+    files = [dirent.path for dirent in os.scandir(index_dir) if dirent.name.endswith(".index.json")]
+    for path in tqdm(files, unit="indexes"):
+        with open(path) as f:
+            index = Index.deserialize(f.read())
+        # Write next to the target and rename, so a serving process never maps a partial file
+        output = path.removesuffix(".json") + ".bin"
+        with open(output + ".tmp", "wb") as f:
+            f.write(index.serializeBinary())
+        os.replace(output + ".tmp", output)
+
 if __name__ == "__main__":
     __main()
@@ -2,6 +2,29 @@ magic: int
 
 def compareFiles(f1: str, f2: str) -> None: ...
 def tokenize(code: str) -> "TokenizedFile": ...
+def readFiles(paths: list[str], useIoUring: bool = True) -> list[bytes | None]: ...
+def startTracing(eventsPerThread: int = 65536) -> None: ...
+def stopTracing() -> None: ...
+def writeTrace(path: str) -> None: ...
+def buildJobList(
+    files: list[str], requiresSourceMap: bool = False, excludedUrls: list[str] | None = None, threads: int = 0
+) -> list[str]: ...
+def classifyInput(code: str | bytes, minLength: int = 32) -> str: ...
+def clusterObjects(
+    store: str, keys: list[str], threshold: float = 0.9, threads: int = 0, partitions: list[str] = ...
+) -> list[tuple[int, float]]: ...
+def parseVersionRange(range: str) -> list[tuple[tuple[str, int] | None, tuple[str, int] | None]]: ...
+def splitBinary(path: str, count: int, prefix: str) -> list[str]: ...
+
+class MemoryUsage:
+    postings: int
+    groupSets: int
+    tableNodes: int
+    buckets: int
+    names: int
+    total: int
+
+    def __repr__(self) -> str: ...
 
 class Index:
     identifiers: list[int]
@@ -15,10 +38,160 @@ class Index:
     def matchTokens(self, tokens: "TokenizedFile") -> list["Pair"]: ...
     def getPair(self) -> "Pair": ...
     def serialize(self) -> str: ...
+    def serializeBinary(self, sketchSize: int = 64, compressPostings: bool = True) -> bytes: ...
+    def memoryUsage(self) -> MemoryUsage: ...
 
     @staticmethod
     def deserialize(serialization: str) -> Index: ...
 
+class ExternalBuildStats:
+    pairs: int
+    runs: int
+    runBytes: int
+    hashes: int
+
+class ExternalIndexBuilder:
+    def __init__(
+        self,
+        k: int,
+        w: int,
+        temporaryDirectory: str = "",
+        memoryBudget: int = 268435456,
+        threads: int = 0,
+        sketchSize: int = 64,
+        compressPostings: bool = True,
+    ): ...
+    def addGroup(self, name: str) -> int: ...
+    def add(self, group: int, code: str) -> None: ...
+    def finish(self, output: str) -> None: ...
+    def stats(self) -> ExternalBuildStats: ...
+
+class MadvisePolicy:
+    hugePages: bool
+    willNeed: bool
+
+    def __init__(
+        self,
+        hashes: str = "random",
+        postings: str = "random",
+        metadata: str = "normal",
+        hugePages: bool = False,
+        willNeed: bool = False,
+    ): ...
+
+class MappedIndex:
+    k: int
+    w: int
+    groupCount: int
+    hashCount: int
+    hasHierarchy: bool
+    compressedPostings: bool
+
+    def __init__(self, path: str, policy: MadvisePolicy = ...): ...
+    def advise(self, policy: MadvisePolicy) -> bool: ...
+    def matchExternal(self, code: str) -> list["Pair"]: ...
+    def matchTokens(self, tokens: "TokenizedFile") -> list["Pair"]: ...
+    def matchPruned(self, tokens: "TokenizedFile", beam: float = 0.5, leafGroups: int = 8) -> list["Pair"]: ...
+
+class ShardedIndex:
+    k: int
+    w: int
+    groupCount: int
+    hashCount: int
+    shardCount: int
+
+    def __init__(self, addresses: list[str]): ...
+    def matchExternal(self, code: str) -> list["Pair"]: ...
+    def matchTokens(self, tokens: "TokenizedFile") -> list["Pair"]: ...
+
+class ExactIndex:
+    def __init__(self, path: str): ...
+    def lookup(self, code: str) -> tuple[list[str], bool] | None: ...
+    def __len__(self) -> int: ...
+
+class BannerScanner:
+    def __init__(self, packages: list[str], minLength: int = 3): ...
+    def scan(self, code: str) -> list[tuple[str, str, int]]: ...
+    def __len__(self) -> int: ...
+
+class AdvisoryIndex:
+    def __init__(self): ...
+    def add(self, package: str, id: str, level: str, ranges: list[str]) -> int: ...
+    def match(self, package: str, version: str) -> list[int]: ...
+    def matchBatch(self, packages: list[str], versions: list[str], threads: int = 0) -> list[tuple[int, int]]: ...
+    def package(self, advisory: int) -> str: ...
+    def id(self, advisory: int) -> str: ...
+    def level(self, advisory: int) -> str: ...
+    def __len__(self) -> int: ...
+
+class PackWriterStats:
+    hits: int
+    misses: int
+    bytesIn: int
+    bytesOut: int
+
+class PackWriter:
+    def __init__(self, directory: str, packSize: int = 1 << 30, threads: int = 0, preset: int = 6,
+                 seedLoose: bool = False): ...
+    def put(self, key: str, data: bytes | str) -> bool: ...
+    def putCompressed(self, key: str, compressed: bytes) -> bool: ...
+    def flush(self) -> None: ...
+    def stats(self) -> PackWriterStats: ...
+    def __contains__(self, key: str) -> bool: ...
+
+class PackReader:
+    def __init__(self, directory: str, advice: str = "random"): ...
+    def get(self, key: str) -> bytes | None: ...
+    def compressed(self, key: str) -> bytes | None: ...
+    def keys(self) -> list[str]: ...
+    def __contains__(self, key: str) -> bool: ...
+    def __len__(self) -> int: ...
+
+class ZstdPack:
+    def __init__(self, path: str, advice: str = "random"): ...
+    def get(self, key: str) -> bytes | None: ...
+    def keys(self) -> list[str]: ...
+    def __contains__(self, key: str) -> bool: ...
+    def __len__(self) -> int: ...
+
+class IndexRegistry:
+    generation: int
+
+    def __init__(self, directory: str, policy: MadvisePolicy = ..., hotPackages: list[str] = []): ...
+    def reload(self) -> int: ...
+    def reloadAsync(self) -> bool: ...
+    def isReloading(self) -> bool: ...
+    def packages(self) -> list[str]: ...
+    def matchExternal(self, pkg: str, code: str) -> list["Pair"] | None: ...
+    def matchTokens(self, pkg: str, tokens: "TokenizedFile") -> list["Pair"] | None: ...
+
+class NodeStats:
+    node: int
+    jobs: int
+    localHits: int
+    sharedHits: int
+    misses: int
+    localHitRate: float
+
+    def __repr__(self) -> str: ...
+
+class NumaMatcher:
+    def __init__(
+        self,
+        directory: str,
+        topology: str = "",
+        placement: str = "shared",
+        hotPackages: list[str] = [],
+        workersPerNode: int = 0,
+    ): ...
+    def reload(self) -> int: ...
+    def replicate(self) -> None: ...
+    def match(self, pkg: str, code: str, node: int | None = None) -> list["Pair"] | None: ...
+    def matchMany(self, jobs: list[tuple[str, str]]) -> list[list["Pair"] | None]: ...
+    def nodes(self) -> list[list[int]]: ...
+    def stats(self) -> list[NodeStats]: ...
+    def resetStats(self) -> None: ...
+
 class Pair:
     left: int
     right: int
@@ -1,9 +1,34 @@
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <filesystem>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <map>
+#include <ranges>
 #include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
 #include <vector>
 
+#include "src/banner.h"
+#include "src/batchio.h"
+#include "src/binary.h"
+#include "src/classify.h"
+#include "src/cluster.h"
+#include "src/compare.h"
+#include "src/crawl.h"
+#include "src/exact.h"
+#include "src/external.h"
 #include "src/index.h"
+#include "src/parallel.h"
+#include "src/shard.h"
+#include "src/store.h"
+#include "src/trace.h"
+#include "src/zpack.h"
 
 
 std::vector<char> readFile(const std::string &name) {
@@ -41,9 +66,787 @@ extern "C" void compareFiles(const char *f1, const char *f2) {
     std::cout << "Total: " << pair.leftTotal << "/" << pair.rightTotal << std::endl;
 }
 
+static void usage(const char *program) {
+    std::cerr << "Usage: " << program << " file1 file2\n"
+            << "       " << program << " compare [options] (file | directory)...\n"
+            << "       " << program << " index stats (pkg.index.json | pkg.index.bin)\n"
+            << "       " << program << " index build [-k N] [-w N] [-j N] [--memory MIB] [--tmp DIR] [--ext LIST] "
+            << "<pkg.index.bin> <version directory>...\n"
+            << "       " << program << " shard split <pkg.index.bin> <count> <output prefix>\n"
+            << "       " << program << " shard serve <shard.bin> (socket path | host:port)\n"
+            << "       " << program << " shard match [-n N] <address,...> file...\n"
+            << "       " << program << " exact build <npm mirror> <table> [-j N] [--ext LIST]\n"
+            << "       " << program << " exact lookup <table> file...\n"
+            << "       " << program << " banner (packages.txt | index directory) file...\n"
+            << "       " << program << " jobs [-j N] [--requires-sourcemap] [--exclude LIST] -o <jobs> crawl.bson...\n"
+            << "       " << program << " classify file...\n"
+            << "       " << program << " cluster [-j N] [--threshold X] -o <clusters.tsv> <store> <jobs>\n"
+            << "       " << program << " store import <store> <loose directory> [-j N] [--pack-size MIB]\n"
+            << "       " << program << " store get <store> key...\n"
+            << "       " << program << " zpack build (store directory | store.tar) <zpack> [-j N] [--level N]\n"
+            << "       " << program << " zpack get <zpack> key...\n"
+            << "\n"
+            << "Options of compare:\n"
+            << "  -k N             k-gram length (default 17)\n"
+            << "  -w N             winnowing window (default 23)\n"
+            << "  -j N             threads, 0 for one per core (default 0)\n"
+            << "  --list FILE      also read paths from FILE, one per line, - for stdin\n"
+            << "  --ext LIST       extensions searched in directories (default .js,.mjs,.cjs)\n"
+            << "  --format FORMAT  csv or binary (default csv)\n"
+            << "  -o FILE          write the matrix to FILE instead of stdout\n"
+            << "  --trace FILE     write a Chrome trace of the run to FILE, e.g. for Perfetto" << std::endl;
+}
+
+static uint32_t parseNumber(const std::string_view option, const std::string_view value) {
+    uint32_t result = 0;
+    const auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), result);
+    if (error != std::errc() || end != value.data() + value.size()) {
+        throw std::invalid_argument("Invalid value for " + std::string(option) + ": " + std::string(value));
+    }
+    return result;
+}
+
+static std::vector<std::string> splitList(const std::string_view value) {
+    std::vector<std::string> result;
+    for (const auto part: value | std::views::split(',')) {
+        if (!part.empty()) {
+            result.emplace_back(part.begin(), part.end());
+        }
+    }
+    return result;
+}
+
+// dolos classify: prints the input class of every file, as checked before parsing
+static int classifyCommand(const std::vector<std::string_view> &args) {
+    if (args.empty()) {
+        throw std::invalid_argument("Expected: classify file...");
+    }
+    for (const auto arg: args) {
+        const std::filesystem::path path(arg);
+        const auto [data, error] = dolos::readWithPread(path);
+        if (error != 0) {
+            throw std::system_error(error, std::generic_category(), "Failed to read " + path.string());
+        }
+        std::cout << path.string() << ": " << dolos::inputClassName(dolos::classifyInput(data)) << "\n";
+    }
+    return 0;
+}
+
+// dolos cluster: groups near-duplicate jobs and writes the representative and similarity of every job
+static int clusterCommand(const std::vector<std::string_view> &args) {
+    dolos::ClusterOptions options;
+    std::string output;
+    std::vector<std::string_view> positional;
+    for (size_t i = 0; i < args.size(); i++) {
+        const auto arg = args[i];
+        const auto value = [&] {
+            if (i + 1 >= args.size()) {
+                throw std::invalid_argument("Missing value for " + std::string(arg));
+            }
+            return args[++i];
+        };
+
+        if (arg == "-j") {
+            options.threads = parseNumber(arg, value());
+        } else if (arg == "-o") {
+            output = value();
+        } else if (arg == "--threshold") {
+            const auto text = value();
+            const auto [ptr, error] = std::from_chars(text.data(), text.data() + text.size(), options.threshold);
+            if (error != std::errc() || ptr != text.data() + text.size() || options.threshold <= 0
+                || options.threshold > 1) {
+                throw std::invalid_argument("Invalid value for --threshold: " + std::string(text));
+            }
+        } else if (arg.starts_with("-")) {
+            throw std::invalid_argument("Unknown option " + std::string(arg));
+        } else {
+            positional.emplace_back(arg);
+        }
+    }
+    if (positional.size() != 2 || output.empty()) {
+        throw std::invalid_argument("Expected: cluster -o <clusters.tsv> <store> <jobs>");
+    }
+
+    // Jobs as written by dolos jobs, or one per line
+    const auto [data, error] = dolos::readWithPread(std::filesystem::path(positional[1]));
+    if (error != 0) {
+        throw std::system_error(error, std::generic_category(), "Failed to read " + std::string(positional[1]));
+    }
+    std::vector<std::string> jobs, sources, sourceMaps;
+    for (const auto part: std::views::split(std::string_view(data), '\0')) {
+        for (const auto line: std::views::split(std::string_view(part), '\n')) {
+            if (const std::string_view job(line); !job.empty()) {
+                const auto colon = job.find(':');
+                jobs.emplace_back(job);
+                sources.emplace_back(job.substr(0, colon));
+                sourceMaps.emplace_back(colon == std::string_view::npos ? "" : job.substr(colon + 1));
+            }
+        }
+    }
+
+    // Scripts are compared by their source, but compartments are identified with the source map, so only jobs with
+    // the same map (or both without one) share a cluster
+    const auto clustering = dolos::clusterObjects(std::filesystem::path(positional[0]), sources, options, sourceMaps);
+    std::ofstream file(output);
+    for (size_t i = 0; i < jobs.size(); i++) {
+        file << jobs[i] << "\t" << jobs[clustering.representatives[i]] << "\t" << clustering.similarities[i] << "\n";
+    }
+    if (!file) {
+        throw std::runtime_error("Failed to write " + output);
+    }
+    std::cerr << jobs.size() << " jobs in " << clustering.clusters << " clusters" << std::endl;
+    return 0;
+}
+
+// dolos compare: fingerprints all inputs in parallel and writes the covered/total matrix of every pair
+static int compareCommand(const std::vector<std::string_view> &args) {
+    uint32_t k = 17, w = 23, threads = 0;
+    std::string format = "csv", output, trace;
+    std::vector<std::string> extensions = {".js", ".mjs", ".cjs"};
+    std::vector<std::filesystem::path> paths;
+
+    for (size_t i = 0; i < args.size(); i++) {
+        const auto arg = args[i];
+        const auto value = [&] {
+            if (i + 1 >= args.size()) {
+                throw std::invalid_argument("Missing value for " + std::string(arg));
+            }
+            return args[++i];
+        };
+
+        if (arg == "-k") {
+            k = parseNumber(arg, value());
+        } else if (arg == "-w") {
+            w = parseNumber(arg, value());
+        } else if (arg == "-j") {
+            threads = parseNumber(arg, value());
+        } else if (arg == "--ext") {
+            extensions = splitList(value());
+        } else if (arg == "--format") {
+            format = value();
+        } else if (arg == "-o") {
+            output = value();
+        } else if (arg == "--trace") {
+            trace = value();
+        } else if (arg == "--list") {
+            const std::string list(value());
+            std::ifstream file;
+            if (list != "-") {
+                file.open(list);
+                if (!file.is_open()) {
+                    throw std::runtime_error("Failed to open file list " + list);
+                }
+            }
+            std::istream &in = list == "-" ? std::cin : file;
+            for (std::string line; std::getline(in, line);) {
+                if (!line.empty()) {
+                    paths.emplace_back(line);
+                }
+            }
+        } else if (arg.starts_with("-") && arg != "-") {
+            throw std::invalid_argument("Unknown option " + std::string(arg));
+        } else {
+            paths.emplace_back(arg);
+        }
+    }
+
+    if (k == 0 || w == 0) {
+        throw std::invalid_argument("k and w must be positive");
+    }
+    if (format != "csv" && format != "binary") {
+        throw std::invalid_argument("Unknown format " + format + ", expected csv or binary");
+    }
+
+    const auto inputs = dolos::collectInputs(paths, extensions);
+    if (inputs.size() < 2) {
+        throw std::invalid_argument("Need at least two files to compare");
+    }
+
+    if (!trace.empty()) {
+        dolos::startTracing();
+    }
+    const auto files = dolos::fingerprintFiles(inputs, k, w, threads);
+    const auto matrix = dolos::compareAll(files, threads);
+
+    std::ofstream file;
+    if (!output.empty()) {
+        file.open(output, std::ios::binary);
+        if (!file.is_open()) {
+            throw std::runtime_error("Failed to open output file " + output);
+        }
+    }
+    std::ostream &out = output.empty() ? std::cout : file;
+    if (format == "binary") {
+        dolos::writeBinary(out, files, matrix);
+    } else {
+        dolos::writeCsv(out, files, matrix);
+    }
+    out.flush();
+    if (!out) {
+        throw std::runtime_error("Failed to write the matrix");
+    }
+
+    if (!trace.empty()) {
+        dolos::stopTracing();
+        std::ofstream traceFile(trace);
+        dolos::writeTrace(traceFile);
+        if (!traceFile) {
+            throw std::runtime_error("Failed to write trace file " + trace);
+        }
+    }
+
+    std::cerr << "Compared " << files.size() << " files (" << matrix.covered.size() << " pairs)" << std::endl;
+    return 0;
+}
+
+// Posting list lengths in power of two buckets: 1, 2-3, 4-7, ...
+struct Histogram {
+    std::vector<uint64_t> buckets;
+
+    void add(const uint64_t length) {
+        if (length == 0) {
+            return;
+        }
+        const auto bucket = static_cast<size_t>(std::bit_width(length) - 1);
+        if (bucket >= buckets.size()) {
+            buckets.resize(bucket + 1, 0);
+        }
+        buckets[bucket] += 1;
+    }
+
+    void print(std::ostream &out) const {
+        for (size_t bucket = 0; bucket < buckets.size(); bucket++) {
+            const uint64_t low = uint64_t{1} << bucket, high = (low << 1) - 1;
+            const auto label = low == high ? std::to_string(low) : std::to_string(low) + "-" + std::to_string(high);
+            out << "  " << std::left << std::setw(14) << label
+                    << std::right << std::setw(12) << buckets[bucket] << "\n";
+        }
+    }
+};
+
+static void printBytes(std::ostream &out, const std::string &label, const size_t bytes) {
+    out << "  " << std::left << std::setw(14) << label << std::right << std::setw(14) << bytes << " B"
+            << std::setw(10) << std::fixed << std::setprecision(1) << static_cast<double>(bytes) / (1 << 20)
+            << " MiB\n";
+}
+
+// dolos index build: binary index of version directories (<pkg>@<version>, in version order) through external
+// sorting, so the memory use stays within --memory however many versions there are
+static int indexBuild(const std::vector<std::string_view> &args) {
+    dolos::ExternalBuildOptions options;
+    uint32_t k = 27, w = 15;
+    std::vector<std::string> extensions = {".js", ".mjs", ".cjs"};
+    std::vector<std::string_view> positional;
+    for (size_t i = 1; i < args.size(); i++) {
+        const auto arg = args[i];
+        const auto value = [&] {
+            if (i + 1 >= args.size()) {
+                throw std::invalid_argument("Missing value for " + std::string(arg));
+            }
+            return args[++i];
+        };
+
+        if (arg == "-k") {
+            k = parseNumber(arg, value());
+        } else if (arg == "-w") {
+            w = parseNumber(arg, value());
+        } else if (arg == "-j") {
+            options.threads = parseNumber(arg, value());
+        } else if (arg == "--memory") {
+            options.memoryBudget = size_t{parseNumber(arg, value())} << 20;
+        } else if (arg == "--tmp") {
+            options.temporaryDirectory = value();
+        } else if (arg == "--ext") {
+            extensions = splitList(value());
+        } else if (arg.starts_with("-")) {
+            throw std::invalid_argument("Unknown option " + std::string(arg));
+        } else {
+            positional.emplace_back(arg);
+        }
+    }
+    if (positional.size() < 2) {
+        throw std::invalid_argument("Expected: index build <pkg.index.bin> <version directory>...");
+    }
+
+    dolos::ExternalIndexBuilder builder(k, w, options);
+    std::vector<std::filesystem::path> files;
+    std::vector<uint16_t> fileGroups;
+    for (const auto directory: positional | std::views::drop(1)) {
+        // Versions are named like the groups of the preindexer, <pkg>@ (scoped or not) is dropped
+        auto name = std::filesystem::path(directory).filename().string();
+        if (const auto at = name.rfind('@'); at != std::string::npos && at > 0) {
+            name.erase(0, at + 1);
+        }
+        const auto group = builder.addGroup(name);
+        for (auto &file: dolos::collectInputs({std::filesystem::path(directory)}, extensions)) {
+            files.emplace_back(std::move(file));
+            fileGroups.emplace_back(group);
+        }
+    }
+
+    dolos::parallelFor(files.size(), options.threads, [&](const size_t i) {
+        const auto [data, error] = dolos::readWithPread(files[i]);
+        if (error != 0) {
+            throw std::system_error(error, std::generic_category(), "Failed to read " + files[i].string());
+        }
+        builder.add(fileGroups[i], data);
+    });
+    builder.finish(std::filesystem::path(positional[0]));
+
+    const auto stats = builder.stats();
+    std::cerr << "Indexed " << files.size() << " files of " << positional.size() - 1 << " versions, "
+            << stats.hashes << " distinct hashes from " << stats.pairs << " fingerprints in " << stats.runs
+            << " sorted runs (" << stats.runBytes << " bytes)" << std::endl;
+    return 0;
+}
+
+// dolos index stats: memory breakdown, posting list lengths and fingerprints per group of one index
+static int indexCommand(const std::vector<std::string_view> &args) {
+    if (!args.empty() && args[0] == "build") {
+        return indexBuild(args);
+    }
+    if (args.size() != 2 || args[0] != "stats") {
+        throw std::invalid_argument("Expected: index stats <index file> or index build <pkg.index.bin> <directory>...");
+    }
+    const std::filesystem::path path(args[1]);
+    auto &out = std::cout;
+
+    Histogram lengths;
+    std::vector<std::pair<std::string, uint32_t>> groupSizes;
+    uint16_t k, w;
+    size_t hashCount;
+
+    if (path.extension() == ".bin") {
+        const dolos::MappedIndex index(path);
+        k = index.k();
+        w = index.w();
+        hashCount = index.hashCount();
+
+        uint64_t runCount = 0;
+        std::vector<dolos::Run> buffer;
+        for (const auto hash: index.allHashes()) {
+            uint64_t length = 0;
+            for (const auto [first, last]: index.lookup(hash, buffer)) {
+                length += last - first + 1;
+                runCount += 1;
+            }
+            lengths.add(length);
+        }
+        for (uint16_t group = 0; group < index.groupCount(); group++) {
+            groupSizes.emplace_back(index.name(group), index.groupSize(group));
+        }
+
+        out << "Memory (mapped)\n";
+        printBytes(out, "file", index.fileSize());
+        out << "  " << std::left << std::setw(14) << "runs" << std::right << std::setw(14) << runCount << "\n";
+        out << "  " << std::left << std::setw(14) << "hierarchy" << std::right << std::setw(14)
+                << (index.hasHierarchy() ? "yes" : "no") << "\n";
+        out << "  " << std::left << std::setw(14) << "postings" << std::right << std::setw(14)
+                << (index.compressedPostings() ? "compressed" : "runs") << "\n";
+        if (index.shardCount() > 0) {
+            out << "  " << std::left << std::setw(14) << "shard" << std::right << std::setw(14)
+                    << std::to_string(index.shard()) + " of " + std::to_string(index.shardCount()) << "\n";
+        }
+    } else {
+        const auto [data, error] = dolos::readWithPread(path);
+        if (error != 0) {
+            throw std::system_error(error, std::generic_category(), "Failed to read " + path.string());
+        }
+        const dolos::Index index(data);
+        k = index.k;
+        w = index.w;
+        hashCount = index.index.size();
+
+        for (const auto &ids: index.index | std::views::values) {
+            lengths.add(ids.size());
+        }
+        for (uint16_t group = 0; group < index.groupCount(); group++) {
+            const auto name = index.names.find(group);
+            const auto hashes = index.groups.find(group);
+            groupSizes.emplace_back(name == index.names.end() ? "" : name->second,
+                                    hashes == index.groups.end() ? 0 : hashes->second.size());
+        }
+
+        const auto usage = index.memoryUsage();
+        out << "Memory (estimated heap)\n";
+        printBytes(out, "postings", usage.postings);
+        printBytes(out, "group sets", usage.groupSets);
+        printBytes(out, "table nodes", usage.tableNodes);
+        printBytes(out, "buckets", usage.buckets);
+        printBytes(out, "names", usage.names);
+        printBytes(out, "total", usage.total());
+    }
+
+    out << "\nk " << k << ", w " << w << ", " << hashCount << " hashes, " << groupSizes.size() << " groups\n";
+    out << "\nPosting list length (groups per hash)\n";
+    lengths.print(out);
+    out << "\nFingerprints per group\n";
+    for (const auto &[name, size]: groupSizes) {
+        out << "  " << std::left << std::setw(40) << name << std::right << std::setw(12) << size << "\n";
+    }
+    out.flush();
+    return 0;
+}
+
+// dolos shard split: hash range shards of a binary index. dolos shard serve: answers coordinators with the shared
+// hashes per group of one shard. dolos shard match: prints the best matching groups of each file across all shards.
+static int shardCommand(const std::vector<std::string_view> &args) {
+    if (args.size() == 4 && args[0] == "split") {
+        const dolos::MappedIndex index{std::filesystem::path(args[1])};
+        const auto count = parseNumber("count", args[2]);
+        for (const auto &path: dolos::splitBinary(index, count, std::filesystem::path(args[3]))) {
+            const dolos::MappedIndex shard(path);
+            std::cout << path.string() << "\t" << shard.hashCount() << " hashes\n";
+        }
+        return 0;
+    }
+
+    if (args.size() == 3 && args[0] == "serve") {
+        dolos::ShardServer server(std::filesystem::path(args[1]), args[2]);
+        std::cerr << "Serving " << server.shard().hashCount() << " hashes of shard " << server.shard().shard() << " of "
+                << std::max<uint16_t>(server.shard().shardCount(), 1) << " on " << args[2] << std::endl;
+        server.serve();
+    }
+
+    if (args.size() >= 3 && args[0] == "match") {
+        uint32_t top = 5;
+        size_t i = 1;
+        if (args[i] == "-n" && i + 2 < args.size()) {
+            top = parseNumber(args[i], args[i + 1]);
+            i += 2;
+        }
+        dolos::ShardedIndex index(splitList(args[i]));
+        for (const auto file: args | std::views::drop(i + 1)) {
+            const auto [data, error] = dolos::readWithPread(std::filesystem::path(file));
+            if (error != 0) {
+                throw std::system_error(error, std::generic_category(), "Failed to read " + std::string(file));
+            }
+            auto pairs = index.matchExternal(data);
+            std::ranges::stable_sort(pairs, std::ranges::greater{}, &dolos::Pair::covered);
+            for (const auto &pair: pairs | std::views::take(top)) {
+                if (pair.covered > 0) {
+                    std::cout << file << "\t" << pair.right << "\t" << pair.covered << "/" << pair.leftTotal << "\t"
+                            << pair.rightTotal << "\n";
+                }
+            }
+        }
+        return 0;
+    }
+
+    throw std::invalid_argument("Expected: shard split <pkg.index.bin> <count> <prefix>, shard serve <shard.bin> "
+                                "<address> or shard match <address,...> file...");
+}
+
+// dolos exact build: hashes every file of an NPM mirror (<pkg>@<version> directories, scoped packages with + instead
+// of /) into an exact hash table. dolos exact lookup: prints the versions containing each given file.
+static int exactCommand(const std::vector<std::string_view> &args) {
+    if (args.size() >= 3 && args[0] == "build") {
+        const std::filesystem::path mirror(args[1]);
+        const std::string output(args[2]);
+        uint32_t threads = 0;
+        std::vector<std::string> extensions = {".js", ".mjs", ".cjs"};
+        for (size_t i = 3; i < args.size(); i++) {
+            if (args[i] == "-j" && i + 1 < args.size()) {
+                threads = parseNumber(args[i], args[i + 1]);
+                i++;
+            } else if (args[i] == "--ext" && i + 1 < args.size()) {
+                extensions = splitList(args[++i]);
+            } else {
+                throw std::invalid_argument("Unknown option " + std::string(args[i]));
+            }
+        }
+
+        std::vector<std::string> versions;
+        std::vector<uint32_t> fileVersions;
+        std::vector<std::filesystem::path> files;
+        std::vector<std::filesystem::path> directories;
+        for (const auto &entry: std::filesystem::directory_iterator(mirror)) {
+            if (entry.is_directory() && entry.path().filename().string().find('@', 1) != std::string::npos) {
+                directories.emplace_back(entry.path());
+            }
+        }
+        std::ranges::sort(directories);
+        for (const auto &directory: directories) {
+            auto version = directory.filename().string();
+            std::ranges::replace(version, '+', '/');
+            for (auto &file: dolos::collectInputs({directory}, extensions)) {
+                files.emplace_back(std::move(file));
+                fileVersions.emplace_back(versions.size());
+            }
+            versions.emplace_back(std::move(version));
+        }
+
+        std::vector<std::pair<dolos::Digest, dolos::Digest>> digests(files.size());
+        dolos::parallelFor(files.size(), threads, [&](const size_t i) {
+            const auto [data, error] = dolos::readWithPread(files[i]);
+            if (error != 0) {
+                throw std::system_error(error, std::generic_category(), "Failed to read " + files[i].string());
+            }
+            digests[i] = {dolos::sha1(data), dolos::normalizedSha1(data)};
+        });
+
+        dolos::ExactIndexBuilder builder;
+        for (size_t i = 0; i < files.size(); i++) {
+            builder.add(versions[fileVersions[i]], digests[i].first, digests[i].second);
+        }
+
+        // Written next to the target and renamed, so a serving process never maps a partial file
+        {
+            std::ofstream file(output + ".tmp", std::ios::binary);
+            file << builder.serialize();
+            if (!file) {
+                throw std::runtime_error("Failed to write " + output);
+            }
+        }
+        std::filesystem::rename(output + ".tmp", output);
+
+        std::cerr << "Hashed " << files.size() << " files of " << versions.size() << " versions, "
+                << builder.size() << " distinct digests" << std::endl;
+        return 0;
+    }
+
+    if (args.size() >= 3 && args[0] == "lookup") {
+        const dolos::ExactIndex table{std::filesystem::path(args[1])};
+        for (size_t i = 2; i < args.size(); i++) {
+            const std::filesystem::path path(args[i]);
+            const auto [data, error] = dolos::readWithPread(path);
+            if (error != 0) {
+                throw std::system_error(error, std::generic_category(), "Failed to read " + path.string());
+            }
+            std::cout << path.string() << ":";
+            if (const auto match = table.lookup(data)) {
+                std::cout << (match->normalized ? " (whitespace normalized)" : "");
+                for (const auto version: match->versions) {
+                    std::cout << " " << version;
+                }
+            } else {
+                std::cout << " no exact match";
+            }
+            std::cout << "\n";
+        }
+        return 0;
+    }
+
+    throw std::invalid_argument("Expected: exact build <npm mirror> <table> or exact lookup <table> <file>...");
+}
+
+// Package names from a file with one name per line, or from the <pkg>.index.json / <pkg>.index.bin files (scoped
+// packages with + instead of /) of an index directory
+static std::vector<std::string> readPackageNames(const std::filesystem::path &path) {
+    std::vector<std::string> names;
+    if (std::filesystem::is_directory(path)) {
+        for (const auto &entry: std::filesystem::directory_iterator(path)) {
+            auto name = entry.path().filename().string();
+            for (const std::string_view suffix: {".index.json", ".index.bin"}) {
+                if (name.ends_with(suffix)) {
+                    name.resize(name.size() - suffix.size());
+                    std::ranges::replace(name, '+', '/');
+                    names.emplace_back(name);
+                    break;
+                }
+            }
+        }
+        return names;
+    }
+
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open package list " + path.string());
+    }
+    for (std::string line; std::getline(file, line);) {
+        if (!line.empty()) {
+            names.emplace_back(std::move(line));
+        }
+    }
+    return names;
+}
+
+// dolos banner: prints every package name followed by a version (license banners, version constants) in the files
+static int bannerCommand(const std::vector<std::string_view> &args) {
+    if (args.size() < 2) {
+        throw std::invalid_argument("Expected: banner (packages.txt | index directory) file...");
+    }
+    const dolos::BannerScanner scanner(readPackageNames(args[0]));
+    for (size_t i = 1; i < args.size(); i++) {
+        const std::filesystem::path path(args[i]);
+        const auto [data, error] = dolos::readWithPread(path);
+        if (error != 0) {
+            throw std::system_error(error, std::generic_category(), "Failed to read " + path.string());
+        }
+        for (const auto &hit: scanner.scan(data)) {
+            std::cout << path.string() << ":" << hit.offset << "\t" << scanner.package(hit.package) << "@"
+                    << hit.version << "\n";
+        }
+    }
+    return 0;
+}
+
+// dolos jobs: the deduplicated scripts of crawl files as identification jobs
+static int jobsCommand(const std::vector<std::string_view> &args) {
+    dolos::CrawlFilter filter;
+    uint32_t threads = 0;
+    std::string output;
+    std::vector<std::filesystem::path> files;
+    for (size_t i = 0; i < args.size(); i++) {
+        const auto arg = args[i];
+        const auto value = [&] {
+            if (i + 1 >= args.size()) {
+                throw std::invalid_argument("Missing value for " + std::string(arg));
+            }
+            return args[++i];
+        };
+
+        if (arg == "-j") {
+            threads = parseNumber(arg, value());
+        } else if (arg == "-o") {
+            output = value();
+        } else if (arg == "--requires-sourcemap") {
+            filter.requiresSourceMap = true;
+        } else if (arg == "--exclude") {
+            filter.excludedUrls = splitList(value());
+        } else if (arg.starts_with("-")) {
+            throw std::invalid_argument("Unknown option " + std::string(arg));
+        } else {
+            files.emplace_back(arg);
+        }
+    }
+    if (files.empty() || output.empty()) {
+        throw std::invalid_argument("Expected: jobs -o <jobs> crawl.bson...");
+    }
+
+    const auto result = dolos::buildJobList(files, filter, threads);
+    {
+        std::ofstream file(output, std::ios::binary);
+        dolos::writeJobList(file, result.jobs);
+        if (!file) {
+            throw std::runtime_error("Failed to write " + output);
+        }
+    }
+    std::cerr << result.documents << " documents, " << result.scripts << " scripts, " << result.jobs.size()
+            << " jobs" << std::endl;
+    return 0;
+}
+
+static int storeCommand(const std::vector<std::string_view> &args) {
+    if (args.size() >= 3 && args[0] == "import") {
+        const std::filesystem::path store(args[1]), loose(args[2]);
+        dolos::PackWriterOptions options;
+        for (size_t i = 3; i < args.size(); i++) {
+            if (args[i] == "-j" && i + 1 < args.size()) {
+                options.threads = parseNumber(args[i], args[i + 1]);
+                i++;
+            } else if (args[i] == "--pack-size" && i + 1 < args.size()) {
+                options.packSize = uint64_t{parseNumber(args[i], args[i + 1])} << 20;
+                i++;
+            } else {
+                throw std::invalid_argument("Unknown option " + std::string(args[i]));
+            }
+        }
+
+        // Loose objects are already xz compressed and are copied as is, the loose files are left in place
+        dolos::PackWriter writer(store, options);
+        for (const auto &entry: std::filesystem::directory_iterator(loose)) {
+            const auto key = entry.path().filename().string();
+            if (!entry.is_regular_file() || key.starts_with("pack-") || writer.contains(key)) {
+                continue;
+            }
+            auto [data, error] = dolos::readWithPread(entry.path());
+            if (error != 0) {
+                throw std::system_error(error, std::generic_category(), "Failed to read " + entry.path().string());
+            }
+            writer.putCompressed(key, std::move(data));
+        }
+        writer.flush();
+
+        const auto stats = writer.stats();
+        std::cerr << "Imported " << stats.misses << " objects, " << stats.bytesOut << " bytes" << std::endl;
+        return 0;
+    }
+
+    if (args.size() >= 3 && args[0] == "get") {
+        const dolos::PackReader store{std::filesystem::path(args[1])};
+        for (size_t i = 2; i < args.size(); i++) {
+            const std::string key(args[i]);
+            if (!store.contains(key)) {
+                throw std::runtime_error("Object not found: " + key);
+            }
+            const auto data = dolos::xzDecompress(store.compressed(key));
+            std::cout.write(data.data(), static_cast<std::streamsize>(data.size()));
+        }
+        return 0;
+    }
+
+    throw std::invalid_argument("Expected: store import <store> <loose directory> or store get <store> <key>...");
+}
+
+static int zpackCommand(const std::vector<std::string_view> &args) {
+    if (args.size() >= 3 && args[0] == "build") {
+        const std::filesystem::path source(args[1]), output(args[2]);
+        dolos::ZstdPackOptions options;
+        for (size_t i = 3; i < args.size(); i++) {
+            if (args[i] == "-j" && i + 1 < args.size()) {
+                options.threads = parseNumber(args[i], args[i + 1]);
+                i++;
+            } else if (args[i] == "--level" && i + 1 < args.size()) {
+                options.level = static_cast<int>(parseNumber(args[i], args[i + 1]));
+                i++;
+            } else {
+                throw std::invalid_argument("Unknown option " + std::string(args[i]));
+            }
+        }
+
+        const auto stats = dolos::buildZstdPack(source, output, options);
+        std::cerr << "Packed " << stats.objects << " objects, " << stats.rawBytes << " bytes into " << stats.packBytes
+                << " bytes" << std::endl;
+        return 0;
+    }
+
+    if (args.size() >= 3 && args[0] == "get") {
+        const dolos::ZstdPack pack{std::filesystem::path(args[1])};
+        for (size_t i = 2; i < args.size(); i++) {
+            const auto data = pack.get(args[i]);
+            if (!data) {
+                throw std::runtime_error("Object not found: " + std::string(args[i]));
+            }
+            std::cout.write(data->data(), static_cast<std::streamsize>(data->size()));
+        }
+        return 0;
+    }
+
+    throw std::invalid_argument("Expected: zpack build <store> <zpack> or zpack get <zpack> <key>...");
+}
+
 int main(int argc, char **argv) {
+    using Command = int (*)(const std::vector<std::string_view> &);
+    static const std::map<std::string_view, Command> commands = {
+        {"banner", bannerCommand},
+        {"classify", classifyCommand},
+        {"cluster", clusterCommand},
+        {"compare", compareCommand},
+        {"exact", exactCommand},
+        {"index", indexCommand},
+        {"jobs", jobsCommand},
+        {"shard", shardCommand},
+        {"store", storeCommand},
+        {"zpack", zpackCommand},
+    };
+
+    if (const auto command = argc >= 2 ? commands.find(argv[1]) : commands.end(); command != commands.end()) {
+        const std::vector<std::string_view> args(argv + 2, argv + argc);
+        try {
+            return command->second(args);
+        } catch (const std::invalid_argument &e) {
+            std::cerr << e.what() << "\n\n";
+            usage(argv[0]);
+            return 1;
+        } catch (const std::exception &e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+    }
+
     if (argc < 3) {
-        std::cerr << "Usage: " << argv[0] << " file1 file2" << std::endl;
+        usage(argv[0]);
         return 1;
     }
 
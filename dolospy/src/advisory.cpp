@@ -0,0 +1,401 @@
+#include "advisory.h"
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <ranges>
+#include <stdexcept>
+
+#include "parallel.h"
+
+namespace dolos {
+    static bool isNumeric(const std::string_view identifier) {
+        return !identifier.empty()
+               && std::ranges::all_of(identifier, [](const char c) { return c >= '0' && c <= '9'; });
+    }
+
+    // Pre-release precedence: identifiers from left to right, numeric ones by value and below alphanumeric ones, a
+    // shorter list of equal identifiers first
+    static std::strong_ordering comparePrerelease(const std::string_view a, const std::string_view b) {
+        size_t i = 0, j = 0;
+        while (i <= a.size() && j <= b.size()) {
+            const auto aEnd = std::min(a.find('.', i), a.size());
+            const auto bEnd = std::min(b.find('.', j), b.size());
+            const auto x = a.substr(i, aEnd - i);
+            const auto y = b.substr(j, bEnd - j);
+            const bool xNumeric = isNumeric(x), yNumeric = isNumeric(y);
+            std::strong_ordering order = std::strong_ordering::equal;
+            if (xNumeric && yNumeric) {
+                // Without leading zeros the longer number is larger
+                const auto xDigits = x.substr(std::min(x.find_first_not_of('0'), x.size()));
+                const auto yDigits = y.substr(std::min(y.find_first_not_of('0'), y.size()));
+                order = xDigits.size() != yDigits.size() ? xDigits.size() <=> yDigits.size() : xDigits <=> yDigits;
+            } else if (xNumeric != yNumeric) {
+                order = xNumeric ? std::strong_ordering::less : std::strong_ordering::greater;
+            } else {
+                order = x <=> y;
+            }
+            if (order != 0) {
+                return order;
+            }
+            i = aEnd + 1;
+            j = bEnd + 1;
+        }
+        return a.size() <=> b.size();
+    }
+
+    std::strong_ordering SemVer::operator<=>(const SemVer &other) const {
+        if (const auto order = std::tie(major, minor, patch) <=> std::tie(other.major, other.minor, other.patch);
+            order != 0) {
+            return order;
+        }
+        // A release ranks above its pre-releases
+        if (prerelease.empty() != other.prerelease.empty()) {
+            return prerelease.empty() ? std::strong_ordering::greater : std::strong_ordering::less;
+        }
+        return comparePrerelease(prerelease, other.prerelease);
+    }
+
+    std::strong_ordering VersionBound::operator<=>(const VersionBound &other) const {
+        if (infinity != 0 || other.infinity != 0) {
+            return infinity <=> other.infinity;
+        }
+        if (const auto order = version <=> other.version; order != 0) {
+            return order;
+        }
+        return side <=> other.side;
+    }
+
+    namespace {
+        // Version with missing or wildcard parts, as used in ranges
+        struct PartialVersion {
+            std::array<uint64_t, 3> parts{};
+            // Number of given parts, 0 for "*"
+            int count = 0;
+            std::string prerelease;
+        };
+
+        const VersionBound lowestBound{.infinity = -1, .version = {}, .side = 0};
+        const VersionBound highestBound{.infinity = 1, .version = {}, .side = 0};
+
+        VersionBound before(SemVer version) {
+            return {.infinity = 0, .version = std::move(version), .side = -1};
+        }
+
+        VersionBound after(SemVer version) {
+            return {.infinity = 0, .version = std::move(version), .side = 1};
+        }
+    }
+
+    static bool isWildcard(const std::string_view part) {
+        return part == "x" || part == "X" || part == "*";
+    }
+
+    static PartialVersion parsePartial(std::string_view text) {
+        if (!text.empty() && (text.front() == 'v' || text.front() == 'V')) {
+            text.remove_prefix(1);
+        }
+        PartialVersion result;
+        if (text.empty() || isWildcard(text)) {
+            return result;
+        }
+
+        if (const auto build = text.find('+'); build != std::string_view::npos) {
+            text = text.substr(0, build);
+        }
+        std::string_view prerelease;
+        if (const auto dash = text.find('-'); dash != std::string_view::npos) {
+            prerelease = text.substr(dash + 1);
+            text = text.substr(0, dash);
+            if (prerelease.empty()) {
+                throw std::invalid_argument("Empty pre-release in version range");
+            }
+        }
+
+        bool wildcard = false;
+        size_t start = 0;
+        for (int i = 0; i < 3 && start <= text.size(); i++) {
+            const auto end = std::min(text.find('.', start), text.size());
+            const auto part = text.substr(start, end - start);
+            start = end + 1;
+            if (isWildcard(part)) {
+                wildcard = true;
+                continue;
+            }
+            const auto [ptr, error] = std::from_chars(part.data(), part.data() + part.size(), result.parts[i]);
+            if (part.empty() || wildcard || error != std::errc() || ptr != part.data() + part.size()) {
+                throw std::invalid_argument("Invalid version in range: " + std::string(text));
+            }
+            result.count = i + 1;
+        }
+        if (start <= text.size()) {
+            throw std::invalid_argument("Invalid version in range: " + std::string(text));
+        }
+        if (!prerelease.empty()) {
+            if (result.count != 3) {
+                throw std::invalid_argument("Pre-release of a partial version in range: " + std::string(text));
+            }
+            result.prerelease = prerelease;
+        }
+        return result;
+    }
+
+    std::optional<SemVer> parseSemVer(const std::string_view text) {
+        if (text.empty() || std::ranges::any_of(text, [](const char c) { return c == ' ' || isWildcard({&c, 1}); })) {
+            return std::nullopt;
+        }
+        try {
+            auto partial = parsePartial(text);
+            if (partial.count != 3) {
+                return std::nullopt;
+            }
+            return SemVer{partial.parts[0], partial.parts[1], partial.parts[2], std::move(partial.prerelease)};
+        } catch (const std::invalid_argument &) {
+            return std::nullopt;
+        }
+    }
+
+    // First version matched by the partial version
+    static SemVer lowest(const PartialVersion &version) {
+        return {version.parts[0], version.parts[1], version.parts[2], version.prerelease};
+    }
+
+    // Lowest pre-release above all versions matched by the partial version, 1.2 -> 1.3.0-0
+    static SemVer next(const PartialVersion &version) {
+        if (version.count == 1) {
+            return {version.parts[0] + 1, 0, 0, "0"};
+        }
+        return {version.parts[0], version.parts[1] + 1, 0, "0"};
+    }
+
+    static std::vector<VersionInterval> normalize(std::vector<VersionInterval> intervals) {
+        std::erase_if(intervals, [](const VersionInterval &interval) { return interval.lower >= interval.upper; });
+        std::ranges::sort(intervals, {}, &VersionInterval::lower);
+        std::vector<VersionInterval> merged;
+        for (auto &interval: intervals) {
+            if (!merged.empty() && interval.lower <= merged.back().upper) {
+                merged.back().upper = std::max(merged.back().upper, interval.upper);
+            } else {
+                merged.emplace_back(std::move(interval));
+            }
+        }
+        return merged;
+    }
+
+    static std::vector<VersionInterval> intersect(const std::vector<VersionInterval> &a,
+                                                  const std::vector<VersionInterval> &b) {
+        std::vector<VersionInterval> result;
+        for (const auto &x: a) {
+            for (const auto &y: b) {
+                result.emplace_back(VersionInterval{std::max(x.lower, y.lower), std::min(x.upper, y.upper)});
+            }
+        }
+        return normalize(std::move(result));
+    }
+
+    static std::vector<VersionInterval> comparator(const std::string_view op, const PartialVersion &version) {
+        const bool full = version.count == 3;
+        const VersionInterval everything{lowestBound, highestBound};
+        if (version.count == 0) {
+            if (op == "<" || op == ">" || op == "!=") {
+                return {};
+            }
+            return {everything};
+        }
+
+        // Versions matched by the (partial) version itself
+        const VersionInterval matched = full
+                                            ? VersionInterval{before(lowest(version)), after(lowest(version))}
+                                            : VersionInterval{before(lowest(version)), before(next(version))};
+        if (op.empty() || op == "=" || op == "==") {
+            return {matched};
+        }
+        if (op == "!=") {
+            return normalize({{lowestBound, matched.lower}, {matched.upper, highestBound}});
+        }
+        if (op == ">=") {
+            return {{matched.lower, highestBound}};
+        }
+        if (op == ">") {
+            return {{matched.upper, highestBound}};
+        }
+        if (op == "<") {
+            // Also below the pre-releases of a partial version, <1.2 excludes 1.2.0-rc.1
+            auto bound = lowest(version);
+            if (!full) {
+                bound.prerelease = "0";
+            }
+            return {{lowestBound, before(std::move(bound))}};
+        }
+        if (op == "<=") {
+            return {{lowestBound, matched.upper}};
+        }
+        if (op == "~") {
+            const PartialVersion line{.parts = version.parts, .count = std::min(version.count, 2), .prerelease = {}};
+            return {{matched.lower, before(next(line))}};
+        }
+        if (op == "^") {
+            // Up to the next change of the first non-zero part
+            const auto &[major, minor, patch] = version.parts;
+            SemVer upper;
+            if (major > 0 || version.count == 1) {
+                upper = {major + 1, 0, 0, "0"};
+            } else if (minor > 0 || version.count == 2) {
+                upper = {0, minor + 1, 0, "0"};
+            } else {
+                upper = {0, 0, patch + 1, "0"};
+            }
+            return {{matched.lower, before(std::move(upper))}};
+        }
+        throw std::invalid_argument("Unknown operator in version range: " + std::string(op));
+    }
+
+    static std::vector<VersionInterval> parseAlternative(const std::string_view range) {
+        std::vector<std::string_view> tokens;
+        for (size_t i = 0; i < range.size();) {
+            const auto start = range.find_first_not_of(" \t,", i);
+            if (start == std::string_view::npos) {
+                break;
+            }
+            const auto end = std::min(range.find_first_of(" \t,", start), range.size());
+            tokens.emplace_back(range.substr(start, end - start));
+            i = end;
+        }
+
+        // Hyphen range "1.2.3 - 2.3.4"
+        if (tokens.size() == 3 && tokens[1] == "-") {
+            return normalize({{comparator(">=", parsePartial(tokens[0]))[0].lower,
+                               comparator("<=", parsePartial(tokens[2]))[0].upper}});
+        }
+
+        std::vector<VersionInterval> result = {{lowestBound, highestBound}};
+        for (size_t i = 0; i < tokens.size(); i++) {
+            auto token = tokens[i];
+            const auto versionStart = std::min(token.find_first_not_of("<>=!^~"), token.size());
+            const auto op = token.substr(0, versionStart);
+            auto version = token.substr(versionStart);
+            // Operator separated from its version by a space, ">= 1.0.0"
+            if (version.empty() && !op.empty() && i + 1 < tokens.size()) {
+                version = tokens[++i];
+            }
+            result = intersect(result, comparator(op, parsePartial(version)));
+        }
+        return result;
+    }
+
+    std::vector<VersionInterval> parseVersionRange(const std::string_view range) {
+        std::vector<VersionInterval> result;
+        for (size_t start = 0; start <= range.size();) {
+            const auto end = std::min(range.find("||", start), range.size());
+            const auto alternative = parseAlternative(range.substr(start, end - start));
+            result.insert(result.end(), alternative.begin(), alternative.end());
+            start = end + 2;
+        }
+        return normalize(std::move(result));
+    }
+
+    uint32_t AdvisoryIndex::add(const std::string &package, std::string id, std::string level,
+                                const std::vector<std::string> &ranges) {
+        // Parsed first, so an invalid range leaves the index unchanged
+        std::vector<VersionInterval> affected = {{lowestBound, highestBound}};
+        for (const auto &range: ranges) {
+            affected = intersect(affected, parseVersionRange(range));
+        }
+
+        const auto advisory = static_cast<uint32_t>(entries.size());
+        entries.emplace_back(Advisory{.package = package, .id = std::move(id), .level = std::move(level)});
+        if (affected.empty()) {
+            return advisory;
+        }
+
+        auto &entry = packages[package];
+        for (auto &interval: affected) {
+            entry.intervals.emplace_back(std::move(interval), advisory);
+        }
+        buildSegments(entry);
+        return advisory;
+    }
+
+    void AdvisoryIndex::buildSegments(Package &package) {
+        package.bounds.clear();
+        for (const auto &interval: package.intervals | std::views::keys) {
+            package.bounds.emplace_back(interval.lower);
+            package.bounds.emplace_back(interval.upper);
+        }
+        std::ranges::sort(package.bounds);
+        package.bounds.erase(std::ranges::unique(package.bounds).begin(), package.bounds.end());
+
+        std::vector<std::vector<uint32_t>> segments(package.bounds.size() - 1);
+        for (const auto &[interval, advisory]: package.intervals) {
+            const auto first = std::ranges::lower_bound(package.bounds, interval.lower) - package.bounds.begin();
+            const auto last = std::ranges::lower_bound(package.bounds, interval.upper) - package.bounds.begin();
+            for (auto segment = first; segment < last; segment++) {
+                segments[segment].emplace_back(advisory);
+            }
+        }
+
+        package.offsets.assign(1, 0);
+        package.advisories.clear();
+        for (auto &segment: segments) {
+            std::ranges::sort(segment);
+            segment.erase(std::ranges::unique(segment).begin(), segment.end());
+            package.advisories.insert(package.advisories.end(), segment.begin(), segment.end());
+            package.offsets.emplace_back(static_cast<uint32_t>(package.advisories.size()));
+        }
+    }
+
+    std::span<const uint32_t> AdvisoryIndex::match(const std::string &package, const std::string_view version) const {
+        const auto it = packages.find(package);
+        if (it == packages.end()) {
+            return {};
+        }
+        auto parsed = parseSemVer(version);
+        if (!parsed) {
+            return {};
+        }
+
+        const auto &entry = it->second;
+        const VersionBound point{.infinity = 0, .version = std::move(*parsed), .side = 0};
+        const auto upper = std::ranges::upper_bound(entry.bounds, point);
+        if (upper == entry.bounds.begin() || upper == entry.bounds.end()) {
+            return {};
+        }
+        const auto segment = upper - entry.bounds.begin() - 1;
+        return std::span(entry.advisories).subspan(entry.offsets[segment],
+                                                   entry.offsets[segment + 1] - entry.offsets[segment]);
+    }
+
+    std::vector<std::pair<uint32_t, uint32_t>> AdvisoryIndex::matchBatch(const std::span<const std::string> packages,
+                                                                         const std::span<const std::string> versions,
+                                                                         const unsigned threads) const {
+        if (packages.size() != versions.size()) {
+            throw std::invalid_argument("Expected as many versions as packages");
+        }
+        if (packages.size() > UINT32_MAX) {
+            throw std::invalid_argument("Too many queries in one batch");
+        }
+
+        constexpr size_t chunkSize = 1 << 14;
+        const size_t chunkCount = (packages.size() + chunkSize - 1) / chunkSize;
+        std::vector<std::vector<std::pair<uint32_t, uint32_t>>> chunks(chunkCount);
+        parallelFor(chunkCount, threads, [&](const size_t chunk) {
+            const size_t end = std::min(packages.size(), (chunk + 1) * chunkSize);
+            for (size_t query = chunk * chunkSize; query < end; query++) {
+                for (const auto advisory: match(packages[query], versions[query])) {
+                    chunks[chunk].emplace_back(static_cast<uint32_t>(query), advisory);
+                }
+            }
+        });
+
+        std::vector<std::pair<uint32_t, uint32_t>> result;
+        size_t total = 0;
+        for (const auto &chunk: chunks) {
+            total += chunk.size();
+        }
+        result.reserve(total);
+        for (const auto &chunk: chunks) {
+            result.insert(result.end(), chunk.begin(), chunk.end());
+        }
+        return result;
+    }
+}
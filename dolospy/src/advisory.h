@@ -0,0 +1,94 @@
+#ifndef ADVISORY_H
+#define ADVISORY_H
+
+#include <compare>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace dolos {
+    struct SemVer {
+        uint64_t major = 0, minor = 0, patch = 0;
+        // Dot separated pre-release identifiers, empty for a release. Build metadata is dropped.
+        std::string prerelease;
+
+        // Precedence as defined by semver 2.0.0
+        std::strong_ordering operator<=>(const SemVer &other) const;
+
+        bool operator==(const SemVer &other) const = default;
+    };
+
+    // Full version like "1.2.3", "v1.2.3-rc.1" or "1.2.3+build", empty if the text is anything else
+    std::optional<SemVer> parseSemVer(std::string_view text);
+
+    // Position on the version line: just before, at or just after a version, or one of both ends
+    struct VersionBound {
+        int8_t infinity = 0;
+        SemVer version;
+        int8_t side = 0;
+
+        std::strong_ordering operator<=>(const VersionBound &other) const;
+
+        bool operator==(const VersionBound &other) const = default;
+    };
+
+    // Versions in [lower, upper)
+    struct VersionInterval {
+        VersionBound lower, upper;
+    };
+
+    // Disjoint intervals matched by an npm style range: comparators (<, <=, >, >=, =, !=) separated by spaces or
+    // commas, "^" and "~" ranges, x-ranges, hyphen ranges and "||". Throws std::invalid_argument for anything else.
+    std::vector<VersionInterval> parseVersionRange(std::string_view range);
+
+    // Affected version ranges of advisories per package. The intervals of all advisories of a package are cut into
+    // elementary segments at their bounds, each segment lists the advisories covering it, so a lookup is one binary
+    // search in the sorted bounds of the package.
+    class AdvisoryIndex {
+        struct Advisory {
+            std::string package, id, level;
+        };
+
+        struct Package {
+            std::vector<std::pair<VersionInterval, uint32_t>> intervals;
+            // Segment i is [bounds[i], bounds[i + 1]) and affected by advisories[offsets[i]..offsets[i + 1]]
+            std::vector<VersionBound> bounds;
+            std::vector<uint32_t> offsets;
+            std::vector<uint32_t> advisories;
+        };
+
+        std::vector<Advisory> entries;
+        std::unordered_map<std::string, Package> packages;
+
+        static void buildSegments(Package &package);
+
+    public:
+        // Adds an advisory affecting the versions matched by all ranges at once, so one without any range affects
+        // every version. Returns the advisory number.
+        uint32_t add(const std::string &package, std::string id, std::string level,
+                     const std::vector<std::string> &ranges);
+
+        size_t size() const { return entries.size(); }
+
+        const std::string &package(const uint32_t advisory) const { return entries[advisory].package; }
+
+        const std::string &id(const uint32_t advisory) const { return entries[advisory].id; }
+
+        const std::string &level(const uint32_t advisory) const { return entries[advisory].level; }
+
+        // Advisories affecting the version, none if the version is no valid semver
+        std::span<const uint32_t> match(const std::string &package, std::string_view version) const;
+
+        // (query, advisory) of all matches of the queries, ordered by query, split over the given number of threads
+        std::vector<std::pair<uint32_t, uint32_t>> matchBatch(std::span<const std::string> packages,
+                                                              std::span<const std::string> versions,
+                                                              unsigned threads = 0) const;
+    };
+}
+
+#endif //ADVISORY_H
@@ -0,0 +1,259 @@
+#include "banner.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <queue>
+#include <stdexcept>
+
+#include "trace.h"
+
+namespace dolos {
+    static char lower(const char c) {
+        return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+    }
+
+    static bool isDigit(const char c) {
+        return c >= '0' && c <= '9';
+    }
+
+    static bool isIdentifier(const char c) {
+        return isDigit(c) || (lower(c) >= 'a' && lower(c) <= 'z') || c == '_' || c == '$';
+    }
+
+    static bool isVersionChar(const char c) {
+        return isIdentifier(c) && c != '_' && c != '$';
+    }
+
+    // Part of a word for boundaries, '-' included so "react-dom" or "x-react" contain no "react"
+    static bool isWord(const char c) {
+        return isIdentifier(c) || c == '-';
+    }
+
+    BannerScanner::BannerScanner(std::vector<std::string> names, const size_t minLength) {
+        std::ranges::sort(names);
+        names.erase(std::ranges::unique(names).begin(), names.end());
+        for (auto &name: names) {
+            if (name.size() < minLength) {
+                continue;
+            }
+            maxLength = std::max(maxLength, name.size());
+            packages.emplace_back(std::move(name));
+        }
+
+        for (int byte = 0; byte < 256; byte++) {
+            classes[byte] = isWord(static_cast<char>(byte)) ? wordClass : boundaryClass;
+        }
+        std::array<bool, 256> seen{};
+        for (const auto &name: packages) {
+            for (const char c: name) {
+                const auto byte = static_cast<uint8_t>(lower(c));
+                if (!seen[byte]) {
+                    if (classCount > std::numeric_limits<uint8_t>::max()) {
+                        throw std::invalid_argument("Too many distinct characters in banner patterns");
+                    }
+                    seen[byte] = true;
+                    classes[byte] = static_cast<uint8_t>(classCount++);
+                }
+            }
+        }
+        std::array<bool, 256> classIsWord{};
+        for (int byte = 0; byte < 256; byte++) {
+            const char c = static_cast<char>(byte);
+            if (c >= 'A' && c <= 'Z') {
+                classes[byte] = classes[static_cast<uint8_t>(lower(c))];
+            }
+            classIsWord[classes[byte]] = isWord(c);
+            wordBytes[byte] = isWord(c);
+        }
+
+        // Row 0 is the root (after a word boundary), row 1 the dead state (inside a word), then the trie
+        constexpr uint32_t root = 0, missing = std::numeric_limits<uint32_t>::max();
+        const uint32_t dead = classCount;
+        transitions.assign(2 * classCount, missing);
+        stateNames.assign(2, noName);
+        for (uint32_t id = 0; id < packages.size(); id++) {
+            uint32_t state = root;
+            for (const char c: packages[id]) {
+                const auto cls = classes[static_cast<uint8_t>(c)];
+                if (transitions[state + cls] == missing) {
+                    if (transitions.size() + classCount >= outputFlag) {
+                        throw std::invalid_argument("Too many banner pattern states");
+                    }
+                    transitions[state + cls] = static_cast<uint32_t>(transitions.size());
+                    transitions.resize(transitions.size() + classCount, missing);
+                    stateNames.emplace_back(noName);
+                }
+                state = transitions[state + cls];
+            }
+            // Duplicates up to case keep the first name
+            if (stateNames[state / classCount] == noName) {
+                stateNames[state / classCount] = id;
+            }
+        }
+
+        // Mismatches restart at the root on a boundary and wait in the dead state for the next one otherwise
+        for (uint32_t cls = 0; cls < classCount; cls++) {
+            if (transitions[root + cls] == missing) {
+                transitions[root + cls] = classIsWord[cls] ? dead : root;
+            }
+        }
+        for (uint32_t state = dead; state < transitions.size(); state += classCount) {
+            for (uint32_t cls = 0; cls < classCount; cls++) {
+                if (transitions[state + cls] == missing) {
+                    transitions[state + cls] = classIsWord[cls] ? dead : transitions[root + cls];
+                }
+            }
+        }
+        for (auto &next: transitions) {
+            if (stateNames[next / classCount] != noName) {
+                next |= outputFlag;
+            }
+        }
+    }
+
+    std::string_view parseVersion(const std::string_view text) {
+        size_t i = 0;
+        for (int part = 0; part < 3; part++) {
+            if (part > 0) {
+                if (i >= text.size() || text[i] != '.') {
+                    return {};
+                }
+                i++;
+            }
+            const size_t start = i;
+            while (i < text.size() && isDigit(text[i])) {
+                i++;
+            }
+            if (i == start || i - start > 9) {
+                return {};
+            }
+        }
+        // Pre-release and build metadata
+        for (const char separator: {'-', '+'}) {
+            if (i + 1 < text.size() && text[i] == separator && isVersionChar(text[i + 1])) {
+                i++;
+                while (i < text.size() && (isVersionChar(text[i]) || text[i] == '.' || text[i] == '-')) {
+                    i++;
+                }
+                while (text[i - 1] == '.' || text[i - 1] == '-') {
+                    i--;
+                }
+            }
+        }
+        return text.substr(0, i);
+    }
+
+    // Longest gap between a name and its version, the word "version" may add its length
+    constexpr size_t maxGap = 32;
+    constexpr std::string_view versionWord = "version";
+
+    // Start of the version after a name: separators, "v" and "version" may come in between, as in "jQuery v3.6.0",
+    // "lodash.VERSION = '4.17.21'" or "react@18.2.0"
+    static size_t versionStart(const std::string_view after) {
+        constexpr std::string_view separators = " \t@:=\"'`/(,.";
+
+        size_t i = 0;
+        while (i < after.size() && i <= maxGap) {
+            const char c = after[i];
+            if (isDigit(c)) {
+                return i;
+            }
+            if (separators.find(c) != std::string_view::npos) {
+                i++;
+            } else if (c == '-' && i + 1 < after.size() && isDigit(after[i + 1])) {
+                i++;
+            } else if (after.size() - i >= versionWord.size()
+                       && std::ranges::equal(after.substr(i, versionWord.size()), versionWord, {}, lower)) {
+                i += versionWord.size();
+            } else if (lower(c) == 'v') {
+                i++;
+            } else {
+                break;
+            }
+        }
+        return std::string_view::npos;
+    }
+
+    uint32_t BannerScanner::advance(const std::string_view text, uint32_t state, const size_t from, const size_t to,
+                                    std::vector<BannerHit> &hits) const {
+        const uint32_t *table = transitions.data();
+        const uint8_t *byteClasses = classes.data();
+        const uint32_t dead = classCount;
+        for (size_t i = from; i < to; i++) {
+            // Most bytes lie in words that start with no name, skip them without the dependent table loads
+            if (state == dead) {
+                while (i < to && wordBytes[static_cast<uint8_t>(text[i])]) {
+                    i++;
+                }
+                if (i == to) {
+                    break;
+                }
+            }
+            state = table[state + byteClasses[static_cast<uint8_t>(text[i])]];
+            if (!(state & outputFlag)) [[likely]] {
+                continue;
+            }
+            state &= ~outputFlag;
+
+            // The name must end at a word boundary, except for "v" and "-" as in "jquery-v3.6.0" or "jquery-1.12.4"
+            const size_t end = i + 1;
+            if (end < text.size() && isWord(text[end]) && lower(text[end]) != 'v'
+                && !(text[end] == '-' && end + 1 < text.size()
+                     && (isDigit(text[end + 1]) || lower(text[end + 1]) == 'v'))) {
+                continue;
+            }
+            const auto after = text.substr(end);
+            const auto start = versionStart(after);
+            if (start == std::string_view::npos) {
+                continue;
+            }
+            if (const auto version = parseVersion(after.substr(start)); !version.empty()) {
+                const auto id = stateNames[state / classCount];
+                hits.emplace_back(BannerHit{.package = id, .offset = end - packages[id].size(), .version = version});
+            }
+        }
+        return state;
+    }
+
+    std::vector<BannerHit> BannerScanner::scan(const std::span<const char> data) const {
+        DOLOS_TRACE("banner.scan", "lookup");
+        std::vector<BannerHit> hits;
+        if (packages.empty()) {
+            return hits;
+        }
+
+        // Every hit has a version, so the automaton only runs over the bytes before each "digits.digits.digits". The
+        // dots are found with memchr, which leaves the bulk of a bundle to vectorized code.
+        const std::string_view text(data.data(), data.size());
+        const size_t window = maxLength + maxGap + versionWord.size() + 10;
+        const uint32_t dead = classCount;
+        uint32_t state = 0;
+        size_t scanned = 0;
+        const char *dot = text.data();
+        const char *const textEnd = text.data() + text.size();
+        while ((dot = static_cast<const char *>(std::memchr(dot, '.', static_cast<size_t>(textEnd - dot))))) {
+            const auto position = static_cast<size_t>(dot - text.data());
+            dot++;
+            if (position == 0 || !isDigit(text[position - 1])) {
+                continue;
+            }
+            size_t versionPosition = position - 1;
+            while (versionPosition > 0 && position - versionPosition < 10 && isDigit(text[versionPosition - 1])) {
+                versionPosition--;
+            }
+            if (parseVersion(text.substr(versionPosition)).empty()) {
+                continue;
+            }
+
+            // Names ending before the version are not found again, the automaton continues where it stopped
+            if (const size_t from = versionPosition > window ? versionPosition - window : 0; from > scanned) {
+                scanned = from;
+                state = from > 0 && wordBytes[static_cast<uint8_t>(text[from - 1])] ? dead : 0;
+            }
+            state = advance(text, state, scanned, versionPosition, hits);
+            scanned = std::max(scanned, versionPosition);
+        }
+        return hits;
+    }
+}
@@ -0,0 +1,69 @@
+#ifndef BANNER_H
+#define BANNER_H
+
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace dolos {
+    struct BannerHit {
+        uint32_t package;
+        // Offset of the package name in the scanned data
+        uint64_t offset;
+        // Version string following the name, points into the scanned data
+        std::string_view version;
+    };
+
+    // Finds package names followed by a version in bundles, as left behind by license banners and version constants
+    // ("/*! jQuery v3.6.0", "@license React v18.2.0", "lodash.VERSION = '4.17.21'").
+    // Names only count at the start of a word, so instead of a full Aho-Corasick automaton with failure links the
+    // trie of all names is compiled into a dense DFA that restarts at word boundaries and otherwise rests in a dead
+    // state until the next one. Its transitions are indexed by byte class (one class per byte occurring in a name,
+    // plus word and non-word bytes), so the table stays small and the rows of the root and dead state stay in L1.
+    // Since every hit needs a version, only the bytes shortly before an "x.y.z" are fed to the automaton at all.
+    // Matching ignores ASCII case.
+    class BannerScanner {
+        std::vector<std::string> packages;
+        // Byte to class, see wordClass and boundaryClass for bytes in no name
+        std::array<uint8_t, 256> classes{};
+        uint32_t classCount = 2;
+        // Bytes that belong to a word, including '-' of package names
+        std::array<bool, 256> wordBytes{};
+        // transitions[state + class] is the next state, states are numbered by the offset of their row. The high bit
+        // marks states where a name ends.
+        std::vector<uint32_t> transitions;
+        // Name ending in the state with the row at state, indexed by state / classCount
+        std::vector<uint32_t> stateNames;
+        size_t maxLength = 0;
+
+        // Runs the automaton over text[from, to) and collects the hits of names ending there
+        uint32_t advance(std::string_view text, uint32_t state, size_t from, size_t to,
+                         std::vector<BannerHit> &hits) const;
+
+    public:
+        static constexpr uint32_t outputFlag = 1u << 31;
+        static constexpr uint32_t noName = std::numeric_limits<uint32_t>::max();
+        static constexpr uint8_t boundaryClass = 0, wordClass = 1;
+
+        // Names shorter than minLength are ignored, short names mostly match ordinary identifiers
+        explicit BannerScanner(std::vector<std::string> packages, size_t minLength = 3);
+
+        size_t size() const { return packages.size(); }
+
+        size_t stateCount() const { return stateNames.size(); }
+
+        const std::string &package(const uint32_t id) const { return packages[id]; }
+
+        // Hits in order of offset
+        std::vector<BannerHit> scan(std::span<const char> data) const;
+    };
+
+    // Semantic version at the start of text (major.minor.patch with optional pre-release and build), empty if none
+    std::string_view parseVersion(std::string_view text);
+}
+
+#endif //BANNER_H
@@ -0,0 +1,299 @@
+#include "batchio.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef DOLOS_HAVE_IO_URING
+#include <liburing.h>
+#endif
+
+#include "trace.h"
+
+namespace dolos {
+    ReadResult readWithPread(const std::filesystem::path &path) {
+        DOLOS_TRACE("read", "io");
+        ReadResult result;
+        const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            result.error = errno;
+            return result;
+        }
+
+        struct stat st{};
+        if (fstat(fd, &st) != 0) {
+            result.error = errno;
+            close(fd);
+            return result;
+        }
+
+        result.data.resize(st.st_size);
+        size_t done = 0;
+        while (done < result.data.size()) {
+            const auto n = pread(fd, result.data.data() + done, result.data.size() - done, static_cast<off_t>(done));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                // Truncated while reading counts as an error as well, the content would be garbage
+                result.error = n < 0 ? errno : EIO;
+                break;
+            }
+            done += n;
+        }
+
+        close(fd);
+        return result;
+    }
+
+#ifdef DOLOS_HAVE_IO_URING
+    struct BatchReader::Ring {
+        io_uring ring{};
+
+        explicit Ring(const unsigned entries) {
+            if (const int ret = io_uring_queue_init(entries, &ring, 0); ret < 0) {
+                throw std::system_error(-ret, std::generic_category(), "io_uring_queue_init");
+            }
+
+            io_uring_probe *probe = io_uring_get_probe_ring(&ring);
+            const bool supported = probe
+                                   && io_uring_opcode_supported(probe, IORING_OP_OPENAT)
+                                   && io_uring_opcode_supported(probe, IORING_OP_STATX)
+                                   && io_uring_opcode_supported(probe, IORING_OP_READ)
+                                   && io_uring_opcode_supported(probe, IORING_OP_CLOSE);
+            if (probe) {
+                io_uring_free_probe(probe);
+            }
+            if (!supported) {
+                io_uring_queue_exit(&ring);
+                throw std::system_error(ENOSYS, std::generic_category(), "io_uring opcodes");
+            }
+        }
+
+        Ring(const Ring &) = delete;
+        Ring &operator=(const Ring &) = delete;
+
+        ~Ring() {
+            io_uring_queue_exit(&ring);
+        }
+    };
+
+    namespace {
+        enum Operation : uint64_t {
+            Open = 0,
+            Stat = 1,
+            Read = 2,
+            Close = 3,
+        };
+
+        // Largest single read, io_uring takes an unsigned length and large reads are split by the kernel anyway
+        constexpr size_t maxChunk = 1u << 30;
+
+        struct Pending {
+            int fd = -1;
+            struct statx stx{};
+            size_t done = 0;
+            ReadResult result;
+        };
+
+        uint64_t tag(const size_t index, const Operation op) {
+            return static_cast<uint64_t>(index) << 2 | op;
+        }
+
+        // Submits what is queued, waits until no operation of the batch is in flight anymore and closes the files
+        // they opened. False if the ring failed, the kernel may then still write into the pending entries.
+        bool drain(io_uring *ring, unsigned &inflight, std::vector<Pending> &pending) {
+            if (inflight > 0 && io_uring_submit(ring) < 0) {
+                return false;
+            }
+            while (inflight > 0) {
+                io_uring_cqe *cqe;
+                if (const int ret = io_uring_wait_cqe(ring, &cqe); ret == -EINTR) {
+                    continue;
+                } else if (ret < 0) {
+                    return false;
+                }
+                // Opens that completed after the failure never made it into pending
+                if ((io_uring_cqe_get_data64(cqe) & 3) == Open && cqe->res >= 0) {
+                    close(cqe->res);
+                }
+                io_uring_cqe_seen(ring, cqe);
+                inflight--;
+            }
+            for (auto &p: pending) {
+                if (p.fd >= 0) {
+                    close(p.fd);
+                    p.fd = -1;
+                }
+            }
+            return true;
+        }
+    }
+
+    void BatchReader::readUring(const std::vector<std::filesystem::path> &paths, const ReadCallback &callback) {
+        auto *ring = &this->ring->ring;
+        std::vector<Pending> pending(paths.size());
+        size_t next = 0, finished = 0;
+        unsigned inflight = 0;
+
+        // Never more operations in flight than queue entries, so there always is a free sqe and no cqe overflow
+        const auto sqe = [&] {
+            inflight++;
+            return io_uring_get_sqe(ring);
+        };
+
+        const auto submitRead = [&](const size_t i) {
+            auto &p = pending[i];
+            const size_t count = std::min(maxChunk, p.result.data.size() - p.done);
+            auto *s = sqe();
+            io_uring_prep_read(s, p.fd, p.result.data.data() + p.done, count, p.done);
+            io_uring_sqe_set_data64(s, tag(i, Read));
+        };
+
+        const auto finish = [&](const size_t i) {
+            auto &p = pending[i];
+            if (p.fd >= 0) {
+                auto *s = sqe();
+                io_uring_prep_close(s, p.fd);
+                io_uring_sqe_set_data64(s, tag(i, Close));
+                p.fd = -1;
+            }
+            if (p.result.error != 0) {
+                p.result.data.clear();
+            }
+            finished++;
+            callback(i, std::move(p.result));
+        };
+
+        // The size comes from the opened file like with fstat, so a path replaced in between cannot mismatch it
+        const auto submitStat = [&](const size_t i) {
+            auto &p = pending[i];
+            auto *s = sqe();
+            io_uring_prep_statx(s, p.fd, "", AT_EMPTY_PATH, STATX_SIZE, &p.stx);
+            io_uring_sqe_set_data64(s, tag(i, Stat));
+        };
+
+        // Operations in flight write into pending, so a failed submit or a throwing callback first waits for them
+        try {
+            while (finished < paths.size() || inflight > 0) {
+                // Every completion queues at most one follow-up operation of its file, one entry per file is enough
+                while (next < paths.size() && inflight < queueDepth) {
+                    auto *s = sqe();
+                    io_uring_prep_openat(s, AT_FDCWD, paths[next].c_str(), O_RDONLY | O_CLOEXEC, 0);
+                    io_uring_sqe_set_data64(s, tag(next, Open));
+                    next++;
+                }
+
+                if (const int ret = io_uring_submit_and_wait(ring, 1); ret < 0 && ret != -EINTR) {
+                    throw std::system_error(-ret, std::generic_category(), "io_uring_submit_and_wait");
+                }
+
+                io_uring_cqe *cqe;
+                while (io_uring_peek_cqe(ring, &cqe) == 0) {
+                    const auto data = io_uring_cqe_get_data64(cqe);
+                    const int res = cqe->res;
+                    io_uring_cqe_seen(ring, cqe);
+                    inflight--;
+
+                    const size_t i = data >> 2;
+                    auto &p = pending[i];
+                    switch (static_cast<Operation>(data & 3)) {
+                        case Open:
+                            if (res < 0) {
+                                p.result.error = -res;
+                                finish(i);
+                            } else {
+                                p.fd = res;
+                                submitStat(i);
+                            }
+                            break;
+                        case Stat:
+                            if (res < 0) {
+                                p.result.error = -res;
+                                finish(i);
+                                break;
+                            }
+                            p.result.data.resize(p.stx.stx_size);
+                            if (p.result.data.empty()) {
+                                finish(i);
+                            } else {
+                                submitRead(i);
+                            }
+                            break;
+                        case Read:
+                            if (res == -EINTR || res == -EAGAIN) {
+                                submitRead(i);
+                            } else if (res <= 0) {
+                                p.result.error = res < 0 ? -res : EIO;
+                                finish(i);
+                            } else {
+                                p.done += res;
+                                if (p.done < p.result.data.size()) {
+                                    submitRead(i);
+                                } else {
+                                    finish(i);
+                                }
+                            }
+                            break;
+                        case Close:
+                            break;
+                    }
+                }
+            }
+        } catch (...) {
+            if (!drain(ring, inflight, pending)) {
+                // Nothing can tell when the kernel is done with the entries, so they are leaked and the broken ring
+                // is given up for pread
+                new std::vector<Pending>(std::move(pending));
+                this->ring.reset();
+            }
+            throw;
+        }
+    }
+#else
+    struct BatchReader::Ring {
+    };
+
+    void BatchReader::readUring(const std::vector<std::filesystem::path> &, const ReadCallback &) {
+    }
+#endif
+
+    BatchReader::BatchReader(const unsigned queueDepth, const bool useIoUring) : queueDepth(std::max(2u, queueDepth)) {
+#ifdef DOLOS_HAVE_IO_URING
+        if (useIoUring) {
+            try {
+                ring = std::make_unique<Ring>(this->queueDepth);
+            } catch (const std::system_error &) {
+                // Fall back to pread
+            }
+        }
+#else
+        (void) useIoUring;
+#endif
+    }
+
+    BatchReader::~BatchReader() = default;
+
+    void BatchReader::read(const std::vector<std::filesystem::path> &paths, const ReadCallback &callback) {
+        if (ring) {
+            DOLOS_TRACE("read.batch", "io");
+            readUring(paths, callback);
+            return;
+        }
+        for (size_t i = 0; i < paths.size(); i++) {
+            callback(i, readWithPread(paths[i]));
+        }
+    }
+
+    std::vector<ReadResult> BatchReader::readAll(const std::vector<std::filesystem::path> &paths) {
+        std::vector<ReadResult> results(paths.size());
+        read(paths, [&](const size_t i, ReadResult result) {
+            results[i] = std::move(result);
+        });
+        return results;
+    }
+}
@@ -0,0 +1,51 @@
+#ifndef BATCHIO_H
+#define BATCHIO_H
+
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace dolos {
+    struct ReadResult {
+        std::string data;
+        // 0 on success, otherwise an errno value
+        int error = 0;
+    };
+
+    // Called once per file as soon as it is read, possibly while other reads are still in flight
+    using ReadCallback = std::function<void(size_t index, ReadResult result)>;
+
+    // Reads many small files at once. With io_uring, the open, statx, read and close operations of all files
+    // are queued together and the callback runs while the remaining requests are processed by the kernel.
+    // Without io_uring support (not compiled in, or refused by the kernel or a seccomp profile), files are
+    // read one after another with pread.
+    class BatchReader {
+        struct Ring;
+
+        std::unique_ptr<Ring> ring;
+        unsigned queueDepth;
+
+        void readUring(const std::vector<std::filesystem::path> &paths, const ReadCallback &callback);
+
+    public:
+        explicit BatchReader(unsigned queueDepth = 64, bool useIoUring = true);
+
+        BatchReader(const BatchReader &) = delete;
+        BatchReader &operator=(const BatchReader &) = delete;
+
+        ~BatchReader();
+
+        bool usesIoUring() const { return ring != nullptr; }
+
+        void read(const std::vector<std::filesystem::path> &paths, const ReadCallback &callback);
+
+        std::vector<ReadResult> readAll(const std::vector<std::filesystem::path> &paths);
+    };
+
+    ReadResult readWithPread(const std::filesystem::path &path);
+}
+
+#endif //BATCHIO_H
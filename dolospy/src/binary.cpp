@@ -0,0 +1,350 @@
+#include "binary.h"
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include <optional>
+#include <ranges>
+#include <stdexcept>
+
+#include "hashing.h"
+#include "trace.h"
+
+namespace dolos {
+    static constexpr size_t sectionAlignment = 64;
+
+    static size_t align(const size_t offset) {
+        return (offset + sectionAlignment - 1) / sectionAlignment * sectionAlignment;
+    }
+
+    template<typename T>
+    static void writeSection(std::string &out, const uint64_t offset, const std::vector<T> &values) {
+        std::memcpy(out.data() + offset, values.data(), values.size() * sizeof(T));
+    }
+
+    BinaryHeader layoutBinary(BinaryHeader header) {
+        const bool compressed = header.version == BinaryHeader::currentVersion;
+        std::memcpy(header.magic, BinaryHeader::expectedMagic, sizeof(header.magic));
+        header.hashesOffset = align(sizeof(BinaryHeader));
+        header.offsetsOffset = align(header.hashesOffset + header.hashCount * sizeof(uint64_t));
+        header.postingsOffset = align(header.offsetsOffset + (compressed ? header.hashCount * sizeof(uint32_t)
+                                                                         : (header.hashCount + 1) * sizeof(uint64_t)));
+        header.groupSizesOffset = align(header.postingsOffset + header.postingsSize * (compressed ? 1 : sizeof(Run)));
+        header.nameOffsetsOffset = align(header.groupSizesOffset + header.groupCount * sizeof(uint32_t));
+        header.namesOffset = align(header.nameOffsetsOffset + (header.groupCount + 1) * sizeof(uint32_t));
+        header.nodesOffset = align(header.namesOffset + header.namesSize);
+        header.sketchesOffset = align(header.nodesOffset + header.nodeCount * sizeof(HierarchyNode));
+        return header;
+    }
+
+    uint64_t binarySize(const BinaryHeader &header) {
+        return header.sketchesOffset + header.sketchCount * sizeof(uint64_t);
+    }
+
+    std::string serializeBinary(const Index &index, const uint32_t sketchSize, const bool compressPostings) {
+        std::vector<uint64_t> hashes;
+        hashes.reserve(index.index.size());
+        for (const auto &hash: index.index | std::views::keys) {
+            hashes.emplace_back(hash);
+        }
+        std::ranges::sort(hashes);
+
+        std::vector<uint64_t> offsets;
+        offsets.reserve(hashes.size() + 1);
+        std::vector<Run> postings;
+        for (const auto hash: hashes) {
+            offsets.emplace_back(postings.size());
+            // The set is sorted, so consecutive ids extend the last run
+            const auto firstRun = postings.size();
+            for (const auto id: index.index.at(hash)) {
+                if (postings.size() > firstRun && postings.back().last + 1 == id) {
+                    postings.back().last = id;
+                } else {
+                    postings.emplace_back(Run{.first = id, .last = id});
+                }
+            }
+        }
+        offsets.emplace_back(postings.size());
+
+        std::vector<uint32_t> slots;
+        std::vector<uint8_t> lists;
+        if (compressPostings) {
+            slots.reserve(hashes.size());
+            for (size_t i = 0; i < hashes.size(); i++) {
+                slots.emplace_back(encodePostings(std::span(postings).subspan(offsets[i], offsets[i + 1] - offsets[i]),
+                                                  lists));
+            }
+            lists.resize(lists.size() + listPadding, 0);
+        }
+
+        const uint32_t groupCount = index.groupCount();
+
+        std::vector<uint32_t> groupSizes(groupCount, 0);
+        std::vector<uint32_t> nameOffsets;
+        nameOffsets.reserve(groupCount + 1);
+        std::string names;
+        for (uint16_t id = 0; id < groupCount; id++) {
+            if (const auto it = index.groups.find(id); it != index.groups.end()) {
+                groupSizes[id] = it->second.size();
+            }
+            nameOffsets.emplace_back(names.size());
+            if (const auto it = index.names.find(id); it != index.names.end()) {
+                names += it->second;
+            }
+        }
+        nameOffsets.emplace_back(names.size());
+
+        const auto hierarchy = buildHierarchy(index, sketchSize);
+
+        BinaryHeader header{};
+        header.version = compressPostings ? BinaryHeader::currentVersion : BinaryHeader::uncompressedVersion;
+        header.k = index.k;
+        header.w = index.w;
+        header.groupCount = groupCount;
+        header.hashCount = hashes.size();
+        header.postingsSize = compressPostings ? lists.size() : postings.size();
+        header.namesSize = names.size();
+        header.nodeCount = hierarchy.nodes.size();
+        header.sketchCount = hierarchy.sketches.size();
+        header = layoutBinary(header);
+
+        std::string out(binarySize(header), '\0');
+        std::memcpy(out.data(), &header, sizeof(header));
+        writeSection(out, header.hashesOffset, hashes);
+        if (compressPostings) {
+            writeSection(out, header.offsetsOffset, slots);
+            writeSection(out, header.postingsOffset, lists);
+        } else {
+            writeSection(out, header.offsetsOffset, offsets);
+            writeSection(out, header.postingsOffset, postings);
+        }
+        writeSection(out, header.groupSizesOffset, groupSizes);
+        writeSection(out, header.nameOffsetsOffset, nameOffsets);
+        std::memcpy(out.data() + header.namesOffset, names.data(), names.size());
+        writeSection(out, header.nodesOffset, hierarchy.nodes);
+        writeSection(out, header.sketchesOffset, hierarchy.sketches);
+
+        return out;
+    }
+
+    template<typename T>
+    static std::span<const T> section(const std::span<const char> data, const uint64_t offset, const uint64_t count) {
+        if (offset % alignof(T) != 0 || offset > data.size() || count > (data.size() - offset) / sizeof(T)) {
+            throw std::runtime_error("Corrupt binary index: section out of bounds");
+        }
+        return {reinterpret_cast<const T *>(data.data() + offset), count};
+    }
+
+    MappedIndex::MappedIndex(const std::filesystem::path &path, const MadvisePolicy &policy)
+        : MappedIndex(MappedFile(path), path, policy) {
+    }
+
+    MappedIndex::MappedIndex(MappedFile mapping, const std::filesystem::path &path, const MadvisePolicy &policy)
+        : file(std::move(mapping)) {
+        const auto data = file.data();
+        if (data.size() < sizeof(BinaryHeader)) {
+            throw std::runtime_error("Not a binary index: " + path.string());
+        }
+
+        header = reinterpret_cast<const BinaryHeader *>(data.data());
+        if (std::memcmp(header->magic, BinaryHeader::expectedMagic, sizeof(header->magic)) != 0) {
+            throw std::runtime_error("Not a binary index: " + path.string());
+        }
+        if (header->version != BinaryHeader::currentVersion && header->version != BinaryHeader::uncompressedVersion) {
+            throw std::runtime_error("Unsupported binary index version " + std::to_string(header->version)
+                                     + ", convert " + path.string() + " again");
+        }
+
+        hashes = section<uint64_t>(data, header->hashesOffset, header->hashCount);
+        if (compressedPostings()) {
+            slots = section<uint32_t>(data, header->offsetsOffset, header->hashCount);
+            lists = section<uint8_t>(data, header->postingsOffset, header->postingsSize);
+        } else {
+            offsets = section<uint64_t>(data, header->offsetsOffset, header->hashCount + 1);
+            postings = section<Run>(data, header->postingsOffset, header->postingsSize);
+        }
+        groupSizes = section<uint32_t>(data, header->groupSizesOffset, header->groupCount);
+        nameOffsets = section<uint32_t>(data, header->nameOffsetsOffset, header->groupCount + 1);
+        const auto nameData = section<char>(data, header->namesOffset, header->namesSize);
+        names = std::string_view(nameData.data(), nameData.size());
+        nodes = section<HierarchyNode>(data, header->nodesOffset, header->nodeCount);
+        sketches = section<uint64_t>(data, header->sketchesOffset, header->sketchCount);
+
+        if ((!compressedPostings() && offsets.back() != header->postingsSize)
+            || (compressedPostings() && lists.size() < listPadding) || nameOffsets.back() != header->namesSize
+            || (header->shardCount > 0 && header->shard >= header->shardCount)) {
+            throw std::runtime_error("Corrupt binary index: " + path.string());
+        }
+        // Lookups slice postings and names without bounds checks, with the last entry checked above sorted offsets
+        // keep every slice in range
+        if (!std::ranges::is_sorted(offsets) || !std::ranges::is_sorted(nameOffsets)) {
+            throw std::runtime_error("Corrupt binary index: offsets out of order in " + path.string());
+        }
+        for (const auto &node: nodes) {
+            if (node.first > node.last || node.last >= header->groupCount) {
+                throw std::runtime_error("Corrupt binary index: hierarchy out of range in " + path.string());
+            }
+        }
+
+        advise(policy);
+    }
+
+    bool MappedIndex::advise(const MadvisePolicy &policy) const {
+        bool ok = true;
+        if (policy.hugePages) {
+            ok &= file.adviseHugePages();
+        }
+        ok &= file.advise(policy.metadata, 0, header->hashesOffset);
+        ok &= file.advise(policy.hashes, header->hashesOffset, header->postingsOffset - header->hashesOffset);
+        ok &= file.advise(policy.postings, header->postingsOffset, header->groupSizesOffset - header->postingsOffset);
+        ok &= file.advise(policy.metadata, header->groupSizesOffset);
+        if (policy.willNeed) {
+            ok &= file.advise(Advice::WillNeed);
+        }
+        return ok;
+    }
+
+    std::string_view MappedIndex::name(const uint16_t group) const {
+        return names.substr(nameOffsets[group], nameOffsets[group + 1] - nameOffsets[group]);
+    }
+
+    std::optional<size_t> MappedIndex::find(const uint64_t hash) const {
+        const auto it = std::ranges::lower_bound(hashes, hash);
+        if (it == hashes.end() || *it != hash) {
+            return std::nullopt;
+        }
+        return static_cast<size_t>(std::distance(hashes.begin(), it));
+    }
+
+    std::span<const Run> MappedIndex::lookup(const uint64_t hash, std::vector<Run> &buffer) const {
+        const auto i = find(hash);
+        if (!i) {
+            return {};
+        }
+        if (compressedPostings()) {
+            decodePostings(slots[*i], lists, buffer, vectorized);
+            return buffer;
+        }
+        return postings.subspan(offsets[*i], offsets[*i + 1] - offsets[*i]);
+    }
+
+    std::vector<Pair> MappedIndex::matchExternal(const std::span<const char> sourceCode) const {
+        return matchTokens(tokenize(sourceCode));
+    }
+
+    std::vector<Pair> MappedIndex::matchTokens(const TokenizedFile &tokens) const {
+        const auto fingerprints = fingerprint(tokens, header->k, header->w);
+        return matchHashes(fingerprints);
+    }
+
+    void MappedIndex::countShared(const std::span<const uint64_t> fingerprints, const std::span<uint32_t> counts) const {
+        if (counts.size() != header->groupCount) {
+            throw std::invalid_argument("Expected one counter per group");
+        }
+
+        DOLOS_TRACE("mapped.lookup", "lookup");
+        // Difference array: each run adds one at its first group and removes it after its last group, a single
+        // prefix sum at the end yields the shared hashes per group. Unsigned wrap-around keeps it exact.
+        std::ranges::fill(counts, 0);
+        for (const auto hash: fingerprints) {
+            const auto i = find(hash);
+            if (!i) {
+                continue;
+            }
+            if (compressedPostings()) {
+                // Decoded straight into the counters, most slots hold their single run inline
+                accumulatePostings(slots[*i], lists, counts, vectorized);
+                continue;
+            }
+            for (const auto [first, last]: postings.subspan(offsets[*i], offsets[*i + 1] - offsets[*i])) {
+                if (first > last || last >= header->groupCount) {
+                    throw std::runtime_error("Corrupt binary index: run out of range");
+                }
+                counts[first] += 1;
+                if (last + 1u < header->groupCount) {
+                    counts[last + 1] -= 1;
+                }
+            }
+        }
+        std::inclusive_scan(counts.begin(), counts.end(), counts.begin());
+    }
+
+    std::vector<Pair> MappedIndex::matchHashes(const std::span<const uint64_t> fingerprints) const {
+        std::vector<uint32_t> sharedHashes(header->groupCount);
+        countShared(fingerprints, sharedHashes);
+
+        DOLOS_TRACE("emit.pairs", "emit");
+        const std::string external = "external";
+        const auto total = static_cast<uint32_t>(fingerprints.size());
+        std::vector<Pair> pairs;
+        pairs.reserve(header->groupCount);
+        for (uint16_t identifier = 0; identifier < header->groupCount; identifier++) {
+            pairs.emplace_back(Pair{
+                .left = external,
+                .right = std::string(name(identifier)),
+                .covered = sharedHashes[identifier],
+                .leftTotal = total,
+                .rightTotal = groupSizes[identifier],
+            });
+        }
+        return pairs;
+    }
+
+    std::vector<Pair> MappedIndex::matchPruned(const std::span<const uint64_t> fingerprints,
+                                               const PruneOptions &options) const {
+        if (!hasHierarchy()) {
+            return matchHashes(fingerprints);
+        }
+
+        std::vector<std::pair<uint16_t, uint16_t>> ranges;
+        {
+            DOLOS_TRACE("hierarchy.select", "lookup");
+            ranges = selectRanges(nodes, sketches, fingerprints, options);
+        }
+        // Short queries, bundle fragments among them, can miss every sketch while sharing fingerprints
+        if (ranges.empty()) {
+            return matchHashes(fingerprints);
+        }
+
+        // Only the selected groups are counted: each run is clipped to the ranges it overlaps, which are disjoint
+        // and sorted, so the difference array stays zero outside them
+        std::vector<uint32_t> sharedHashes(header->groupCount);
+        {
+            DOLOS_TRACE("mapped.lookup", "lookup");
+            std::vector<Run> buffer;
+            for (const auto hash: fingerprints) {
+                for (const auto [first, last]: lookup(hash, buffer)) {
+                    auto range = std::ranges::lower_bound(ranges, first, {}, &std::pair<uint16_t, uint16_t>::second);
+                    for (; range != ranges.end() && range->first <= last; ++range) {
+                        sharedHashes[std::max(first, range->first)] += 1;
+                        if (const auto end = std::min(last, range->second) + 1u; end < header->groupCount) {
+                            sharedHashes[end] -= 1;
+                        }
+                    }
+                }
+            }
+            std::inclusive_scan(sharedHashes.begin(), sharedHashes.end(), sharedHashes.begin());
+        }
+
+        DOLOS_TRACE("emit.pairs", "emit");
+        const std::string external = "external";
+        const auto total = static_cast<uint32_t>(fingerprints.size());
+        std::vector<Pair> pairs;
+        for (const auto &[first, last]: ranges) {
+            for (uint32_t identifier = first; identifier <= last; identifier++) {
+                pairs.emplace_back(Pair{
+                    .left = external,
+                    .right = std::string(name(identifier)),
+                    .covered = sharedHashes[identifier],
+                    .leftTotal = total,
+                    .rightTotal = groupSizes[identifier],
+                });
+            }
+        }
+        return pairs;
+    }
+
+    uint32_t MappedIndex::groupSize(const uint16_t group) const {
+        return groupSizes[group];
+    }
+}
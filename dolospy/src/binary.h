@@ -0,0 +1,145 @@
+#ifndef BINARY_H
+#define BINARY_H
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "hierarchy.h"
+#include "index.h"
+#include "mapped.h"
+#include "postings.h"
+#include "tokenizer.h"
+
+namespace dolos {
+    // Layout of <pkg>.index.bin. All sections start 64 byte aligned at the given offsets:
+    //   hashes      uint64_t[hashCount], sorted
+    //   offsets     version 3: uint64_t[hashCount + 1], run range of each hash
+    //               version 4: uint32_t[hashCount], slot of each hash (see postings.h)
+    //   postings    version 3: Run[postingsSize], group ids of each hash as sorted, disjoint runs
+    //               version 4: uint8_t[postingsSize], encoded lists of the slots and listPadding zero bytes
+    //   groupSizes  uint32_t[groupCount], number of fingerprints per group
+    //   nameOffsets uint32_t[groupCount + 1], range of each name in names
+    //   names       char[namesSize]
+    //   nodes       HierarchyNode[nodeCount], version clustering tree, root last (see hierarchy.h)
+    //   sketches    uint64_t[sketchCount], MinHash sketches of the nodes
+    struct BinaryHeader {
+        static constexpr char expectedMagic[8] = {'D', 'O', 'L', 'O', 'S', 'I', 'D', 'X'};
+        static constexpr uint32_t currentVersion = 4;
+        // Still read, and written when compressed postings are turned off
+        static constexpr uint32_t uncompressedVersion = 3;
+
+        char magic[8];
+        uint32_t version;
+        uint16_t k, w;
+        uint32_t groupCount;
+        // Position among the shardCount hash ranges written by splitBinary (see shard.h), both 0 for a whole index
+        uint16_t shard, shardCount;
+        uint64_t hashCount;
+        uint64_t postingsSize;
+        uint64_t namesSize;
+        uint64_t hashesOffset;
+        uint64_t offsetsOffset;
+        uint64_t postingsOffset;
+        uint64_t groupSizesOffset;
+        uint64_t nameOffsetsOffset;
+        uint64_t namesOffset;
+        uint64_t nodeCount;
+        uint64_t sketchCount;
+        uint64_t nodesOffset;
+        uint64_t sketchesOffset;
+    };
+
+    // Fills in magic and the section offsets of a header whose version, k, w and counts are set
+    BinaryHeader layoutBinary(BinaryHeader header);
+
+    // Size of the whole file described by a laid out header
+    uint64_t binarySize(const BinaryHeader &header);
+
+    // A sketch size of 0 leaves out the version hierarchy, without compressed postings the file is version 3
+    std::string serializeBinary(const Index &index, uint32_t sketchSize = 64, bool compressPostings = true);
+
+    struct MadvisePolicy {
+        Advice hashes = Advice::Random;
+        Advice postings = Advice::Random;
+        Advice metadata = Advice::Normal;
+        bool hugePages = false;
+        // Prefetch the whole file right after mapping it
+        bool willNeed = false;
+    };
+
+    // Read-only index working directly on a mapped <pkg>.index.bin file
+    class MappedIndex {
+        MappedFile file;
+        const BinaryHeader *header;
+        std::span<const uint64_t> hashes;
+        // Version 3
+        std::span<const uint64_t> offsets;
+        std::span<const Run> postings;
+        // Version 4
+        std::span<const uint32_t> slots;
+        std::span<const uint8_t> lists;
+        bool vectorized = vectorizedPostings();
+        std::span<const uint32_t> groupSizes;
+        std::span<const uint32_t> nameOffsets;
+        std::string_view names;
+        std::span<const HierarchyNode> nodes;
+        std::span<const uint64_t> sketches;
+
+        // Position of the hash in the hashes section
+        std::optional<size_t> find(uint64_t hash) const;
+
+    public:
+        explicit MappedIndex(const std::filesystem::path &path, const MadvisePolicy &policy = {});
+
+        // Over a file mapped or copied by the caller, path only names it in errors
+        MappedIndex(MappedFile mapping, const std::filesystem::path &path, const MadvisePolicy &policy = {});
+
+        // Applies the policy to the sections of the file. Returns false if any madvise call was refused.
+        bool advise(const MadvisePolicy &policy) const;
+
+        uint16_t k() const { return header->k; }
+        uint16_t w() const { return header->w; }
+        uint32_t groupCount() const { return header->groupCount; }
+        uint64_t hashCount() const { return header->hashCount; }
+        uint16_t shard() const { return header->shard; }
+        uint16_t shardCount() const { return header->shardCount; }
+        size_t fileSize() const { return file.size(); }
+
+        // The whole file as mapped
+        std::span<const char> fileData() const { return file.data(); }
+
+        std::string_view name(uint16_t group) const;
+
+        uint32_t groupSize(uint16_t group) const;
+
+        std::span<const uint64_t> allHashes() const { return hashes; }
+
+        bool compressedPostings() const { return header->version == BinaryHeader::currentVersion; }
+
+        // Runs of group ids containing the hash, empty if unknown. Compressed postings are decoded into buffer.
+        std::span<const Run> lookup(uint64_t hash, std::vector<Run> &buffer) const;
+
+        std::vector<Pair> matchExternal(std::span<const char> sourceCode) const;
+
+        std::vector<Pair> matchTokens(const TokenizedFile &tokens) const;
+
+        std::vector<Pair> matchHashes(std::span<const uint64_t> fingerprints) const;
+
+        bool hasHierarchy() const { return !nodes.empty(); }
+
+        // Like matchHashes, but only counts and returns the versions in the subtrees the hierarchy considers
+        // promising. Without a hierarchy, or if the query misses the sketches of every subtree, all versions are
+        // returned.
+        std::vector<Pair> matchPruned(std::span<const uint64_t> fingerprints, const PruneOptions &options = {}) const;
+
+        // Shared hashes per group without allocating, counts needs exactly groupCount() entries
+        void countShared(std::span<const uint64_t> fingerprints, std::span<uint32_t> counts) const;
+    };
+}
+
+#endif //BINARY_H
@@ -0,0 +1,135 @@
+#include "bson.h"
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace dolos {
+    static int32_t readInt32(const std::span<const char> data) {
+        if (data.size() < sizeof(int32_t)) {
+            throw std::runtime_error("Corrupt BSON: truncated length");
+        }
+        // BSON is little endian like every platform this builds for
+        int32_t value;
+        std::memcpy(&value, data.data(), sizeof(value));
+        return value;
+    }
+
+    // Bytes of a value starting with its length, extra counts the bytes between length and data
+    static size_t prefixedSize(const std::span<const char> data, const size_t extra) {
+        const auto length = readInt32(data);
+        if (length < 0) {
+            throw std::runtime_error("Corrupt BSON: negative length");
+        }
+        return sizeof(int32_t) + extra + static_cast<size_t>(length);
+    }
+
+    static size_t cstringSize(const std::span<const char> data) {
+        const auto *end = static_cast<const char *>(std::memchr(data.data(), 0, data.size()));
+        if (!end) {
+            throw std::runtime_error("Corrupt BSON: unterminated key");
+        }
+        return static_cast<size_t>(end - data.data()) + 1;
+    }
+
+    static size_t valueSize(const BsonType type, const std::span<const char> data) {
+        switch (type) {
+            case BsonType::Undefined:
+            case BsonType::Null:
+            case BsonType::MinKey:
+            case BsonType::MaxKey:
+                return 0;
+            case BsonType::Boolean:
+                return 1;
+            case BsonType::Int32:
+                return 4;
+            case BsonType::Double:
+            case BsonType::DateTime:
+            case BsonType::Timestamp:
+            case BsonType::Int64:
+                return 8;
+            case BsonType::ObjectId:
+                return 12;
+            case BsonType::Decimal128:
+                return 16;
+            case BsonType::String:
+            case BsonType::JavaScript:
+            case BsonType::Symbol:
+                return prefixedSize(data, 0);
+            case BsonType::DbPointer:
+                return prefixedSize(data, 12);
+            case BsonType::Binary:
+                return prefixedSize(data, 1);
+            case BsonType::Document:
+            case BsonType::Array:
+            case BsonType::JavaScriptWithScope:
+                // The length includes itself
+                return prefixedSize(data, 0) - sizeof(int32_t);
+            case BsonType::Regex: {
+                const size_t pattern = cstringSize(data);
+                return pattern + cstringSize(data.subspan(pattern));
+            }
+        }
+        throw std::runtime_error("Corrupt BSON: unknown element type " + std::to_string(static_cast<int>(type)));
+    }
+
+    std::optional<std::string_view> BsonElement::string() const {
+        if (type != BsonType::String) {
+            return std::nullopt;
+        }
+        // Length prefix, then the bytes and a terminating zero counted by the length
+        if (value.size() < sizeof(int32_t) + 1) {
+            throw std::runtime_error("Corrupt BSON: string without terminator");
+        }
+        return std::string_view(value.data() + sizeof(int32_t), value.size() - sizeof(int32_t) - 1);
+    }
+
+    std::optional<BsonDocument> BsonElement::document() const {
+        if (type != BsonType::Document && type != BsonType::Array) {
+            return std::nullopt;
+        }
+        return BsonDocument(value);
+    }
+
+    BsonDocument::BsonDocument(const std::span<const char> data) {
+        const auto length = readInt32(data);
+        if (length < 5 || static_cast<size_t>(length) > data.size()) {
+            throw std::runtime_error("Corrupt BSON: document length " + std::to_string(length) + " out of bounds");
+        }
+        bytes = data.first(static_cast<size_t>(length));
+        if (bytes.back() != 0) {
+            throw std::runtime_error("Corrupt BSON: unterminated document");
+        }
+    }
+
+    BsonDocument::Cursor BsonDocument::elements() const {
+        // Between the length and the terminating zero
+        return Cursor(bytes.subspan(sizeof(int32_t), bytes.size() - sizeof(int32_t) - 1));
+    }
+
+    std::optional<BsonElement> BsonDocument::Cursor::next() {
+        if (rest.empty()) {
+            return std::nullopt;
+        }
+        const auto type = static_cast<BsonType>(rest[0]);
+        const size_t keySize = cstringSize(rest.subspan(1));
+        const std::string_view key(rest.data() + 1, keySize - 1);
+        const auto value = rest.subspan(1 + keySize);
+        const size_t size = valueSize(type, value);
+        if (size > value.size()) {
+            throw std::runtime_error("Corrupt BSON: element exceeds its document");
+        }
+        rest = value.subspan(size);
+        return BsonElement{.type = type, .key = key, .value = value.first(size)};
+    }
+
+    std::optional<BsonElement> BsonDocument::find(const std::string_view key) const {
+        auto cursor = elements();
+        while (auto element = cursor.next()) {
+            if (element->key == key) {
+                return element;
+            }
+        }
+        return std::nullopt;
+    }
+}
@@ -0,0 +1,78 @@
+#ifndef BSON_H
+#define BSON_H
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string_view>
+
+namespace dolos {
+    // Element types of the BSON specification that the crawl data uses or that have to be skipped
+    enum class BsonType : uint8_t {
+        Double = 0x01,
+        String = 0x02,
+        Document = 0x03,
+        Array = 0x04,
+        Binary = 0x05,
+        Undefined = 0x06,
+        ObjectId = 0x07,
+        Boolean = 0x08,
+        DateTime = 0x09,
+        Null = 0x0a,
+        Regex = 0x0b,
+        DbPointer = 0x0c,
+        JavaScript = 0x0d,
+        Symbol = 0x0e,
+        JavaScriptWithScope = 0x0f,
+        Int32 = 0x10,
+        Timestamp = 0x11,
+        Int64 = 0x12,
+        Decimal128 = 0x13,
+        MinKey = 0xff,
+        MaxKey = 0x7f,
+    };
+
+    class BsonDocument;
+
+    // Element of a raw BSON document, value points into the document bytes
+    struct BsonElement {
+        BsonType type;
+        std::string_view key;
+        std::span<const char> value;
+
+        // Contents without length prefix and terminator, empty if the element is no string
+        std::optional<std::string_view> string() const;
+
+        // Embedded document or array, empty if the element is neither
+        std::optional<BsonDocument> document() const;
+    };
+
+    // Read-only view of a BSON document, nothing is decoded until asked for. All sizes are checked against the
+    // view, corrupt input throws std::runtime_error.
+    class BsonDocument {
+        std::span<const char> bytes;
+
+    public:
+        // The document at the start of data, which may continue with further documents
+        explicit BsonDocument(std::span<const char> data);
+
+        size_t size() const { return bytes.size(); }
+
+        // Walks the elements in order: while (const auto element = cursor.next()) { ... }
+        class Cursor {
+            std::span<const char> rest;
+
+        public:
+            explicit Cursor(std::span<const char> elements) : rest(elements) {}
+
+            std::optional<BsonElement> next();
+        };
+
+        Cursor elements() const;
+
+        // First element with the key, a linear scan as BSON has no index
+        std::optional<BsonElement> find(std::string_view key) const;
+    };
+}
+
+#endif //BSON_H
@@ -0,0 +1,277 @@
+#include "classify.h"
+
+#include <bit>
+#include <cctype>
+#include <cstdint>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "trace.h"
+
+namespace dolos {
+    std::string_view inputClassName(const InputClass inputClass) {
+        switch (inputClass) {
+            case InputClass::Script:
+                return "script";
+            case InputClass::Empty:
+                return "empty";
+            case InputClass::TooShort:
+                return "too_short";
+            case InputClass::Json:
+                return "json";
+            case InputClass::Html:
+                return "html";
+            case InputClass::Binary:
+                return "binary";
+        }
+        return "unknown";
+    }
+
+    static bool isSpace(const char c) {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+    }
+
+    namespace {
+        struct ByteCounts {
+            size_t significant = 0;
+            // Below 0x20 and not whitespace, NUL included
+            size_t control = 0;
+        };
+    }
+
+    static void countScalar(const char *data, const size_t size, ByteCounts &counts) {
+        for (size_t i = 0; i < size; i++) {
+            const auto c = static_cast<unsigned char>(data[i]);
+            const bool space = isSpace(data[i]);
+            counts.significant += !space;
+            counts.control += c < 0x20 && !space;
+        }
+    }
+
+    static ByteCounts countBytes(const std::span<const char> data) {
+        ByteCounts counts;
+        size_t i = 0;
+#ifdef __SSE2__
+        // 16 bytes per step: whitespace by comparing against each of the four characters, control bytes as the
+        // non-negative ones below 0x20 (bytes of multibyte UTF-8 sequences are negative as signed chars)
+        const auto space = _mm_set1_epi8(' '), tab = _mm_set1_epi8('\t'), newline = _mm_set1_epi8('\n'),
+                   carriageReturn = _mm_set1_epi8('\r'), minusOne = _mm_set1_epi8(-1);
+        for (; i + 16 <= data.size(); i += 16) {
+            const auto bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data.data() + i));
+            const auto whitespace = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(bytes, space), _mm_cmpeq_epi8(bytes, tab)),
+                _mm_or_si128(_mm_cmpeq_epi8(bytes, newline), _mm_cmpeq_epi8(bytes, carriageReturn)));
+            const auto control = _mm_andnot_si128(
+                whitespace, _mm_and_si128(_mm_cmplt_epi8(bytes, space), _mm_cmpgt_epi8(bytes, minusOne)));
+            counts.significant += 16 - std::popcount(static_cast<uint32_t>(_mm_movemask_epi8(whitespace)));
+            counts.control += std::popcount(static_cast<uint32_t>(_mm_movemask_epi8(control)));
+        }
+#endif
+        countScalar(data.data() + i, data.size() - i, counts);
+        return counts;
+    }
+
+    namespace {
+        // Validating JSON scanner without building values, for deciding whether a payload is a JSON document
+        class JsonScanner {
+            std::string_view text;
+            size_t i = 0;
+
+            void skipSpace() {
+                while (i < text.size() && isSpace(text[i])) {
+                    i++;
+                }
+            }
+
+            bool literal(const std::string_view word) {
+                if (text.substr(i, word.size()) != word) {
+                    return false;
+                }
+                i += word.size();
+                return true;
+            }
+
+            bool digits() {
+                const size_t start = i;
+                while (i < text.size() && text[i] >= '0' && text[i] <= '9') {
+                    i++;
+                }
+                return i > start;
+            }
+
+            bool number() {
+                if (i < text.size() && text[i] == '-') {
+                    i++;
+                }
+                if (i < text.size() && text[i] == '0') {
+                    i++;
+                } else if (!digits()) {
+                    return false;
+                }
+                if (i < text.size() && text[i] == '.' && (++i, !digits())) {
+                    return false;
+                }
+                if (i < text.size() && (text[i] == 'e' || text[i] == 'E')) {
+                    i++;
+                    if (i < text.size() && (text[i] == '+' || text[i] == '-')) {
+                        i++;
+                    }
+                    return digits();
+                }
+                return true;
+            }
+
+            bool string() {
+                for (i++; i < text.size(); i++) {
+                    const auto c = static_cast<unsigned char>(text[i]);
+                    if (c == '"') {
+                        i++;
+                        return true;
+                    }
+                    if (c < 0x20) {
+                        return false;
+                    }
+                    if (c == '\\') {
+                        if (++i >= text.size()) {
+                            return false;
+                        }
+                        if (text[i] == 'u') {
+                            for (size_t j = 0; j < 4; j++) {
+                                if (++i >= text.size() || !std::isxdigit(static_cast<unsigned char>(text[i]))) {
+                                    return false;
+                                }
+                            }
+                        } else if (std::string_view("\"\\/bfnrt").find(text[i]) == std::string_view::npos) {
+                            return false;
+                        }
+                    }
+                }
+                return false;
+            }
+
+            bool scalar() {
+                switch (text[i]) {
+                    case '"':
+                        return string();
+                    case 't':
+                        return literal("true");
+                    case 'f':
+                        return literal("false");
+                    case 'n':
+                        return literal("null");
+                    default:
+                        return number();
+                }
+            }
+
+        public:
+            explicit JsonScanner(const std::string_view text) : text(text) {
+            }
+
+            // One object or array and nothing but whitespace after it
+            bool document() {
+                enum class Expect { Value, ValueOrClose, Key, KeyOrClose, Colon, CommaOrClose };
+                std::vector<char> open;
+                auto expect = Expect::Value;
+                for (skipSpace(); i < text.size(); skipSpace()) {
+                    const char c = text[i];
+                    switch (expect) {
+                        case Expect::ValueOrClose:
+                            if (c == ']') {
+                                open.pop_back();
+                                i++;
+                                expect = Expect::CommaOrClose;
+                                break;
+                            }
+                            [[fallthrough]];
+                        case Expect::Value:
+                            if (c == '{' || c == '[') {
+                                open.emplace_back(c);
+                                i++;
+                                expect = c == '{' ? Expect::KeyOrClose : Expect::ValueOrClose;
+                            } else if (open.empty() || !scalar()) {
+                                return false;
+                            } else {
+                                expect = Expect::CommaOrClose;
+                            }
+                            break;
+                        case Expect::KeyOrClose:
+                            if (c == '}') {
+                                open.pop_back();
+                                i++;
+                                expect = Expect::CommaOrClose;
+                                break;
+                            }
+                            [[fallthrough]];
+                        case Expect::Key:
+                            if (c != '"' || !string()) {
+                                return false;
+                            }
+                            expect = Expect::Colon;
+                            break;
+                        case Expect::Colon:
+                            if (c != ':') {
+                                return false;
+                            }
+                            i++;
+                            expect = Expect::Value;
+                            break;
+                        case Expect::CommaOrClose:
+                            if (open.empty()) {
+                                return false;
+                            }
+                            if (c == ',') {
+                                expect = open.back() == '{' ? Expect::Key : Expect::Value;
+                            } else if ((c == '}' && open.back() == '{') || (c == ']' && open.back() == '[')) {
+                                open.pop_back();
+                            } else {
+                                return false;
+                            }
+                            i++;
+                            break;
+                    }
+                }
+                return open.empty() && expect == Expect::CommaOrClose;
+            }
+        };
+    }
+
+    InputClass classifyInput(std::span<const char> data, const size_t minLength) {
+        DOLOS_TRACE("classify", "parse");
+        if (data.size() >= 3 && data[0] == '\xef' && data[1] == '\xbb' && data[2] == '\xbf') {
+            data = data.subspan(3);
+        }
+        const auto counts = countBytes(data);
+        if (counts.significant == 0) {
+            return InputClass::Empty;
+        }
+        // Text has next to no control bytes, compressed or image data about one in eight
+        if (counts.control * 100 > data.size()) {
+            return InputClass::Binary;
+        }
+        if (counts.significant < minLength) {
+            return InputClass::TooShort;
+        }
+
+        size_t first = 0;
+        while (isSpace(data[first])) {
+            first++;
+        }
+        const char c = data[first];
+        if (c == '<' && first + 1 < data.size()) {
+            // A tag, declaration or comment, as in error pages served instead of the script
+            const char next = data[first + 1];
+            if (std::isalpha(static_cast<unsigned char>(next)) || next == '!' || next == '?') {
+                return InputClass::Html;
+            }
+        }
+        const std::string_view text(data.data() + first, data.size() - first);
+        if ((c == '{' || c == '[') && JsonScanner(text).document()) {
+            return InputClass::Json;
+        }
+        return InputClass::Script;
+    }
+}
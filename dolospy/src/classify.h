@@ -0,0 +1,27 @@
+#ifndef CLASSIFY_H
+#define CLASSIFY_H
+
+#include <cstddef>
+#include <span>
+#include <string_view>
+
+namespace dolos {
+    // What a crawled "script" payload actually is, everything but Script can never match a library
+    enum class InputClass {
+        Script,
+        Empty,
+        TooShort,
+        Json,
+        Html,
+        Binary,
+    };
+
+    // "script", "empty", "too_short", "json", "html" or "binary"
+    std::string_view inputClassName(InputClass inputClass);
+
+    // Byte level checks before any parsing: whitespace only, fewer than minLength non-whitespace bytes, control
+    // bytes of binary data, a leading HTML or XML tag, or an object or array that is valid JSON as a whole
+    InputClass classifyInput(std::span<const char> data, size_t minLength = 32);
+}
+
+#endif //CLASSIFY_H
@@ -0,0 +1,159 @@
+#include "cluster.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <system_error>
+#include <unordered_map>
+
+#include "batchio.h"
+#include "hashing.h"
+#include "hierarchy.h"
+#include "parallel.h"
+#include "store.h"
+#include "tokenizer.h"
+#include "trace.h"
+#include "zpack.h"
+
+namespace dolos {
+    ScriptSketch sketchScript(const std::span<const char> content, const uint32_t k, const uint32_t w) {
+        DOLOS_TRACE("cluster.sketch", "hash");
+        auto hashes = fingerprint(tokenize(content), k, w);
+        std::ranges::sort(hashes);
+        hashes.erase(std::ranges::unique(hashes).begin(), hashes.end());
+
+        ScriptSketch sketch;
+        sketch.minima.fill(std::numeric_limits<uint32_t>::max());
+        sketch.fingerprints = static_cast<uint32_t>(hashes.size());
+        // The permutations are derived from two halves of one mixed hash (a + i * b), which keeps the inner loop
+        // free of further hashing
+        for (const auto hash: hashes) {
+            const auto mixed = sketchHash(hash);
+            const auto a = static_cast<uint32_t>(mixed), b = static_cast<uint32_t>(mixed >> 32) | 1;
+            for (uint32_t i = 0; i < ScriptSketch::size; i++) {
+                sketch.minima[i] = std::min(sketch.minima[i], a + i * b);
+            }
+        }
+        return sketch;
+    }
+
+    double sketchSimilarity(const ScriptSketch &a, const ScriptSketch &b) {
+        size_t equal = 0;
+        for (size_t i = 0; i < ScriptSketch::size; i++) {
+            equal += a.minima[i] == b.minima[i];
+        }
+        return static_cast<double>(equal) / ScriptSketch::size;
+    }
+
+    // Rows per band: the most that still makes pairs somewhat below the threshold likely candidates, as LSH with
+    // b bands of r rows collides at a similarity around (1 / b) ^ (1 / r)
+    static size_t bandRows(const double threshold) {
+        size_t rows = 1;
+        for (size_t r = 2; r <= ScriptSketch::size / 2; r *= 2) {
+            const double bands = static_cast<double>(ScriptSketch::size / r);
+            if (std::pow(1 / bands, 1 / static_cast<double>(r)) <= threshold - 0.05) {
+                rows = r;
+            }
+        }
+        return rows;
+    }
+
+    Clustering clusterSketches(const std::vector<ScriptSketch> &sketches, const double threshold,
+                               const std::vector<std::string> &partitions) {
+        if (!partitions.empty() && partitions.size() != sketches.size()) {
+            throw std::invalid_argument("Expected one partition per sketch");
+        }
+        DOLOS_TRACE("cluster.assign", "match");
+        const size_t rows = bandRows(threshold), bands = ScriptSketch::size / rows;
+        Clustering result{.representatives = std::vector<uint32_t>(sketches.size()),
+                          .similarities = std::vector<float>(sketches.size(), 1)};
+
+        // Representatives by (band, hash of its rows)
+        std::unordered_map<uint64_t, std::vector<uint32_t>> buckets;
+        std::vector<uint64_t> keys(bands);
+        std::vector<uint32_t> candidates;
+        for (uint32_t i = 0; i < sketches.size(); i++) {
+            const auto &sketch = sketches[i];
+            result.representatives[i] = i;
+            if (sketch.fingerprints == 0) {
+                result.clusters++;
+                continue;
+            }
+
+            candidates.clear();
+            // Buckets of other partitions are kept apart
+            const uint64_t partition = partitions.empty() ? 0 : std::hash<std::string>{}(partitions[i]);
+            for (size_t band = 0; band < bands; band++) {
+                uint64_t key = sketchHash(band ^ sketchHash(partition));
+                for (size_t row = band * rows; row < (band + 1) * rows; row++) {
+                    key = sketchHash(key ^ sketch.minima[row]);
+                }
+                keys[band] = key;
+                if (const auto it = buckets.find(key); it != buckets.end()) {
+                    candidates.insert(candidates.end(), it->second.begin(), it->second.end());
+                }
+            }
+            std::ranges::sort(candidates);
+            candidates.erase(std::ranges::unique(candidates).begin(), candidates.end());
+
+            double best = 0;
+            for (const auto candidate: candidates) {
+                if (!partitions.empty() && partitions[candidate] != partitions[i]) {
+                    continue;
+                }
+                if (const auto similarity = sketchSimilarity(sketch, sketches[candidate]); similarity > best) {
+                    best = similarity;
+                    result.representatives[i] = candidate;
+                }
+            }
+            if (best >= threshold) {
+                result.similarities[i] = static_cast<float>(best);
+                continue;
+            }
+
+            result.representatives[i] = i;
+            result.clusters++;
+            for (const auto key: keys) {
+                buckets[key].emplace_back(i);
+            }
+        }
+        return result;
+    }
+
+    Clustering clusterObjects(const std::filesystem::path &store, const std::vector<std::string> &keys,
+                              const ClusterOptions &options, const std::vector<std::string> &partitions) {
+        std::unique_ptr<ZstdPack> zpack;
+        std::unique_ptr<PackReader> packs;
+        if (std::filesystem::is_directory(store)) {
+            packs = std::make_unique<PackReader>(store);
+        } else {
+            zpack = std::make_unique<ZstdPack>(store);
+        }
+        const auto load = [&](const std::string &key) {
+            if (zpack) {
+                if (auto content = zpack->get(key)) {
+                    return std::move(*content);
+                }
+            } else if (packs->contains(key)) {
+                return xzDecompress(packs->compressed(key));
+            } else if (const auto path = store / key; key.find('/') == std::string::npos && exists(path)) {
+                const auto [data, error] = readWithPread(path);
+                if (error != 0) {
+                    throw std::system_error(error, std::generic_category(), "Failed to read " + path.string());
+                }
+                return xzDecompress(data);
+            }
+            throw std::runtime_error("Object not found: " + key);
+        };
+
+        std::vector<ScriptSketch> sketches(keys.size());
+        parallelFor(keys.size(), options.threads, [&](const size_t i) {
+            const auto content = load(keys[i]);
+            sketches[i] = sketchScript(content, options.k, options.w);
+        });
+        return clusterSketches(sketches, options.threshold, partitions);
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef CLUSTER_H
+#define CLUSTER_H
+
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace dolos {
+    // MinHash signature of the winnowed fingerprints of a script
+    struct ScriptSketch {
+        static constexpr size_t size = 128;
+
+        std::array<uint32_t, size> minima;
+        // Distinct fingerprints, scripts without any are never clustered
+        uint32_t fingerprints = 0;
+    };
+
+    ScriptSketch sketchScript(std::span<const char> content, uint32_t k, uint32_t w);
+
+    // Fraction of equal minima, an estimate of the Jaccard similarity of the fingerprint sets
+    double sketchSimilarity(const ScriptSketch &a, const ScriptSketch &b);
+
+    struct ClusterOptions {
+        // Estimated Jaccard similarity a script needs to its representative
+        double threshold = 0.9;
+        uint32_t k = 17, w = 23;
+        unsigned threads = 0;
+    };
+
+    struct Clustering {
+        // Index of the representative of every script, its own index for representatives
+        std::vector<uint32_t> representatives;
+        // Estimated similarity to the representative, 1 for representatives
+        std::vector<float> similarities;
+        size_t clusters = 0;
+    };
+
+    // Leader clustering in input order: a script joins the most similar earlier representative reaching the
+    // threshold, found through LSH bands of the sketches, and becomes a representative otherwise. Every member is
+    // similar to its representative itself, not only through a chain of neighbours. With partitions (one label per
+    // script, like the source map of a job) scripts only join representatives with the same label.
+    Clustering clusterSketches(const std::vector<ScriptSketch> &sketches, double threshold,
+                               const std::vector<std::string> &partitions = {});
+
+    // Sketches and clusters the objects of a store, a .zpack or a store directory of packs and loose xz files
+    Clustering clusterObjects(const std::filesystem::path &store, const std::vector<std::string> &keys,
+                              const ClusterOptions &options = {}, const std::vector<std::string> &partitions = {});
+}
+
+#endif //CLUSTER_H
@@ -0,0 +1,158 @@
+#include "compare.h"
+
+#include <algorithm>
+#include <bit>
+#include <span>
+#include <stdexcept>
+#include <system_error>
+
+#include "batchio.h"
+#include "hashing.h"
+#include "parallel.h"
+#include "tokenizer.h"
+#include "trace.h"
+
+namespace dolos {
+    std::vector<std::filesystem::path> collectInputs(const std::vector<std::filesystem::path> &paths,
+                                                     const std::vector<std::string> &extensions) {
+        std::vector<std::filesystem::path> result;
+        for (const auto &path: paths) {
+            if (!std::filesystem::is_directory(path)) {
+                result.emplace_back(path);
+                continue;
+            }
+
+            std::vector<std::filesystem::path> found;
+            for (const auto &entry: std::filesystem::recursive_directory_iterator(path)) {
+                const auto extension = entry.path().extension().string();
+                if (entry.is_regular_file() && std::ranges::find(extensions, extension) != extensions.end()) {
+                    found.emplace_back(entry.path());
+                }
+            }
+            std::ranges::sort(found);
+            result.insert(result.end(), found.begin(), found.end());
+        }
+        return result;
+    }
+
+    std::vector<FileFingerprints> fingerprintFiles(const std::vector<std::filesystem::path> &paths, const uint32_t k,
+                                                   const uint32_t w, const unsigned threads) {
+        std::vector<FileFingerprints> files(paths.size());
+        parallelFor(paths.size(), threads, [&](const size_t i) {
+            const auto [data, error] = readWithPread(paths[i]);
+            if (error != 0) {
+                throw std::system_error(error, std::generic_category(), "Failed to read " + paths[i].string());
+            }
+            const auto tokens = tokenize(std::span(data.data(), data.size()));
+            auto hashes = fingerprint(tokens, k, w);
+            std::ranges::sort(hashes);
+            const auto [first, last] = std::ranges::unique(hashes);
+            hashes.erase(first, last);
+            files[i] = {.name = paths[i].string(), .hashes = std::move(hashes)};
+        });
+        return files;
+    }
+
+    // Start of row i of the upper triangle, row i holds the pairs (i, i + 1) ... (i, size - 1)
+    static size_t rowOffset(const size_t size, const size_t i) {
+        return i * size - i * (i + 1) / 2;
+    }
+
+    uint32_t SimilarityMatrix::at(size_t i, size_t j) const {
+        if (i == j) {
+            return totals[i];
+        }
+        if (i > j) {
+            std::swap(i, j);
+        }
+        return covered[rowOffset(size, i) + j - i - 1];
+    }
+
+    SimilarityMatrix compareAll(const std::vector<FileFingerprints> &files, const unsigned threads) {
+        const size_t size = files.size();
+        SimilarityMatrix matrix{
+            .size = size,
+            .totals = std::vector<uint32_t>(size),
+            .covered = std::vector<uint32_t>(size * (size - std::min<size_t>(size, 1)) / 2, 0),
+        };
+
+        // Inverted index of all files: which files contain each hash, as (hash, file) pairs sorted by hash
+        std::vector<std::pair<uint64_t, uint32_t>> postings;
+        size_t totalHashes = 0;
+        for (size_t i = 0; i < size; i++) {
+            matrix.totals[i] = static_cast<uint32_t>(files[i].hashes.size());
+            totalHashes += files[i].hashes.size();
+        }
+        postings.reserve(totalHashes);
+        for (size_t i = 0; i < size; i++) {
+            for (const auto hash: files[i].hashes) {
+                postings.emplace_back(hash, static_cast<uint32_t>(i));
+            }
+        }
+        std::ranges::sort(postings);
+
+        // Rows are independent, each one walks the postings of its own hashes and only counts later files
+        parallelFor(size, threads, [&](const size_t i) {
+            DOLOS_TRACE("compare.row", "lookup");
+            const size_t row = rowOffset(size, i);
+            auto it = postings.begin();
+            for (const auto hash: files[i].hashes) {
+                // Hashes of a file are sorted too, so the search continues where the previous one ended
+                it = std::lower_bound(it, postings.end(), std::pair{hash, static_cast<uint32_t>(i + 1)});
+                for (; it != postings.end() && it->first == hash; ++it) {
+                    matrix.covered[row + it->second - i - 1] += 1;
+                }
+            }
+        });
+
+        return matrix;
+    }
+
+    static std::string csvField(const std::string &value) {
+        if (value.find_first_of(",\"\n") == std::string::npos) {
+            return value;
+        }
+        std::string quoted = "\"";
+        for (const char c: value) {
+            if (c == '"') {
+                quoted += '"';
+            }
+            quoted += c;
+        }
+        return quoted + '"';
+    }
+
+    void writeCsv(std::ostream &out, const std::vector<FileFingerprints> &files, const SimilarityMatrix &matrix) {
+        DOLOS_TRACE("emit.matrix", "emit");
+        out << "left,right,covered,leftTotal,rightTotal\n";
+        for (size_t i = 0; i < matrix.size; i++) {
+            const auto left = csvField(files[i].name);
+            for (size_t j = i + 1; j < matrix.size; j++) {
+                out << left << ',' << csvField(files[j].name) << ',' << matrix.at(i, j) << ','
+                        << matrix.totals[i] << ',' << matrix.totals[j] << '\n';
+            }
+        }
+    }
+
+    template<typename T>
+    static void writeRaw(std::ostream &out, const T *values, const size_t count) {
+        static_assert(std::endian::native == std::endian::little, "Binary matrices are written little-endian");
+        out.write(reinterpret_cast<const char *>(values), static_cast<std::streamsize>(count * sizeof(T)));
+    }
+
+    void writeBinary(std::ostream &out, const std::vector<FileFingerprints> &files, const SimilarityMatrix &matrix) {
+        DOLOS_TRACE("emit.matrix", "emit");
+        constexpr uint32_t version = 1;
+        const auto size = static_cast<uint32_t>(matrix.size);
+        out.write("DOLOSMAT", 8);
+        writeRaw(out, &version, 1);
+        writeRaw(out, &size, 1);
+        for (const auto &file: files) {
+            const auto length = static_cast<uint32_t>(file.name.size());
+            writeRaw(out, &length, 1);
+            out.write(file.name.data(), length);
+        }
+        writeRaw(out, matrix.totals.data(), matrix.totals.size());
+        writeRaw(out, matrix.covered.data(), matrix.covered.size());
+    }
+}
@@ -0,0 +1,48 @@
+#ifndef COMPARE_H
+#define COMPARE_H
+
+#include <cstdint>
+#include <filesystem>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace dolos {
+    // Sorted, deduplicated fingerprints of one input file, the same set Index::addToGroup stores per group
+    struct FileFingerprints {
+        std::string name;
+        std::vector<uint64_t> hashes;
+    };
+
+    // Expands directories recursively to the files with one of the given extensions, in sorted order. Files given
+    // explicitly are always kept.
+    std::vector<std::filesystem::path> collectInputs(const std::vector<std::filesystem::path> &paths,
+                                                     const std::vector<std::string> &extensions);
+
+    // Reads, tokenizes and fingerprints all files on the given number of threads (0: one per core)
+    std::vector<FileFingerprints> fingerprintFiles(const std::vector<std::filesystem::path> &paths, uint32_t k,
+                                                   uint32_t w, unsigned threads = 0);
+
+    // Shared fingerprints of every pair of files. Only the upper triangle is stored, row by row.
+    struct SimilarityMatrix {
+        size_t size = 0;
+        std::vector<uint32_t> totals;
+        std::vector<uint32_t> covered;
+
+        uint32_t at(size_t i, size_t j) const;
+    };
+
+    SimilarityMatrix compareAll(const std::vector<FileFingerprints> &files, unsigned threads = 0);
+
+    // One line per pair: left,right,covered,leftTotal,rightTotal
+    void writeCsv(std::ostream &out, const std::vector<FileFingerprints> &files, const SimilarityMatrix &matrix);
+
+    // Little-endian layout:
+    //   magic "DOLOSMAT", uint32 version, uint32 size
+    //   size names, each as uint32 length followed by the bytes
+    //   uint32 totals[size]
+    //   uint32 covered[size * (size - 1) / 2], upper triangle row by row
+    void writeBinary(std::ostream &out, const std::vector<FileFingerprints> &files, const SimilarityMatrix &matrix);
+}
+
+#endif //COMPARE_H
@@ -0,0 +1,143 @@
+#include "crawl.h"
+
+#include <algorithm>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
+
+#include "bson.h"
+#include "mapped.h"
+#include "parallel.h"
+#include "trace.h"
+
+namespace dolos {
+    const std::vector<std::string> &defaultCdnHosts() {
+        static const std::vector<std::string> hosts = {
+            "//cdn.jsdelivr.net",
+            "//cdnjs.cloudflare.com",
+            "//unpkg.com",
+            "//ajax.googleapis.com",
+            "//ajax.aspnetcdn.com",
+            "//code.jquery.com",
+        };
+        return hosts;
+    }
+
+    namespace {
+        struct Script {
+            std::string_view source, sourceMap;
+
+            auto operator<=>(const Script &) const = default;
+        };
+    }
+
+    static void scanFile(const std::filesystem::path &path, const std::span<const char> data, const CrawlFilter &filter,
+                         std::vector<Script> &scripts, size_t &documents) {
+        DOLOS_TRACE("crawl.file", "io");
+        for (size_t offset = 0; offset < data.size();) {
+            const BsonDocument document(data.subspan(offset));
+            offset += document.size();
+            documents++;
+
+            std::optional<BsonElement> meta;
+            bool hasTime = false;
+            auto fields = document.elements();
+            while (const auto field = fields.next()) {
+                hasTime |= field->key == "time";
+                if (field->key == "meta") {
+                    meta = field;
+                }
+            }
+            if (!hasTime) {
+                throw std::runtime_error("Unsupported V1 document found in " + path.string());
+            }
+            // Failed visits store an error instead of the responses
+            if (!meta || meta->type != BsonType::Array) {
+                continue;
+            }
+
+            auto responses = meta->document()->elements();
+            while (const auto response = responses.next()) {
+                const auto entry = response->document();
+                if (!entry) {
+                    continue;
+                }
+                std::optional<std::string_view> type, url, source, sourceMap;
+                bool hasSource = false;
+                auto cursor = entry->elements();
+                while (const auto field = cursor.next()) {
+                    if (field->key == "type") {
+                        type = field->string();
+                    } else if (field->key == "url") {
+                        url = field->string();
+                    } else if (field->key == "source") {
+                        hasSource = true;
+                        source = field->string();
+                    } else if (field->key == "sourceMap") {
+                        sourceMap = field->string();
+                    }
+                }
+
+                if (type != "js") {
+                    continue;
+                }
+                if (url && std::ranges::any_of(filter.excludedUrls, [&](const std::string &host) {
+                    return url->find(host) != std::string_view::npos;
+                })) {
+                    continue;
+                }
+                if (filter.requiresSourceMap && !sourceMap) {
+                    continue;
+                }
+                if (!source) {
+                    const std::string problem = hasSource ? "Script source is no string" : "Script without source";
+                    throw std::runtime_error(problem + " in " + path.string());
+                }
+                scripts.emplace_back(Script{*source, sourceMap.value_or(std::string_view())});
+            }
+        }
+    }
+
+    CrawlJobs buildJobList(const std::vector<std::filesystem::path> &files, const CrawlFilter &filter,
+                           const unsigned threads) {
+        // Mappings stay open until the jobs are copied out, the scripts point into them
+        std::vector<MappedFile> mappings(files.size());
+        std::vector<std::vector<Script>> scripts(files.size());
+        std::vector<size_t> documents(files.size()), counts(files.size());
+        parallelFor(files.size(), threads, [&](const size_t i) {
+            mappings[i] = MappedFile(files[i]);
+            mappings[i].advise(Advice::Sequential);
+            scanFile(files[i], mappings[i].data(), filter, scripts[i], documents[i]);
+            counts[i] = scripts[i].size();
+            std::ranges::sort(scripts[i]);
+            scripts[i].erase(std::ranges::unique(scripts[i]).begin(), scripts[i].end());
+        });
+
+        CrawlJobs result;
+        std::vector<Script> all;
+        for (size_t i = 0; i < files.size(); i++) {
+            result.documents += documents[i];
+            result.scripts += counts[i];
+            all.insert(all.end(), scripts[i].begin(), scripts[i].end());
+        }
+        std::ranges::sort(all);
+        all.erase(std::ranges::unique(all).begin(), all.end());
+
+        result.jobs.reserve(all.size());
+        for (const auto &[source, sourceMap]: all) {
+            std::string job;
+            job.reserve(source.size() + 1 + sourceMap.size());
+            job.append(source).append(":").append(sourceMap);
+            result.jobs.emplace_back(std::move(job));
+        }
+        return result;
+    }
+
+    void writeJobList(std::ostream &out, const std::vector<std::string> &jobs) {
+        for (const auto &job: jobs) {
+            out.write(job.data(), static_cast<std::streamsize>(job.size()));
+            out.put('\0');
+        }
+    }
+}
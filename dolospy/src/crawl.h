@@ -0,0 +1,36 @@
+#ifndef CRAWL_H
+#define CRAWL_H
+
+#include <cstddef>
+#include <filesystem>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace dolos {
+    // CDN hosts whose scripts are library copies rather than bundles, matched anywhere in the URL
+    const std::vector<std::string> &defaultCdnHosts();
+
+    struct CrawlFilter {
+        std::vector<std::string> excludedUrls = defaultCdnHosts();
+        bool requiresSourceMap = false;
+    };
+
+    struct CrawlJobs {
+        // "<source hash>:<source map hash>", the second part empty without source map. Sorted and unique.
+        std::vector<std::string> jobs;
+        size_t documents = 0;
+        // Scripts that passed the filter, before deduplication
+        size_t scripts = 0;
+    };
+
+    // Collects the scripts of all crawl files (BSON documents with domain, time and a meta array of responses) that
+    // pass the filter. The files are mapped and walked as raw BSON, one file per thread.
+    CrawlJobs buildJobList(const std::vector<std::filesystem::path> &files, const CrawlFilter &filter,
+                           unsigned threads = 0);
+
+    // Jobs as zero terminated strings, the layout the eval workers read from shared memory
+    void writeJobList(std::ostream &out, const std::vector<std::string> &jobs);
+}
+
+#endif //CRAWL_H
@@ -0,0 +1,290 @@
+#include "exact.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <stdexcept>
+
+#include "trace.h"
+
+namespace dolos {
+    void Sha1::compress() {
+        std::array<uint32_t, 80> w{};
+        for (size_t i = 0; i < 16; i++) {
+            w[i] = static_cast<uint32_t>(block[i * 4]) << 24 | static_cast<uint32_t>(block[i * 4 + 1]) << 16
+                   | static_cast<uint32_t>(block[i * 4 + 2]) << 8 | static_cast<uint32_t>(block[i * 4 + 3]);
+        }
+        for (size_t i = 16; i < 80; i++) {
+            w[i] = std::rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+        }
+
+        auto [a, b, c, d, e] = state;
+        for (size_t i = 0; i < 80; i++) {
+            uint32_t f, k;
+            if (i < 20) {
+                f = (b & c) | (~b & d);
+                k = 0x5a827999;
+            } else if (i < 40) {
+                f = b ^ c ^ d;
+                k = 0x6ed9eba1;
+            } else if (i < 60) {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8f1bbcdc;
+            } else {
+                f = b ^ c ^ d;
+                k = 0xca62c1d6;
+            }
+            const uint32_t next = std::rotl(a, 5) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = std::rotl(b, 30);
+            b = a;
+            a = next;
+        }
+
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        blockSize = 0;
+    }
+
+    void Sha1::update(const std::span<const char> data) {
+        size_t i = 0;
+        while (i < data.size()) {
+            const size_t n = std::min(data.size() - i, block.size() - blockSize);
+            std::memcpy(block.data() + blockSize, data.data() + i, n);
+            blockSize += n;
+            i += n;
+            if (blockSize == block.size()) {
+                compress();
+            }
+        }
+        length += data.size();
+    }
+
+    void Sha1::update(const char c) {
+        block[blockSize++] = static_cast<uint8_t>(c);
+        if (blockSize == block.size()) {
+            compress();
+        }
+        length += 1;
+    }
+
+    Digest Sha1::finish() {
+        const uint64_t bits = length * 8;
+        update('\x80');
+        while (blockSize != 56) {
+            update('\0');
+        }
+        for (int shift = 56; shift >= 0; shift -= 8) {
+            update(static_cast<char>(bits >> shift));
+        }
+
+        Digest digest;
+        for (size_t i = 0; i < state.size(); i++) {
+            for (size_t j = 0; j < 4; j++) {
+                digest[i * 4 + j] = static_cast<uint8_t>(state[i] >> (24 - j * 8));
+            }
+        }
+        return digest;
+    }
+
+    Digest sha1(const std::span<const char> content) {
+        Sha1 hash;
+        hash.update(content);
+        return hash.finish();
+    }
+
+    static bool isSpace(const char c) {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+    }
+
+    Digest normalizedSha1(const std::span<const char> content) {
+        Sha1 hash;
+        bool pendingSpace = false, started = false;
+        size_t runStart = 0;
+        for (size_t i = 0; i < content.size(); i++) {
+            if (isSpace(content[i])) {
+                // Flush the run of non-whitespace before it in one piece
+                if (runStart < i) {
+                    hash.update(content.subspan(runStart, i - runStart));
+                }
+                runStart = i + 1;
+                pendingSpace = started;
+                continue;
+            }
+            if (pendingSpace) {
+                hash.update(' ');
+                pendingSpace = false;
+            }
+            started = true;
+        }
+        if (runStart < content.size()) {
+            hash.update(content.subspan(runStart));
+        }
+        return hash.finish();
+    }
+
+    std::string toHex(const Digest &digest) {
+        static constexpr char digits[] = "0123456789abcdef";
+        std::string hex;
+        hex.reserve(digest.size() * 2);
+        for (const auto byte: digest) {
+            hex += digits[byte >> 4];
+            hex += digits[byte & 15];
+        }
+        return hex;
+    }
+
+    static uint64_t slotHash(const Digest &digest, const DigestKind kind) {
+        uint64_t hash;
+        std::memcpy(&hash, digest.data(), sizeof(hash));
+        return hash ^ static_cast<uint64_t>(kind) * 0x9e3779b97f4a7c15;
+    }
+
+    void ExactIndexBuilder::add(const std::string &version, const Digest &raw, const Digest &normalized) {
+        const auto [it, inserted] = ids.try_emplace(version, static_cast<uint32_t>(names.size()));
+        if (inserted) {
+            names.emplace_back(version);
+        }
+        entries[{raw, DigestKind::Raw}].insert(it->second);
+        entries[{normalized, DigestKind::Normalized}].insert(it->second);
+    }
+
+    void ExactIndexBuilder::add(const std::string &version, const std::span<const char> content) {
+        add(version, sha1(content), normalizedSha1(content));
+    }
+
+    static constexpr size_t sectionAlignment = 64;
+
+    static size_t align(const size_t offset) {
+        return (offset + sectionAlignment - 1) / sectionAlignment * sectionAlignment;
+    }
+
+    std::string ExactIndexBuilder::serialize() const {
+        // At most half full, so probe sequences stay short
+        const uint64_t slotCount = std::bit_ceil(std::max<uint64_t>(16, entries.size() * 2));
+        std::vector<ExactSlot> slots(slotCount, ExactSlot{});
+        std::vector<uint32_t> versionIds;
+        for (const auto &[key, versions]: entries) {
+            const auto &[digest, kind] = key;
+            auto slot = slotHash(digest, kind) & (slotCount - 1);
+            while (slots[slot].count != 0) {
+                slot = (slot + 1) & (slotCount - 1);
+            }
+            slots[slot] = ExactSlot{
+                .digest = digest,
+                .kind = kind,
+                .reserved = {},
+                .first = static_cast<uint32_t>(versionIds.size()),
+                .count = static_cast<uint32_t>(versions.size()),
+            };
+            versionIds.insert(versionIds.end(), versions.begin(), versions.end());
+        }
+
+        std::vector<uint32_t> nameOffsets;
+        nameOffsets.reserve(names.size() + 1);
+        std::string nameData;
+        for (const auto &name: names) {
+            nameOffsets.emplace_back(nameData.size());
+            nameData += name;
+        }
+        nameOffsets.emplace_back(nameData.size());
+
+        ExactHeader header{};
+        std::memcpy(header.magic, ExactHeader::expectedMagic, sizeof(header.magic));
+        header.version = ExactHeader::currentVersion;
+        header.nameCount = static_cast<uint32_t>(names.size());
+        header.slotCount = slotCount;
+        header.entryCount = entries.size();
+        header.idCount = versionIds.size();
+        header.namesSize = nameData.size();
+        header.slotsOffset = align(sizeof(ExactHeader));
+        header.idsOffset = align(header.slotsOffset + slots.size() * sizeof(ExactSlot));
+        header.nameOffsetsOffset = align(header.idsOffset + versionIds.size() * sizeof(uint32_t));
+        header.namesOffset = align(header.nameOffsetsOffset + nameOffsets.size() * sizeof(uint32_t));
+
+        std::string out(header.namesOffset + nameData.size(), '\0');
+        std::memcpy(out.data(), &header, sizeof(header));
+        std::memcpy(out.data() + header.slotsOffset, slots.data(), slots.size() * sizeof(ExactSlot));
+        std::memcpy(out.data() + header.idsOffset, versionIds.data(), versionIds.size() * sizeof(uint32_t));
+        std::memcpy(out.data() + header.nameOffsetsOffset, nameOffsets.data(), nameOffsets.size() * sizeof(uint32_t));
+        std::memcpy(out.data() + header.namesOffset, nameData.data(), nameData.size());
+        return out;
+    }
+
+    template<typename T>
+    static std::span<const T> section(const std::span<const char> data, const uint64_t offset, const uint64_t count) {
+        if (offset % alignof(T) != 0 || offset > data.size() || count > (data.size() - offset) / sizeof(T)) {
+            throw std::runtime_error("Corrupt exact hash table: section out of bounds");
+        }
+        return {reinterpret_cast<const T *>(data.data() + offset), count};
+    }
+
+    ExactIndex::ExactIndex(const std::filesystem::path &path) : file(path) {
+        const auto data = file.data();
+        if (data.size() < sizeof(ExactHeader)) {
+            throw std::runtime_error("Not an exact hash table: " + path.string());
+        }
+        header = reinterpret_cast<const ExactHeader *>(data.data());
+        if (std::memcmp(header->magic, ExactHeader::expectedMagic, sizeof(header->magic)) != 0) {
+            throw std::runtime_error("Not an exact hash table: " + path.string());
+        }
+        if (header->version != ExactHeader::currentVersion) {
+            throw std::runtime_error("Unsupported exact hash table version " + std::to_string(header->version)
+                                     + ", build " + path.string() + " again");
+        }
+
+        slots = section<ExactSlot>(data, header->slotsOffset, header->slotCount);
+        ids = section<uint32_t>(data, header->idsOffset, header->idCount);
+        nameOffsets = section<uint32_t>(data, header->nameOffsetsOffset, header->nameCount + 1ull);
+        const auto nameData = section<char>(data, header->namesOffset, header->namesSize);
+        names = std::string_view(nameData.data(), nameData.size());
+
+        if (!std::has_single_bit(header->slotCount) || header->entryCount >= header->slotCount
+            || nameOffsets.back() != header->namesSize) {
+            throw std::runtime_error("Corrupt exact hash table: " + path.string());
+        }
+        // The table is probed randomly, one page per lookup
+        file.advise(Advice::Random, header->slotsOffset, slots.size_bytes());
+    }
+
+    std::string_view ExactIndex::name(const uint32_t id) const {
+        if (id >= header->nameCount || nameOffsets[id] > nameOffsets[id + 1] || nameOffsets[id + 1] > names.size()) {
+            throw std::runtime_error("Corrupt exact hash table: name out of range");
+        }
+        return names.substr(nameOffsets[id], nameOffsets[id + 1] - nameOffsets[id]);
+    }
+
+    std::optional<ExactMatch> ExactIndex::find(const Digest &digest, const DigestKind kind) const {
+        const auto mask = header->slotCount - 1;
+        // The table is never full, so an empty slot ends every probe sequence
+        auto slot = slotHash(digest, kind) & mask;
+        for (uint64_t probe = 0; probe <= mask && slots[slot].count != 0; probe++, slot = (slot + 1) & mask) {
+            const auto &entry = slots[slot];
+            if (entry.kind != kind || entry.digest != digest) {
+                continue;
+            }
+            if (entry.first > ids.size() || entry.count > ids.size() - entry.first) {
+                throw std::runtime_error("Corrupt exact hash table: version range out of bounds");
+            }
+            ExactMatch match{.versions = {}, .normalized = kind == DigestKind::Normalized};
+            match.versions.reserve(entry.count);
+            for (const auto id: ids.subspan(entry.first, entry.count)) {
+                match.versions.emplace_back(name(id));
+            }
+            return match;
+        }
+        return std::nullopt;
+    }
+
+    std::optional<ExactMatch> ExactIndex::lookup(const std::span<const char> content) const {
+        DOLOS_TRACE("exact.lookup", "lookup");
+        if (auto match = find(sha1(content), DigestKind::Raw)) {
+            return match;
+        }
+        return find(normalizedSha1(content), DigestKind::Normalized);
+    }
+}
@@ -0,0 +1,126 @@
+#ifndef EXACT_H
+#define EXACT_H
+
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <optional>
+#include <set>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "mapped.h"
+
+namespace dolos {
+    using Digest = std::array<uint8_t, 20>;
+
+    class Sha1 {
+        std::array<uint32_t, 5> state = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0};
+        std::array<uint8_t, 64> block{};
+        size_t blockSize = 0;
+        uint64_t length = 0;
+
+        void compress();
+
+    public:
+        void update(std::span<const char> data);
+
+        void update(char c);
+
+        Digest finish();
+    };
+
+    // SHA-1 of the content, the key the crawler stores scripts under
+    Digest sha1(std::span<const char> content);
+
+    // SHA-1 with every run of whitespace replaced by one space and leading and trailing whitespace removed, so line
+    // endings, indentation and trailing newlines do not matter
+    Digest normalizedSha1(std::span<const char> content);
+
+    std::string toHex(const Digest &digest);
+
+    enum class DigestKind : uint8_t { Raw = 0, Normalized = 1 };
+
+    // Slot of the open-addressing table in <name>.exact.bin, empty if count is 0
+    struct ExactSlot {
+        Digest digest;
+        DigestKind kind;
+        uint8_t reserved[3];
+        // Range in the version id section
+        uint32_t first, count;
+    };
+
+    // Layout of an exact hash table. All sections start 64 byte aligned at the given offsets:
+    //   slots       ExactSlot[slotCount], slotCount a power of two, linear probing from the first 8 digest bytes
+    //   ids         uint32_t[idCount], ids of the pkg@version names of each slot
+    //   nameOffsets uint32_t[nameCount + 1], range of each name in names
+    //   names       char[namesSize]
+    struct ExactHeader {
+        static constexpr char expectedMagic[8] = {'D', 'O', 'L', 'O', 'S', 'E', 'X', 'H'};
+        static constexpr uint32_t currentVersion = 1;
+
+        char magic[8];
+        uint32_t version;
+        uint32_t nameCount;
+        uint64_t slotCount;
+        uint64_t entryCount;
+        uint64_t idCount;
+        uint64_t namesSize;
+        uint64_t slotsOffset;
+        uint64_t idsOffset;
+        uint64_t nameOffsetsOffset;
+        uint64_t namesOffset;
+    };
+
+    // Collects the files of many package versions in memory, then writes the table
+    class ExactIndexBuilder {
+        std::map<std::pair<Digest, DigestKind>, std::set<uint32_t>> entries;
+        std::unordered_map<std::string, uint32_t> ids;
+        std::vector<std::string> names;
+
+    public:
+        // Precomputed digests, so files can be hashed in parallel
+        void add(const std::string &version, const Digest &raw, const Digest &normalized);
+
+        void add(const std::string &version, std::span<const char> content);
+
+        size_t size() const { return entries.size(); }
+
+        std::string serialize() const;
+    };
+
+    struct ExactMatch {
+        // pkg@version of every release containing the file
+        std::vector<std::string_view> versions;
+        // Only the whitespace normalized content matched
+        bool normalized;
+    };
+
+    // Read-only exact hash table on a mapped file
+    class ExactIndex {
+        MappedFile file;
+        const ExactHeader *header;
+        std::span<const ExactSlot> slots;
+        std::span<const uint32_t> ids;
+        std::span<const uint32_t> nameOffsets;
+        std::string_view names;
+
+        std::optional<ExactMatch> find(const Digest &digest, DigestKind kind) const;
+
+    public:
+        explicit ExactIndex(const std::filesystem::path &path);
+
+        size_t size() const { return header->entryCount; }
+
+        std::string_view name(uint32_t id) const;
+
+        // Versions with a byte identical file, else with the same file up to whitespace
+        std::optional<ExactMatch> lookup(std::span<const char> content) const;
+    };
+}
+
+#endif //EXACT_H
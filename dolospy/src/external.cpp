@@ -0,0 +1,474 @@
+#include "external.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <queue>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <utility>
+
+#include "binary.h"
+#include "hashing.h"
+#include "hierarchy.h"
+#include "postings.h"
+#include "tokenizer.h"
+#include "trace.h"
+
+namespace dolos {
+    static constexpr size_t flushSize = size_t{1} << 20;
+    // Longest varint of a uint64_t
+    static constexpr size_t maxVarint = 10;
+
+    static void putVarint(std::string &out, uint64_t value) {
+        while (value >= 0x80) {
+            out.push_back(static_cast<char>(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<char>(value));
+    }
+
+    // A run is the sorted, deduplicated entries as varint pairs: the hash difference to the previous entry (the
+    // first to 0), then the group
+    class ExternalIndexBuilder::RunWriter {
+        std::filesystem::path path;
+        std::ofstream file;
+        std::string pending;
+        uint64_t previous = 0;
+        uint64_t written = 0;
+
+        void flush() {
+            file.write(pending.data(), static_cast<std::streamsize>(pending.size()));
+            written += pending.size();
+            pending.clear();
+        }
+
+    public:
+        explicit RunWriter(std::filesystem::path path) : path(std::move(path)), file(this->path, std::ios::binary) {
+            if (!file) {
+                throw std::runtime_error("Failed to create " + this->path.string());
+            }
+            pending.reserve(flushSize + 2 * maxVarint);
+        }
+
+        void add(const Entry &entry) {
+            putVarint(pending, entry.hash - previous);
+            putVarint(pending, entry.group);
+            previous = entry.hash;
+            if (pending.size() >= flushSize) {
+                flush();
+            }
+        }
+
+        // Bytes written
+        uint64_t close() {
+            flush();
+            file.close();
+            if (!file) {
+                throw std::runtime_error("Failed to write " + path.string());
+            }
+            return written;
+        }
+    };
+
+    class ExternalIndexBuilder::RunReader {
+        std::filesystem::path path;
+        std::ifstream file;
+        std::vector<char> buffer;
+        size_t position = 0, end = 0;
+        uint64_t previous = 0;
+
+        void refill() {
+            std::memmove(buffer.data(), buffer.data() + position, end - position);
+            end -= position;
+            position = 0;
+            file.read(buffer.data() + end, static_cast<std::streamsize>(buffer.size() - end));
+            end += file.gcount();
+            if (file.bad()) {
+                throw std::runtime_error("Failed to read " + path.string());
+            }
+        }
+
+        uint64_t varint() {
+            uint64_t value = 0;
+            for (unsigned shift = 0; shift < 64; shift += 7) {
+                if (position == end) {
+                    throw std::runtime_error("Truncated sort run " + path.string());
+                }
+                const auto byte = static_cast<uint8_t>(buffer[position++]);
+                value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+                if (byte < 0x80) {
+                    return value;
+                }
+            }
+            throw std::runtime_error("Corrupt sort run " + path.string());
+        }
+
+    public:
+        RunReader(std::filesystem::path path, const size_t bufferSize)
+            : path(std::move(path)), file(this->path, std::ios::binary), buffer(std::max(bufferSize, 4 * maxVarint)) {
+            if (!file) {
+                throw std::runtime_error("Failed to open " + this->path.string());
+            }
+        }
+
+        bool next(Entry &entry) {
+            if (end - position < 2 * maxVarint && file) {
+                refill();
+            }
+            if (position == end) {
+                return false;
+            }
+            previous += varint();
+            entry.hash = previous;
+            entry.group = static_cast<uint16_t>(varint());
+            return true;
+        }
+    };
+
+    class SectionWriter {
+        std::filesystem::path path;
+        std::ofstream file;
+        std::string pending;
+
+        void flush() {
+            file.write(pending.data(), static_cast<std::streamsize>(pending.size()));
+            pending.clear();
+        }
+
+    public:
+        explicit SectionWriter(std::filesystem::path path) : path(std::move(path)), file(this->path, std::ios::binary) {
+            if (!file) {
+                throw std::runtime_error("Failed to create " + this->path.string());
+            }
+            pending.reserve(flushSize);
+        }
+
+        void write(const void *data, const size_t size) {
+            pending.append(static_cast<const char *>(data), size);
+            if (pending.size() >= flushSize) {
+                flush();
+            }
+        }
+
+        template<typename T>
+        void add(const T &value) {
+            write(&value, sizeof(T));
+        }
+
+        void close() {
+            flush();
+            file.close();
+            if (!file) {
+                throw std::runtime_error("Failed to write " + path.string());
+            }
+        }
+    };
+
+    ExternalIndexBuilder::ExternalIndexBuilder(const uint16_t k, const uint16_t w, const ExternalBuildOptions &options)
+        : k(k), w(w), options(options) {
+        if (options.fanIn < 2) {
+            throw std::invalid_argument("Merging runs needs a fan-in of at least 2");
+        }
+        // Every thread may sort a full buffer while another one is being filled
+        const unsigned threads = options.threads == 0 ? std::max(1u, std::thread::hardware_concurrency())
+                                                      : options.threads;
+        bufferEntries = std::max<size_t>(options.memoryBudget / sizeof(Entry) / (threads + 1), 4096);
+
+        const auto base = options.temporaryDirectory.empty() ? std::filesystem::temp_directory_path()
+                                                             : options.temporaryDirectory;
+        auto pattern = (base / "dolos-index-XXXXXX").string();
+        if (mkdtemp(pattern.data()) == nullptr) {
+            throw std::system_error(errno, std::generic_category(), "Failed to create a directory in " + base.string());
+        }
+        directory = pattern;
+    }
+
+    ExternalIndexBuilder::~ExternalIndexBuilder() {
+        std::error_code error;
+        std::filesystem::remove_all(directory, error);
+    }
+
+    std::filesystem::path ExternalIndexBuilder::nextRun() {
+        return directory / ("run-" + std::to_string(runNumber++));
+    }
+
+    uint64_t ExternalIndexBuilder::writeRun(std::vector<Entry> entries, const std::filesystem::path &path) {
+        DOLOS_TRACE("external.run", "io");
+        std::ranges::sort(entries);
+        entries.erase(std::ranges::unique(entries).begin(), entries.end());
+        RunWriter writer(path);
+        for (const auto &entry: entries) {
+            writer.add(entry);
+        }
+        return writer.close();
+    }
+
+    size_t ExternalIndexBuilder::readBufferSize() const {
+        return std::clamp(options.memoryBudget / (options.fanIn + 1), size_t{64} << 10, size_t{4} << 20);
+    }
+
+    void ExternalIndexBuilder::merge(const std::span<const std::filesystem::path> paths,
+                                     const std::function<void(const Entry &)> &emit) {
+        using Head = std::pair<Entry, size_t>;
+        std::vector<std::unique_ptr<RunReader>> readers;
+        std::priority_queue<Head, std::vector<Head>, std::greater<>> heads;
+        for (const auto &path: paths) {
+            readers.emplace_back(std::make_unique<RunReader>(path, readBufferSize()));
+            if (Entry entry{}; readers.back()->next(entry)) {
+                heads.emplace(entry, readers.size() - 1);
+            }
+        }
+
+        // Runs are deduplicated on their own, the same pair may still be in several of them
+        bool first = true;
+        Entry last{};
+        while (!heads.empty()) {
+            auto [entry, reader] = heads.top();
+            heads.pop();
+            if (first || entry != last) {
+                emit(entry);
+                last = entry;
+                first = false;
+            }
+            if (readers[reader]->next(entry)) {
+                heads.emplace(entry, reader);
+            }
+        }
+    }
+
+    void ExternalIndexBuilder::mergePass() {
+        DOLOS_TRACE("external.merge", "io");
+        const std::vector inputs(runs.begin(), runs.begin() + static_cast<std::ptrdiff_t>(options.fanIn));
+        const auto path = nextRun();
+        RunWriter writer(path);
+        merge(inputs, [&](const Entry &entry) { writer.add(entry); });
+        counters.runBytes += writer.close();
+        counters.runs++;
+
+        for (const auto &input: inputs) {
+            std::filesystem::remove(input);
+        }
+        runs.erase(runs.begin(), runs.begin() + static_cast<std::ptrdiff_t>(options.fanIn));
+        runs.emplace_back(path);
+    }
+
+    uint16_t ExternalIndexBuilder::addGroup(const std::string &name) {
+        std::lock_guard lock(mutex);
+        if (const auto it = identifiers.find(name); it != identifiers.end()) {
+            return it->second;
+        }
+        if (names.size() > UINT16_MAX) {
+            throw std::runtime_error("An index holds at most " + std::to_string(UINT16_MAX + 1) + " groups");
+        }
+        const auto identifier = static_cast<uint16_t>(names.size());
+        identifiers.emplace(name, identifier);
+        names.emplace_back(name);
+        return identifier;
+    }
+
+    void ExternalIndexBuilder::add(const uint16_t group, const std::span<const char> sourceCode) {
+        const auto hashes = fingerprint(tokenize(sourceCode), k, w);
+        addHashes(group, hashes);
+    }
+
+    void ExternalIndexBuilder::addHashes(const uint16_t group, const std::span<const uint64_t> hashes) {
+        std::vector<Entry> full;
+        std::filesystem::path path;
+        {
+            std::lock_guard lock(mutex);
+            if (finished) {
+                throw std::runtime_error("Index already finished");
+            }
+            if (group >= names.size()) {
+                throw std::invalid_argument("Unknown group " + std::to_string(group));
+            }
+            if (!buffer.empty() && buffer.size() + hashes.size() > bufferEntries) {
+                full = std::exchange(buffer, {});
+                path = nextRun();
+            }
+            if (buffer.capacity() == 0) {
+                buffer.reserve(bufferEntries);
+            }
+            for (const auto hash: hashes) {
+                buffer.emplace_back(Entry{.hash = hash, .group = group});
+            }
+            counters.pairs += hashes.size();
+        }
+        if (full.empty()) {
+            return;
+        }
+
+        // Sorted and written outside the lock, so the other threads keep filling the next buffer meanwhile
+        const auto bytes = writeRun(std::move(full), path);
+        std::lock_guard lock(mutex);
+        runs.emplace_back(path);
+        counters.runs++;
+        counters.runBytes += bytes;
+    }
+
+    void ExternalIndexBuilder::finish(const std::filesystem::path &output) {
+        std::lock_guard lock(mutex);
+        if (finished) {
+            throw std::runtime_error("Index already finished");
+        }
+        finished = true;
+        if (!buffer.empty()) {
+            const auto path = nextRun();
+            counters.runBytes += writeRun(std::exchange(buffer, {}), path);
+            counters.runs++;
+            runs.emplace_back(path);
+        }
+        while (runs.size() > options.fanIn) {
+            mergePass();
+        }
+
+        const auto groupCount = static_cast<uint32_t>(names.size());
+        std::vector<uint32_t> groupSizes(groupCount, 0);
+        // Bottom-k sketches of the groups as max-heaps while merging
+        std::vector<std::vector<uint64_t>> sketches(options.sketchSize == 0 ? 0 : groupCount);
+
+        const auto hashesPath = directory / "hashes", offsetsPath = directory / "offsets",
+                   postingsPath = directory / "postings";
+        SectionWriter hashes(hashesPath), offsets(offsetsPath), postings(postingsPath);
+        uint64_t hashCount = 0, postingsSize = 0;
+        uint64_t previous = 0;
+        // Runs of the current hash, and encoded lists not yet written
+        std::vector<Run> hashRuns;
+        std::vector<uint8_t> lists;
+        const auto endHash = [&] {
+            if (!options.compressPostings) {
+                offsets.add(postingsSize);
+                postings.write(hashRuns.data(), hashRuns.size() * sizeof(Run));
+                postingsSize += hashRuns.size();
+                return;
+            }
+            offsets.add(encodePostings(hashRuns, lists, postingsSize));
+            if (lists.size() >= flushSize) {
+                postings.write(lists.data(), lists.size());
+                postingsSize += lists.size();
+                lists.clear();
+            }
+        };
+        {
+            DOLOS_TRACE("external.merge", "io");
+            merge(runs, [&](const Entry &entry) {
+                if (entry.group >= groupCount) {
+                    throw std::runtime_error("Corrupt sort run: group out of range");
+                }
+                // Groups of a hash arrive sorted and distinct, consecutive ids extend the current run
+                if (hashCount == 0 || entry.hash != previous) {
+                    if (hashCount > 0) {
+                        endHash();
+                    }
+                    hashes.add(entry.hash);
+                    hashCount++;
+                    previous = entry.hash;
+                    hashRuns.clear();
+                    hashRuns.emplace_back(Run{.first = entry.group, .last = entry.group});
+                } else if (hashRuns.back().last + 1 == entry.group) {
+                    hashRuns.back().last = entry.group;
+                } else {
+                    hashRuns.emplace_back(Run{.first = entry.group, .last = entry.group});
+                }
+
+                groupSizes[entry.group]++;
+                if (!sketches.empty()) {
+                    auto &sketch = sketches[entry.group];
+                    const auto value = sketchHash(entry.hash);
+                    if (sketch.size() < options.sketchSize) {
+                        sketch.emplace_back(value);
+                        std::ranges::push_heap(sketch);
+                    } else if (value < sketch.front()) {
+                        std::ranges::pop_heap(sketch);
+                        sketch.back() = value;
+                        std::ranges::push_heap(sketch);
+                    }
+                }
+            });
+        }
+        if (hashCount > 0) {
+            endHash();
+        }
+        if (options.compressPostings) {
+            lists.resize(lists.size() + listPadding, 0);
+            postings.write(lists.data(), lists.size());
+            postingsSize += lists.size();
+        } else {
+            offsets.add(postingsSize);
+        }
+        hashes.close();
+        offsets.close();
+        postings.close();
+        counters.hashes = hashCount;
+
+        for (auto &sketch: sketches) {
+            std::ranges::sort_heap(sketch);
+        }
+        const auto hierarchy = buildHierarchy(std::move(sketches), options.sketchSize);
+
+        std::vector<uint32_t> nameOffsets;
+        nameOffsets.reserve(groupCount + 1);
+        std::string allNames;
+        for (const auto &name: names) {
+            nameOffsets.emplace_back(allNames.size());
+            allNames += name;
+        }
+        nameOffsets.emplace_back(allNames.size());
+
+        BinaryHeader header{};
+        header.version = options.compressPostings ? BinaryHeader::currentVersion : BinaryHeader::uncompressedVersion;
+        header.k = k;
+        header.w = w;
+        header.groupCount = groupCount;
+        header.hashCount = hashCount;
+        header.postingsSize = postingsSize;
+        header.namesSize = allNames.size();
+        header.nodeCount = hierarchy.nodes.size();
+        header.sketchCount = hierarchy.sketches.size();
+        header = layoutBinary(header);
+
+        // Written next to the target and renamed, so a serving process never maps a partial file
+        const auto temporary = output.string() + ".tmp";
+        std::ofstream out(temporary, std::ios::binary);
+        uint64_t position = 0;
+        const auto write = [&](const uint64_t offset, const void *data, const size_t size) {
+            static constexpr char zeros[64] = {};
+            out.write(zeros, static_cast<std::streamsize>(offset - position));
+            out.write(static_cast<const char *>(data), static_cast<std::streamsize>(size));
+            position = offset + size;
+        };
+        const auto copy = [&](const uint64_t offset, const std::filesystem::path &path) {
+            write(offset, nullptr, 0);
+            if (const auto size = std::filesystem::file_size(path); size > 0) {
+                std::ifstream in(path, std::ios::binary);
+                out << in.rdbuf();
+                position += size;
+            }
+            std::filesystem::remove(path);
+        };
+        write(0, &header, sizeof(header));
+        copy(header.hashesOffset, hashesPath);
+        copy(header.offsetsOffset, offsetsPath);
+        copy(header.postingsOffset, postingsPath);
+        write(header.groupSizesOffset, groupSizes.data(), groupSizes.size() * sizeof(uint32_t));
+        write(header.nameOffsetsOffset, nameOffsets.data(), nameOffsets.size() * sizeof(uint32_t));
+        write(header.namesOffset, allNames.data(), allNames.size());
+        write(header.nodesOffset, hierarchy.nodes.data(), hierarchy.nodes.size() * sizeof(HierarchyNode));
+        write(header.sketchesOffset, hierarchy.sketches.data(), hierarchy.sketches.size() * sizeof(uint64_t));
+        out.close();
+        if (!out || position != binarySize(header)) {
+            throw std::runtime_error("Failed to write " + output.string());
+        }
+        std::filesystem::rename(temporary, output);
+    }
+
+    ExternalBuildStats ExternalIndexBuilder::stats() {
+        std::lock_guard lock(mutex);
+        return counters;
+    }
+}
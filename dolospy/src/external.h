@@ -0,0 +1,108 @@
+#ifndef EXTERNAL_H
+#define EXTERNAL_H
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace dolos {
+    struct ExternalBuildOptions {
+        // Sorted runs go into a fresh directory below this one, the system temporary directory if empty
+        std::filesystem::path temporaryDirectory;
+        // Bytes of buffered (hash, group) pairs, split between the threads adding concurrently
+        size_t memoryBudget = size_t{256} << 20;
+        // Threads calling add at the same time, 0 for one per core
+        unsigned threads = 0;
+        // Runs merged at once, more take several merge passes
+        size_t fanIn = 64;
+        // A sketch size of 0 leaves out the version hierarchy
+        uint32_t sketchSize = 64;
+        // Without compressed postings the index is written as version 3
+        bool compressPostings = true;
+    };
+
+    struct ExternalBuildStats {
+        // (hash, group) pairs added, duplicates included
+        uint64_t pairs = 0;
+        // Sorted runs written, including those of intermediate merge passes
+        uint64_t runs = 0;
+        uint64_t runBytes = 0;
+        // Distinct hashes of the finished index
+        uint64_t hashes = 0;
+    };
+
+    // Builds a <pkg>.index.bin without holding the index in memory. Fingerprints are buffered as (hash, group) pairs
+    // up to the memory budget, each full buffer is sorted and written as a delta encoded run by the thread that
+    // filled it, and finish k-way merges the runs straight into the sections of the binary index. The result is
+    // byte for byte what serializeBinary writes for an Index fed the same groups in the same order.
+    class ExternalIndexBuilder {
+        struct Entry {
+            uint64_t hash;
+            uint16_t group;
+
+            auto operator<=>(const Entry &) const = default;
+        };
+
+        class RunReader;
+        class RunWriter;
+
+        uint16_t k, w;
+        ExternalBuildOptions options;
+        std::filesystem::path directory;
+        size_t bufferEntries;
+
+        // Guards everything below
+        std::mutex mutex;
+        std::vector<Entry> buffer;
+        std::vector<std::string> names;
+        std::unordered_map<std::string, uint16_t> identifiers;
+        std::vector<std::filesystem::path> runs;
+        uint64_t runNumber = 0;
+        ExternalBuildStats counters;
+        bool finished = false;
+
+        // Needs the mutex held
+        std::filesystem::path nextRun();
+
+        // Sorts, deduplicates and writes the entries, returns the bytes written
+        static uint64_t writeRun(std::vector<Entry> entries, const std::filesystem::path &path);
+
+        size_t readBufferSize() const;
+
+        // Calls emit for every distinct entry of the runs in order
+        void merge(std::span<const std::filesystem::path> paths, const std::function<void(const Entry &)> &emit);
+
+        // Replaces the oldest fanIn runs by their merge, needs the mutex held
+        void mergePass();
+
+    public:
+        ExternalIndexBuilder(uint16_t k, uint16_t w, const ExternalBuildOptions &options = {});
+
+        ExternalIndexBuilder(const ExternalIndexBuilder &) = delete;
+        ExternalIndexBuilder &operator=(const ExternalIndexBuilder &) = delete;
+
+        // Removes the runs
+        ~ExternalIndexBuilder();
+
+        // Identifier of the group, a new one (in call order) for an unknown name
+        uint16_t addGroup(const std::string &name);
+
+        // Tokenizes and fingerprints one file of a group, safe to call from several threads
+        void add(uint16_t group, std::span<const char> sourceCode);
+
+        void addHashes(uint16_t group, std::span<const uint64_t> hashes);
+
+        // Merges everything added into the binary index, once every add returned. Written next to the output and
+        // renamed.
+        void finish(const std::filesystem::path &output);
+
+        ExternalBuildStats stats();
+    };
+}
+
+#endif //EXTERNAL_H
@@ -2,6 +2,8 @@
 
 #include <vector>
 
+#include "trace.h"
+
 namespace dolos {
     uint64_t tokenHash(char *tok) {
         uint64_t h = 0;
@@ -17,4 +19,11 @@ namespace dolos {
         i = ++i % k;
         return hash;
     }
+
+    std::vector<uint64_t> fingerprint(const std::span<const uint16_t> tokens, const uint32_t k, const uint32_t w) {
+        DOLOS_TRACE("fingerprint", "hash");
+        auto begin = RollingHashIterator(k, tokens.data());
+        const auto end = RollingHashIterator(k, tokens.data() + tokens.size());
+        return winnowFilter(w, begin, end, std::optional<uint32_t>(tokens.size() / w + 1));
+    }
 }
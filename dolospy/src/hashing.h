@@ -5,6 +5,7 @@
 #include <cstdint>
 #include <limits>
 #include <optional>
+#include <span>
 #include <vector>
 
 namespace dolos {
@@ -44,7 +45,7 @@ namespace dolos {
     };
 
     class RollingHashIterator {
-        std::vector<uint16_t>::const_iterator it;
+        const uint16_t *it;
         RollingHash hash;
 
     public:
@@ -52,8 +53,7 @@ namespace dolos {
         using difference_type = std::ptrdiff_t;
         using iterator_category = std::input_iterator_tag;
 
-        explicit RollingHashIterator(const uint32_t k,
-                                     const std::vector<uint16_t>::const_iterator it) : hash(k), it(it) {
+        explicit RollingHashIterator(const uint32_t k, const uint16_t *it) : it(it), hash(k) {
         }
 
         uint64_t operator*() { return hash(*it); } // Is not const !
@@ -93,6 +93,9 @@ namespace dolos {
 
         return filtered;
     };
+
+    // Winnowed k-gram hashes of a tokenized file, the fingerprints stored in an index
+    std::vector<uint64_t> fingerprint(std::span<const uint16_t> tokens, uint32_t k, uint32_t w);
 }
 
 #endif //HASHING_H
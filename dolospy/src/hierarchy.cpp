@@ -0,0 +1,200 @@
+#include "hierarchy.h"
+
+#include <algorithm>
+#include <cmath>
+#include <ranges>
+#include <stdexcept>
+
+namespace dolos {
+    uint64_t sketchHash(uint64_t hash) {
+        // splitmix64 finalizer
+        hash += 0x9e3779b97f4a7c15;
+        hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9;
+        hash = (hash ^ (hash >> 27)) * 0x94d049bb133111eb;
+        return hash ^ (hash >> 31);
+    }
+
+    // The sketchSize smallest distinct values of both sorted sketches
+    static std::vector<uint64_t> mergeSketches(const std::vector<uint64_t> &a, const std::vector<uint64_t> &b,
+                                               const size_t sketchSize) {
+        std::vector<uint64_t> merged;
+        merged.reserve(sketchSize);
+        std::ranges::set_union(a, b, std::back_inserter(merged));
+        merged.resize(std::min(merged.size(), sketchSize));
+        return merged;
+    }
+
+    // Jaccard similarity estimated from the smallest values of the union, counting those present in both
+    static double similarity(const std::vector<uint64_t> &a, const std::vector<uint64_t> &b, const size_t sketchSize) {
+        const auto merged = mergeSketches(a, b, sketchSize);
+        if (merged.empty()) {
+            return 1;
+        }
+        size_t both = 0;
+        for (const auto value: merged) {
+            both += std::ranges::binary_search(a, value) && std::ranges::binary_search(b, value);
+        }
+        return static_cast<double>(both) / static_cast<double>(merged.size());
+    }
+
+    static uint32_t estimateUnion(const std::vector<uint64_t> &sketch, const size_t sketchSize) {
+        if (sketch.size() < sketchSize) {
+            return static_cast<uint32_t>(sketch.size());
+        }
+        // The k-th smallest of n uniform values lies near k / n
+        const double fraction = std::ldexp(static_cast<double>(sketch.back()), -64);
+        return static_cast<uint32_t>(std::min(static_cast<double>(UINT32_MAX),
+                                              static_cast<double>(sketchSize - 1) / fraction));
+    }
+
+    Hierarchy buildHierarchy(const Index &index, const uint32_t sketchSize) {
+        std::vector<std::vector<uint64_t>> groupSketches(sketchSize == 0 ? 0 : index.groupCount());
+        for (uint32_t group = 0; group < groupSketches.size(); group++) {
+            auto &sketch = groupSketches[group];
+            if (const auto it = index.groups.find(group); it != index.groups.end()) {
+                sketch.reserve(it->second.size());
+                for (const auto hash: it->second) {
+                    sketch.emplace_back(sketchHash(hash));
+                }
+                std::ranges::sort(sketch);
+                sketch.resize(std::min<size_t>(sketch.size(), sketchSize));
+            }
+        }
+        return buildHierarchy(std::move(groupSketches), sketchSize);
+    }
+
+    Hierarchy buildHierarchy(std::vector<std::vector<uint64_t>> groupSketches, const uint32_t sketchSize) {
+        Hierarchy hierarchy;
+        const auto groupCount = static_cast<uint32_t>(groupSketches.size());
+        if (sketchSize == 0 || groupCount == 0) {
+            return hierarchy;
+        }
+
+        struct Cluster {
+            uint32_t node;
+            std::vector<uint64_t> sketch;
+        };
+        std::vector<Cluster> clusters;
+        clusters.reserve(groupCount);
+
+        const auto addNode = [&](HierarchyNode node, const std::vector<uint64_t> &sketch) {
+            node.unionSize = estimateUnion(sketch, sketchSize);
+            node.sketchOffset = static_cast<uint32_t>(hierarchy.sketches.size());
+            node.sketchSize = static_cast<uint32_t>(sketch.size());
+            hierarchy.sketches.insert(hierarchy.sketches.end(), sketch.begin(), sketch.end());
+            hierarchy.nodes.emplace_back(node);
+            return static_cast<uint32_t>(hierarchy.nodes.size() - 1);
+        };
+
+        for (uint32_t group = 0; group < groupCount; group++) {
+            auto &sketch = groupSketches[group];
+            const auto id = static_cast<uint16_t>(group);
+            const auto node = addNode({
+                .first = id, .last = id, .left = HierarchyNode::noChild, .right = HierarchyNode::noChild,
+                .unionSize = 0, .sketchOffset = 0, .sketchSize = 0,
+            }, sketch);
+            clusters.emplace_back(Cluster{.node = node, .sketch = std::move(sketch)});
+        }
+
+        // Agglomerative clustering of neighbours, similarities[i] belongs to clusters i and i + 1
+        std::vector<double> similarities;
+        similarities.reserve(clusters.size());
+        for (size_t i = 0; i + 1 < clusters.size(); i++) {
+            similarities.emplace_back(similarity(clusters[i].sketch, clusters[i + 1].sketch, sketchSize));
+        }
+
+        while (clusters.size() > 1) {
+            const auto best = static_cast<size_t>(std::distance(similarities.begin(),
+                                                                std::ranges::max_element(similarities)));
+            auto &left = clusters[best];
+            const auto &right = clusters[best + 1];
+            auto sketch = mergeSketches(left.sketch, right.sketch, sketchSize);
+            left.node = addNode({
+                .first = hierarchy.nodes[left.node].first, .last = hierarchy.nodes[right.node].last,
+                .left = left.node, .right = right.node,
+                .unionSize = 0, .sketchOffset = 0, .sketchSize = 0,
+            }, sketch);
+            left.sketch = std::move(sketch);
+            clusters.erase(clusters.begin() + static_cast<std::ptrdiff_t>(best) + 1);
+
+            similarities.erase(similarities.begin() + static_cast<std::ptrdiff_t>(best));
+            if (best > 0) {
+                similarities[best - 1] = similarity(clusters[best - 1].sketch, clusters[best].sketch, sketchSize);
+            }
+            if (best < similarities.size()) {
+                similarities[best] = similarity(clusters[best].sketch, clusters[best + 1].sketch, sketchSize);
+            }
+        }
+
+        return hierarchy;
+    }
+
+    std::vector<std::pair<uint16_t, uint16_t>> selectRanges(const std::span<const HierarchyNode> nodes,
+                                                            const std::span<const uint64_t> sketches,
+                                                            const std::span<const uint64_t> fingerprints,
+                                                            const PruneOptions &options) {
+        std::vector<std::pair<uint16_t, uint16_t>> ranges;
+        if (nodes.empty()) {
+            return ranges;
+        }
+
+        std::vector<uint64_t> query;
+        query.reserve(fingerprints.size());
+        for (const auto hash: fingerprints) {
+            query.emplace_back(sketchHash(hash));
+        }
+        std::ranges::sort(query);
+
+        // Shared fingerprints of query and subtree, from the share of the sketch found in the query
+        const auto estimate = [&](const HierarchyNode &node) {
+            if (node.sketchOffset + static_cast<uint64_t>(node.sketchSize) > sketches.size()) {
+                throw std::runtime_error("Corrupt hierarchy: sketch out of bounds");
+            }
+            if (node.sketchSize == 0) {
+                return 0.0;
+            }
+            size_t hits = 0;
+            for (const auto value: sketches.subspan(node.sketchOffset, node.sketchSize)) {
+                hits += std::ranges::binary_search(query, value);
+            }
+            return static_cast<double>(hits) / node.sketchSize * node.unionSize;
+        };
+
+        std::vector<uint32_t> frontier = {static_cast<uint32_t>(nodes.size() - 1)};
+        bool expanded = true;
+        while (expanded) {
+            expanded = false;
+            std::vector<std::pair<uint32_t, double>> next;
+            for (const auto id: frontier) {
+                const auto &node = nodes[id];
+                if (!node.isLeaf() && static_cast<uint32_t>(node.last - node.first) + 1 > options.leafGroups) {
+                    if (node.left >= id || node.right >= id) {
+                        throw std::runtime_error("Corrupt hierarchy: child after parent");
+                    }
+                    next.emplace_back(node.left, estimate(nodes[node.left]));
+                    next.emplace_back(node.right, estimate(nodes[node.right]));
+                    expanded = true;
+                } else {
+                    next.emplace_back(id, estimate(node));
+                }
+            }
+
+            double best = 0;
+            for (const auto score: next | std::views::values) {
+                best = std::max(best, score);
+            }
+            frontier.clear();
+            for (const auto &[id, score]: next) {
+                if (score > 0 && score >= options.beam * best) {
+                    frontier.emplace_back(id);
+                }
+            }
+        }
+
+        for (const auto id: frontier) {
+            ranges.emplace_back(nodes[id].first, nodes[id].last);
+        }
+        std::ranges::sort(ranges);
+        return ranges;
+    }
+}
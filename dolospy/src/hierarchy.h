@@ -0,0 +1,58 @@
+#ifndef HIERARCHY_H
+#define HIERARCHY_H
+
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "index.h"
+
+namespace dolos {
+    // Versions of a package clustered into a binary tree. Groups are numbered in version order and release lines
+    // are contiguous in that order, so every node covers a contiguous range of groups and the tree is built by
+    // repeatedly merging the most similar neighbouring clusters. Each node keeps a bottom-k MinHash sketch of the
+    // union of the fingerprints below it, which estimates how much of a query falls into the subtree.
+    struct HierarchyNode {
+        static constexpr uint32_t noChild = std::numeric_limits<uint32_t>::max();
+
+        uint16_t first, last;
+        uint32_t left, right;
+        // Estimated number of distinct fingerprints in the range, exact below the sketch size
+        uint32_t unionSize;
+        uint32_t sketchOffset, sketchSize;
+
+        bool isLeaf() const { return left == noChild; }
+    };
+
+    // Nodes are stored children first, the root is the last node. Sketches hold sorted sketchHash values.
+    struct Hierarchy {
+        std::vector<HierarchyNode> nodes;
+        std::vector<uint64_t> sketches;
+    };
+
+    // Order of fingerprints in the sketches, mixes the low entropy rolling hashes
+    uint64_t sketchHash(uint64_t hash);
+
+    Hierarchy buildHierarchy(const Index &index, uint32_t sketchSize);
+
+    // From the sketch of every group in group order: its sketchSize smallest sketchHash values, sorted
+    Hierarchy buildHierarchy(std::vector<std::vector<uint64_t>> groupSketches, uint32_t sketchSize);
+
+    struct PruneOptions {
+        // At each level, subtrees estimated to share less than this fraction of the best estimate among all
+        // remaining subtrees are dropped
+        double beam = 0.5;
+        // Ranges of at most this many groups are scored exactly instead of descending further
+        uint32_t leafGroups = 8;
+    };
+
+    // Inclusive group ranges worth scoring exactly, sorted by first group. Empty if no subtree shares anything.
+    std::vector<std::pair<uint16_t, uint16_t>> selectRanges(std::span<const HierarchyNode> nodes,
+                                                            std::span<const uint64_t> sketches,
+                                                            std::span<const uint64_t> fingerprints,
+                                                            const PruneOptions &options);
+}
+
+#endif //HIERARCHY_H
@@ -1,12 +1,15 @@
 #include "index.h"
 
 #include <algorithm>
+#include <ranges>
+#include <type_traits>
 #include <vector>
 
 #include <boost/json/src.hpp>
 
 #include "hashing.h"
 #include "tokenizer.h"
+#include "trace.h"
 
 namespace json = boost::json;
 
@@ -24,11 +27,7 @@ namespace dolos {
 
         std::vector<uint16_t> tokens = tokenize(sourceCode);
 
-        auto begin = RollingHashIterator(k, tokens.begin());
-        const auto end = RollingHashIterator(k, tokens.end());
-
-        for (const auto hashes = winnowFilter(w, begin, end, std::optional<uint32_t>(tokens.size() / w + 1));
-             const auto &hash: hashes) {
+        for (const auto hashes = fingerprint(tokens, k, w); const auto &hash: hashes) {
             index[hash].insert(identifier);
             groups[identifier].insert(hash);
         }
@@ -58,12 +57,13 @@ namespace dolos {
     }
 
     std::vector<Pair> Index::matchTokens(const TokenizedFile &tokens) const {
+        return matchHashes(fingerprint(tokens, k, w));
+    }
+
+    std::vector<Pair> Index::matchHashes(const std::span<const uint64_t> fingerprints) const {
         std::vector<Pair> pairs;
         const std::string external = "external";
 
-        auto begin = RollingHashIterator(k, tokens.begin());
-        const auto end = RollingHashIterator(k, tokens.end());
-
         std::unordered_map<uint16_t, uint32_t> sharedHashes;
         uint32_t total = 0;
 
@@ -72,16 +72,19 @@ namespace dolos {
             sharedHashes[id] = 0;
         }
 
-        for (const auto hashes = winnowFilter(w, begin, end, std::optional<uint32_t>(tokens.size() / w + 1));
-             const auto &hash: hashes) {
-            total += 1;
-            if (const auto it = index.find(hash); it != index.end()) {
-                for (const auto identifier: it->second) {
-                    sharedHashes[identifier] += 1;
+        {
+            DOLOS_TRACE("index.lookup", "lookup");
+            for (const auto &hash: fingerprints) {
+                total += 1;
+                if (const auto it = index.find(hash); it != index.end()) {
+                    for (const auto identifier: it->second) {
+                        sharedHashes[identifier] += 1;
+                    }
                 }
             }
         }
 
+        DOLOS_TRACE("emit.pairs", "emit");
         pairs.reserve(sharedHashes.size());
         for (auto [identifier, count]: sharedHashes) {
             pairs.emplace_back(Pair{
@@ -96,6 +99,81 @@ namespace dolos {
         return pairs;
     }
 
+    void Index::countShared(const std::span<const uint64_t> fingerprints, const std::span<uint32_t> counts) const {
+        if (counts.size() != groupCount()) {
+            throw std::invalid_argument("Expected one counter per group");
+        }
+
+        DOLOS_TRACE("index.lookup", "lookup");
+        std::ranges::fill(counts, 0);
+        for (const auto &hash: fingerprints) {
+            if (const auto it = index.find(hash); it != index.end()) {
+                for (const auto identifier: it->second) {
+                    counts[identifier] += 1;
+                }
+            }
+        }
+    }
+
+    uint32_t Index::groupCount() const {
+        uint32_t count = 0;
+        for (const auto &id: names | std::views::keys) {
+            count = std::max<uint32_t>(count, id + 1);
+        }
+        return count;
+    }
+
+    // glibc malloc: 8 byte chunk header, 16 byte alignment, 32 byte minimum chunk
+    static size_t allocation(const size_t bytes) {
+        return std::max<size_t>(32, (bytes + 8 + 15) & ~size_t{15});
+    }
+
+    // std::set node: color and three pointers, then the value
+    template<typename T>
+    static size_t treeNode() {
+        return allocation(32 + sizeof(T));
+    }
+
+    // std::unordered_map node: next pointer, the pair and the hash code, which is only cached for non-integer keys
+    template<typename K, typename V>
+    static size_t hashNode() {
+        constexpr bool cached = !std::is_integral_v<K>;
+        return allocation(sizeof(void *) + sizeof(std::pair<const K, V>) + (cached ? sizeof(size_t) : 0));
+    }
+
+    template<typename Map>
+    static size_t bucketArray(const Map &map) {
+        // A single bucket is stored inside the table itself
+        return map.bucket_count() > 1 ? allocation(map.bucket_count() * sizeof(void *)) : 0;
+    }
+
+    static size_t stringHeap(const std::string &value) {
+        return value.capacity() > 15 ? allocation(value.capacity() + 1) : 0;
+    }
+
+    MemoryUsage Index::memoryUsage() const {
+        MemoryUsage usage;
+        for (const auto &ids: index | std::views::values) {
+            usage.postings += ids.size() * treeNode<uint16_t>();
+        }
+        for (const auto &hashes: groups | std::views::values) {
+            usage.groupSets += hashes.size() * treeNode<uint64_t>();
+        }
+        usage.tableNodes = index.size() * hashNode<uint64_t, std::set<uint16_t>>()
+                           + groups.size() * hashNode<uint16_t, std::set<uint64_t>>();
+        usage.buckets = bucketArray(index) + bucketArray(groups) + bucketArray(identifiers) + bucketArray(names);
+
+        usage.names = identifiers.size() * hashNode<std::string, uint16_t>()
+                      + names.size() * hashNode<uint16_t, std::string>();
+        for (const auto &name: identifiers | std::views::keys) {
+            usage.names += stringHeap(name);
+        }
+        for (const auto &name: names | std::views::values) {
+            usage.names += stringHeap(name);
+        }
+        return usage;
+    }
+
     std::string Index::serialize() const {
         json::array sIdentifiers;
         sIdentifiers.reserve(identifiers.size());
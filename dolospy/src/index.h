@@ -17,6 +17,22 @@ namespace dolos {
         uint32_t leftTotal, rightTotal;
     };
 
+    // Estimated heap usage of an Index in bytes, modeled on the libstdc++ containers and glibc malloc
+    struct MemoryUsage {
+        // Tree nodes of the group id sets, one per (hash, group)
+        size_t postings = 0;
+        // Tree nodes of the fingerprint sets, one per (group, hash)
+        size_t groupSets = 0;
+        // Nodes of the hash -> groups and group -> hashes tables
+        size_t tableNodes = 0;
+        // Bucket arrays of all tables
+        size_t buckets = 0;
+        // Identifier and name tables, including the strings
+        size_t names = 0;
+
+        size_t total() const { return postings + groupSets + tableNodes + buckets + names; }
+    };
+
     struct Index {
         std::unordered_map<uint64_t, std::set<uint16_t>> index;
         std::unordered_map<uint16_t, std::set<uint64_t>> groups;
@@ -37,6 +53,16 @@ namespace dolos {
 
         std::vector<Pair> matchTokens(const TokenizedFile &tokens) const;
 
+        std::vector<Pair> matchHashes(std::span<const uint64_t> fingerprints) const;
+
+        // Shared hashes per group without allocating, counts needs exactly groupCount() entries
+        void countShared(std::span<const uint64_t> fingerprints, std::span<uint32_t> counts) const;
+
+        // Group ids are dense, this is one past the largest id
+        uint32_t groupCount() const;
+
+        MemoryUsage memoryUsage() const;
+
         std::string serialize() const;
     };
 }
@@ -0,0 +1,322 @@
+#include "dolos.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <memory>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "../binary.h"
+#include "../hashing.h"
+#include "../index.h"
+#include "../tokenizer.h"
+
+struct dolos_index {
+    std::unique_ptr<dolos::Index> index;
+    std::unique_ptr<dolos::MappedIndex> mapped;
+
+    uint16_t k() const { return mapped ? mapped->k() : index->k; }
+    uint16_t w() const { return mapped ? mapped->w() : index->w; }
+    uint32_t groupCount() const { return mapped ? mapped->groupCount() : index->groupCount(); }
+
+    void countShared(const std::span<const uint64_t> fingerprints, const std::span<uint32_t> counts) const {
+        if (mapped) {
+            mapped->countShared(fingerprints, counts);
+        } else {
+            index->countShared(fingerprints, counts);
+        }
+    }
+};
+
+struct dolos_fingerprints {
+    uint16_t k, w;
+    std::vector<uint64_t> hashes;
+};
+
+namespace {
+    thread_local std::string lastError;
+
+    struct Status : std::runtime_error {
+        dolos_status status;
+
+        Status(const dolos_status status, const std::string &message) : std::runtime_error(message), status(status) {
+        }
+    };
+
+    // Translates exceptions into status codes, nothing may cross the C boundary
+    template<typename F>
+    dolos_status guarded(F &&fn) noexcept {
+        try {
+            fn();
+            return DOLOS_OK;
+        } catch (const Status &e) {
+            lastError = e.what();
+            return e.status;
+        } catch (const std::bad_alloc &) {
+            lastError = "Out of memory";
+            return DOLOS_OUT_OF_MEMORY;
+        } catch (const std::invalid_argument &e) {
+            lastError = e.what();
+            return DOLOS_INVALID_ARGUMENT;
+        } catch (const std::system_error &e) {
+            lastError = e.what();
+            return DOLOS_IO_ERROR;
+        } catch (const std::exception &e) {
+            // Parsing errors of JSON and binary indexes
+            lastError = e.what();
+            return DOLOS_FORMAT_ERROR;
+        } catch (...) {
+            lastError = "Unknown error";
+            return DOLOS_INTERNAL_ERROR;
+        }
+    }
+
+    void require(const bool condition, const char *message) {
+        if (!condition) {
+            throw Status(DOLOS_INVALID_ARGUMENT, message);
+        }
+    }
+
+    std::string readAll(const char *path) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file.is_open()) {
+            throw Status(DOLOS_IO_ERROR, std::string("Failed to open ") + path);
+        }
+        std::ostringstream content;
+        content << file.rdbuf();
+        return std::move(content).str();
+    }
+}
+
+extern "C" {
+uint32_t dolos_api_version(void) {
+    return DOLOS_API_VERSION;
+}
+
+const char *dolos_status_string(const dolos_status status) {
+    switch (status) {
+        case DOLOS_OK: return "ok";
+        case DOLOS_INVALID_ARGUMENT: return "invalid argument";
+        case DOLOS_IO_ERROR: return "i/o error";
+        case DOLOS_FORMAT_ERROR: return "format error";
+        case DOLOS_BUFFER_TOO_SMALL: return "buffer too small";
+        case DOLOS_OUT_OF_MEMORY: return "out of memory";
+        case DOLOS_INTERNAL_ERROR: return "internal error";
+    }
+    return "unknown status";
+}
+
+const char *dolos_last_error(void) {
+    return lastError.c_str();
+}
+
+dolos_status dolos_tokenize(const char *source, const size_t length, uint16_t *tokens, const size_t capacity,
+                            size_t *count) {
+    return guarded([&] {
+        require(source || length == 0, "source is null");
+        require(count, "count is null");
+        const auto result = dolos::tokenize(std::span(source, length));
+        *count = result.size();
+        if (result.size() > capacity || (!tokens && !result.empty())) {
+            throw Status(DOLOS_BUFFER_TOO_SMALL, "Token buffer too small");
+        }
+        std::ranges::copy(result, tokens);
+    });
+}
+
+dolos_status dolos_fingerprints_create(const char *source, const size_t length, const uint16_t k, const uint16_t w,
+                                       dolos_fingerprints **out) {
+    return guarded([&] {
+        require(source || length == 0, "source is null");
+        require(out, "out is null");
+        require(k > 0 && w > 0, "k and w must be positive");
+        const auto tokens = dolos::tokenize(std::span(source, length));
+        *out = new dolos_fingerprints{.k = k, .w = w, .hashes = dolos::fingerprint(tokens, k, w)};
+    });
+}
+
+dolos_status dolos_fingerprints_create_batch(const size_t n, const char *const *sources, const size_t *lengths,
+                                             const uint16_t k, const uint16_t w, const uint32_t threads,
+                                             dolos_fingerprints **out) {
+    return guarded([&] {
+        require(n == 0 || (sources && lengths), "sources or lengths is null");
+        require(n == 0 || out, "out is null");
+        require(k > 0 && w > 0, "k and w must be positive");
+
+        std::vector<std::unique_ptr<dolos_fingerprints>> results(n);
+        std::atomic<size_t> next{0};
+        std::exception_ptr failure;
+        std::atomic<bool> failed{false};
+
+        const auto work = [&] {
+            for (size_t i; !failed.load() && (i = next.fetch_add(1)) < n;) {
+                try {
+                    require(sources[i] || lengths[i] == 0, "source is null");
+                    const auto tokens = dolos::tokenize(std::span(sources[i], lengths[i]));
+                    results[i] = std::make_unique<dolos_fingerprints>(dolos_fingerprints{
+                        .k = k, .w = w, .hashes = dolos::fingerprint(tokens, k, w),
+                    });
+                } catch (...) {
+                    if (!failed.exchange(true)) {
+                        failure = std::current_exception();
+                    }
+                }
+            }
+        };
+
+        const unsigned available = std::max(1u, std::thread::hardware_concurrency());
+        const size_t count = std::min<size_t>(n, threads > 0 ? threads : available);
+        {
+            std::vector<std::jthread> workers;
+            for (size_t t = 1; t < count; t++) {
+                workers.emplace_back(work);
+            }
+            work();
+        }
+        if (failure) {
+            std::rethrow_exception(failure);
+        }
+
+        for (size_t i = 0; i < n; i++) {
+            out[i] = results[i].release();
+        }
+    });
+}
+
+dolos_status dolos_fingerprints_get(const dolos_fingerprints *fingerprints, const uint64_t **hashes, size_t *count) {
+    return guarded([&] {
+        require(fingerprints && hashes && count, "argument is null");
+        *hashes = fingerprints->hashes.data();
+        *count = fingerprints->hashes.size();
+    });
+}
+
+void dolos_fingerprints_free(dolos_fingerprints *fingerprints) {
+    delete fingerprints;
+}
+
+dolos_status dolos_index_create(const uint16_t k, const uint16_t w, dolos_index **out) {
+    return guarded([&] {
+        require(out, "out is null");
+        require(k > 0 && w > 0, "k and w must be positive");
+        *out = new dolos_index{.index = std::make_unique<dolos::Index>(k, w), .mapped = nullptr};
+    });
+}
+
+dolos_status dolos_index_open(const char *path, dolos_index **out) {
+    return guarded([&] {
+        require(path && out, "argument is null");
+        auto result = std::make_unique<dolos_index>();
+        if (std::string_view(path).ends_with(".bin")) {
+            result->mapped = std::make_unique<dolos::MappedIndex>(path);
+        } else {
+            result->index = std::make_unique<dolos::Index>(readAll(path));
+        }
+        *out = result.release();
+    });
+}
+
+dolos_status dolos_index_add(dolos_index *index, const char *group, const char *source, const size_t length) {
+    return guarded([&] {
+        require(index && group, "argument is null");
+        require(source || length == 0, "source is null");
+        require(index->index != nullptr, "Mapped indexes are read-only");
+        index->index->addToGroup(group, std::span(source, length));
+    });
+}
+
+dolos_status dolos_index_save(const dolos_index *index, const char *path, const int binary) {
+    return guarded([&] {
+        require(index && path, "argument is null");
+        require(index->index != nullptr, "Mapped indexes are already saved");
+        const auto content = binary ? dolos::serializeBinary(*index->index) : index->index->serialize();
+        std::ofstream file(path, std::ios::binary);
+        file.write(content.data(), static_cast<std::streamsize>(content.size()));
+        if (!file) {
+            throw Status(DOLOS_IO_ERROR, std::string("Failed to write ") + path);
+        }
+    });
+}
+
+dolos_status dolos_index_info(const dolos_index *index, uint16_t *k, uint16_t *w, uint32_t *groups) {
+    return guarded([&] {
+        require(index, "index is null");
+        if (k) *k = index->k();
+        if (w) *w = index->w();
+        if (groups) *groups = index->groupCount();
+    });
+}
+
+dolos_status dolos_index_group_name(const dolos_index *index, const uint32_t group, char *name, const size_t capacity,
+                                    size_t *length) {
+    return guarded([&] {
+        require(index && length, "argument is null");
+        require(group < index->groupCount(), "group out of range");
+        std::string_view result;
+        if (index->mapped) {
+            result = index->mapped->name(group);
+        } else if (const auto it = index->index->names.find(group); it != index->index->names.end()) {
+            result = it->second;
+        }
+        *length = result.size();
+        if (result.size() > capacity || (!name && !result.empty())) {
+            throw Status(DOLOS_BUFFER_TOO_SMALL, "Name buffer too small");
+        }
+        std::memcpy(name, result.data(), result.size());
+    });
+}
+
+dolos_status dolos_index_group_size(const dolos_index *index, const uint32_t group, uint32_t *size) {
+    return guarded([&] {
+        require(index && size, "argument is null");
+        require(group < index->groupCount(), "group out of range");
+        if (index->mapped) {
+            *size = index->mapped->groupSize(group);
+        } else {
+            const auto it = index->index->groups.find(group);
+            *size = it == index->index->groups.end() ? 0 : static_cast<uint32_t>(it->second.size());
+        }
+    });
+}
+
+void dolos_index_free(dolos_index *index) {
+    delete index;
+}
+
+dolos_status dolos_match_fingerprints(const dolos_index *index, const size_t n,
+                                      const dolos_fingerprints *const *inputs, uint32_t *covered, uint32_t *totals) {
+    return guarded([&] {
+        require(index, "index is null");
+        require(n == 0 || (inputs && covered && totals), "argument is null");
+        const size_t groups = index->groupCount();
+        for (size_t i = 0; i < n; i++) {
+            require(inputs[i], "fingerprints are null");
+            require(inputs[i]->k == index->k() && inputs[i]->w == index->w(), "fingerprints use a different k or w");
+            index->countShared(inputs[i]->hashes, std::span(covered + i * groups, groups));
+            totals[i] = static_cast<uint32_t>(inputs[i]->hashes.size());
+        }
+    });
+}
+
+dolos_status dolos_match_hashes(const dolos_index *index, const size_t n, const uint64_t *const *hashes,
+                                const size_t *counts, uint32_t *covered, uint32_t *totals) {
+    return guarded([&] {
+        require(index, "index is null");
+        require(n == 0 || (hashes && counts && covered && totals), "argument is null");
+        const size_t groups = index->groupCount();
+        for (size_t i = 0; i < n; i++) {
+            require(hashes[i] || counts[i] == 0, "hashes are null");
+            index->countShared(std::span(hashes[i], counts[i]), std::span(covered + i * groups, groups));
+            totals[i] = static_cast<uint32_t>(counts[i]);
+        }
+    });
+}
+}
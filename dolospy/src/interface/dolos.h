@@ -0,0 +1,104 @@
+#ifndef DOLOS_C_H
+#define DOLOS_C_H
+
+/*
+ * Stable C interface of doloslib for FFI consumers (ctypes, cffi, Rust, ...).
+ *
+ * No function throws or prints. Every call returns a dolos_status, details of the last failure of the calling
+ * thread are available through dolos_last_error(). Output arrays are provided by the caller; if one is too small,
+ * DOLOS_BUFFER_TOO_SMALL is returned and the required size is written to the count argument.
+ *
+ * The ABI is versioned by DOLOS_API_VERSION. Existing functions and enum values are never changed, new ones are
+ * only appended together with a version bump.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DOLOS_API_VERSION 1
+
+typedef enum dolos_status {
+    DOLOS_OK = 0,
+    DOLOS_INVALID_ARGUMENT = 1,
+    DOLOS_IO_ERROR = 2,
+    DOLOS_FORMAT_ERROR = 3,
+    DOLOS_BUFFER_TOO_SMALL = 4,
+    DOLOS_OUT_OF_MEMORY = 5,
+    DOLOS_INTERNAL_ERROR = 6,
+} dolos_status;
+
+/* Either an in-memory index (created empty or from a JSON index) or a mapped <pkg>.index.bin */
+typedef struct dolos_index dolos_index;
+
+/* Winnowed fingerprints of one source */
+typedef struct dolos_fingerprints dolos_fingerprints;
+
+uint32_t dolos_api_version(void);
+
+const char *dolos_status_string(dolos_status status);
+
+/* Message of the last failed call on this thread, valid until the next call on this thread */
+const char *dolos_last_error(void);
+
+/* Tokens */
+
+dolos_status dolos_tokenize(const char *source, size_t length, uint16_t *tokens, size_t capacity, size_t *count);
+
+/* Fingerprints */
+
+dolos_status dolos_fingerprints_create(const char *source, size_t length, uint16_t k, uint16_t w,
+                                       dolos_fingerprints **out);
+
+/* Fingerprints n sources in parallel, out must hold n handles. On failure no handle is returned. */
+dolos_status dolos_fingerprints_create_batch(size_t n, const char *const *sources, const size_t *lengths,
+                                             uint16_t k, uint16_t w, uint32_t threads, dolos_fingerprints **out);
+
+/* The hashes stay valid until the handle is freed */
+dolos_status dolos_fingerprints_get(const dolos_fingerprints *fingerprints, const uint64_t **hashes, size_t *count);
+
+void dolos_fingerprints_free(dolos_fingerprints *fingerprints);
+
+/* Indexes */
+
+dolos_status dolos_index_create(uint16_t k, uint16_t w, dolos_index **out);
+
+/* Paths ending in .bin are mapped, everything else is read as JSON index */
+dolos_status dolos_index_open(const char *path, dolos_index **out);
+
+/* Only for in-memory indexes */
+dolos_status dolos_index_add(dolos_index *index, const char *group, const char *source, size_t length);
+
+/* Writes JSON, or the binary format if binary is non-zero */
+dolos_status dolos_index_save(const dolos_index *index, const char *path, int binary);
+
+dolos_status dolos_index_info(const dolos_index *index, uint16_t *k, uint16_t *w, uint32_t *groups);
+
+/* Copies the name of a group without terminating zero, length receives the full length */
+dolos_status dolos_index_group_name(const dolos_index *index, uint32_t group, char *name, size_t capacity,
+                                    size_t *length);
+
+/* Number of fingerprints of a group */
+dolos_status dolos_index_group_size(const dolos_index *index, uint32_t group, uint32_t *size);
+
+void dolos_index_free(dolos_index *index);
+
+/*
+ * Matching. For n inputs, covered receives n rows of one shared hash count per group (row-major, n * groups
+ * entries) and totals the number of fingerprints of each input.
+ */
+
+dolos_status dolos_match_fingerprints(const dolos_index *index, size_t n, const dolos_fingerprints *const *inputs,
+                                      uint32_t *covered, uint32_t *totals);
+
+dolos_status dolos_match_hashes(const dolos_index *index, size_t n, const uint64_t *const *hashes,
+                                const size_t *counts, uint32_t *covered, uint32_t *totals);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //DOLOS_C_H
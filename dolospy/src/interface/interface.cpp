@@ -7,6 +7,8 @@
 
 #include "../index.h"
 
+const int magic = 42;
+
 std::vector<char> readFile(const std::string &name) {
     std::ifstream file(name);
     file.seekg(0, std::ios::end);
@@ -8,6 +8,6 @@ std::vector<char> readFile(const std::string &name);
 
 void compareFiles(const char *f1, const char *f2);
 
-int magic = 42;
+extern const int magic;
 
 #endif //INTERFACE_H
@@ -0,0 +1,404 @@
+#include <fstream>
+#include <memory>
+#include <span>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <node_api.h>
+
+#include "../banner.h"
+#include "../binary.h"
+#include "../classify.h"
+#include "../exact.h"
+#include "../hashing.h"
+#include "../index.h"
+#include "../tokenizer.h"
+
+// Node-API binding of the native matcher for identify.mjs. Input buffers are read in place and result arrays
+// take ownership of the native vectors instead of copying them.
+
+namespace {
+    struct NativeIndex {
+        std::unique_ptr<dolos::Index> index;
+        std::unique_ptr<dolos::MappedIndex> mapped;
+
+        uint16_t k() const { return mapped ? mapped->k() : index->k; }
+        uint16_t w() const { return mapped ? mapped->w() : index->w; }
+
+        std::vector<dolos::Pair> matchHashes(const std::span<const uint64_t> fingerprints) const {
+            return mapped ? mapped->matchHashes(fingerprints) : index->matchHashes(fingerprints);
+        }
+    };
+
+    struct Error : std::runtime_error {
+        using std::runtime_error::runtime_error;
+    };
+
+    // Thrown to JS as TypeError
+    struct TypeError : Error {
+        using Error::Error;
+    };
+
+    void check(const napi_status status, const char *what) {
+        if (status != napi_ok) {
+            throw Error(std::string("Node-API call failed: ") + what);
+        }
+    }
+
+    template<typename F>
+    napi_value guarded(const napi_env env, F &&fn) {
+        try {
+            return fn();
+        } catch (const std::exception &e) {
+            bool pending = false;
+            napi_is_exception_pending(env, &pending);
+            if (!pending && dynamic_cast<const TypeError *>(&e)) {
+                napi_throw_type_error(env, nullptr, e.what());
+            } else if (!pending) {
+                napi_throw_error(env, nullptr, e.what());
+            }
+            return nullptr;
+        }
+    }
+
+    std::vector<napi_value> arguments(const napi_env env, const napi_callback_info info, const size_t expected) {
+        size_t argc = expected;
+        std::vector<napi_value> argv(expected);
+        check(napi_get_cb_info(env, info, &argc, argv.data(), nullptr, nullptr), "napi_get_cb_info");
+        if (argc < expected) {
+            throw Error("Expected " + std::to_string(expected) + " arguments");
+        }
+        return argv;
+    }
+
+    uint32_t toUint32(const napi_env env, const napi_value value) {
+        uint32_t result;
+        check(napi_get_value_uint32(env, value, &result), "expected a number");
+        return result;
+    }
+
+    std::string toString(const napi_env env, const napi_value value) {
+        size_t length;
+        check(napi_get_value_string_utf8(env, value, nullptr, 0, &length), "expected a string");
+        std::string result(length, '\0');
+        check(napi_get_value_string_utf8(env, value, result.data(), length + 1, &length), "expected a string");
+        return result;
+    }
+
+    // Source code is accepted as string (copied once by V8) or as Buffer/Uint8Array (used in place)
+    template<typename F>
+    auto withSource(const napi_env env, const napi_value value, F &&fn) {
+        napi_valuetype type;
+        check(napi_typeof(env, value, &type), "napi_typeof");
+        if (type == napi_string) {
+            const auto source = toString(env, value);
+            return fn(std::span(source.data(), source.size()));
+        }
+
+        bool isTypedArray = false;
+        check(napi_is_typedarray(env, value, &isTypedArray), "napi_is_typedarray");
+        if (!isTypedArray) {
+            throw Error("Expected source code as string or Buffer");
+        }
+        napi_typedarray_type arrayType;
+        size_t length;
+        void *data;
+        check(napi_get_typedarray_info(env, value, &arrayType, &length, &data, nullptr, nullptr),
+              "napi_get_typedarray_info");
+        if (arrayType != napi_uint8_array) {
+            throw Error("Expected source code as string or Buffer");
+        }
+        return fn(std::span(static_cast<const char *>(data), length));
+    }
+
+    template<typename T>
+    std::span<const T> typedArray(const napi_env env, const napi_value value, const napi_typedarray_type expected,
+                                  const char *what) {
+        bool isTypedArray = false;
+        check(napi_is_typedarray(env, value, &isTypedArray), "napi_is_typedarray");
+        napi_typedarray_type type;
+        size_t length;
+        void *data;
+        if (!isTypedArray || napi_get_typedarray_info(env, value, &type, &length, &data, nullptr, nullptr) != napi_ok
+            || type != expected) {
+            throw Error(std::string("Expected ") + what);
+        }
+        return {static_cast<const T *>(data), length};
+    }
+
+    // Hands the vector over to an ArrayBuffer, it is freed by the garbage collector
+    template<typename T>
+    napi_value toTypedArray(const napi_env env, std::vector<T> values, const napi_typedarray_type type) {
+        auto *owned = new std::vector<T>(std::move(values));
+        napi_value buffer, array;
+        if (napi_create_external_arraybuffer(env, owned->data(), owned->size() * sizeof(T),
+                                             [](napi_env, void *, void *hint) {
+                                                 delete static_cast<std::vector<T> *>(hint);
+                                             }, owned, &buffer) != napi_ok) {
+            delete owned;
+            throw Error("napi_create_external_arraybuffer");
+        }
+        check(napi_create_typedarray(env, type, owned->size(), buffer, 0, &array), "napi_create_typedarray");
+        return array;
+    }
+
+    // Every handle is tagged with the type it points to, so a handle passed to the wrong function is rejected
+    // instead of being cast to the wrong type
+    constexpr napi_type_tag indexTag = {0x6f1c0a9d3b2e4857, 0xa4d1e8c27b9f3061};
+    constexpr napi_type_tag exactTag = {0x2d8e5b7a1c4f9063, 0xc3f60e1d8a5b2947};
+    constexpr napi_type_tag bannerTag = {0x91a7d3c05e6b2f48, 0x5b0e9f2a7c1d8436};
+
+    template<typename T>
+    napi_value wrapExternal(const napi_env env, std::unique_ptr<T> value, const napi_type_tag &tag) {
+        napi_value result;
+        check(napi_create_external(env, value.get(), [](napi_env, void *data, void *) {
+            delete static_cast<T *>(data);
+        }, nullptr, &result), "napi_create_external");
+        value.release();
+        check(napi_type_tag_object(env, result, &tag), "napi_type_tag_object");
+        return result;
+    }
+
+    template<typename T>
+    T &unwrapExternal(const napi_env env, const napi_value value, const napi_type_tag &tag, const char *what) {
+        bool matches = false;
+        void *data = nullptr;
+        if (napi_check_object_type_tag(env, value, &tag, &matches) != napi_ok || !matches
+            || napi_get_value_external(env, value, &data) != napi_ok || !data) {
+            throw TypeError(std::string("Expected ") + what);
+        }
+        return *static_cast<T *>(data);
+    }
+
+    NativeIndex &unwrapIndex(const napi_env env, const napi_value value) {
+        return unwrapExternal<NativeIndex>(env, value, indexTag, "an index returned by openIndex");
+    }
+
+    napi_value toPairs(const napi_env env, const std::vector<dolos::Pair> &pairs) {
+        napi_value result;
+        check(napi_create_array_with_length(env, pairs.size(), &result), "napi_create_array_with_length");
+        for (size_t i = 0; i < pairs.size(); i++) {
+            napi_value obj, name, covered, leftTotal, rightTotal;
+            check(napi_create_object(env, &obj), "napi_create_object");
+            check(napi_create_string_utf8(env, pairs[i].right.data(), pairs[i].right.size(), &name), "name");
+            check(napi_create_uint32(env, pairs[i].covered, &covered), "covered");
+            check(napi_create_uint32(env, pairs[i].leftTotal, &leftTotal), "leftTotal");
+            check(napi_create_uint32(env, pairs[i].rightTotal, &rightTotal), "rightTotal");
+            check(napi_set_named_property(env, obj, "name", name), "name");
+            check(napi_set_named_property(env, obj, "covered", covered), "covered");
+            check(napi_set_named_property(env, obj, "leftTotal", leftTotal), "leftTotal");
+            check(napi_set_named_property(env, obj, "rightTotal", rightTotal), "rightTotal");
+            check(napi_set_element(env, result, i, obj), "napi_set_element");
+        }
+        return result;
+    }
+
+    // tokenize(source: string | Buffer): Uint16Array
+    napi_value tokenize(const napi_env env, const napi_callback_info info) {
+        return guarded(env, [&] {
+            const auto argv = arguments(env, info, 1);
+            auto tokens = withSource(env, argv[0], [](const std::span<const char> source) {
+                return dolos::tokenize(source);
+            });
+            return toTypedArray(env, std::move(tokens), napi_uint16_array);
+        });
+    }
+
+    // fingerprint(tokens: Uint16Array, k: number, w: number): BigUint64Array
+    napi_value fingerprint(const napi_env env, const napi_callback_info info) {
+        return guarded(env, [&] {
+            const auto argv = arguments(env, info, 3);
+            const auto tokens = typedArray<uint16_t>(env, argv[0], napi_uint16_array, "tokens as Uint16Array");
+            auto hashes = dolos::fingerprint(tokens, toUint32(env, argv[1]), toUint32(env, argv[2]));
+            return toTypedArray(env, std::move(hashes), napi_biguint64_array);
+        });
+    }
+
+    // openIndex(path: string): index handle. <pkg>.index.bin is mapped, anything else is parsed as JSON index.
+    napi_value openIndex(const napi_env env, const napi_callback_info info) {
+        return guarded(env, [&] {
+            const auto argv = arguments(env, info, 1);
+            const auto path = toString(env, argv[0]);
+
+            auto native = std::make_unique<NativeIndex>();
+            if (path.ends_with(".bin")) {
+                native->mapped = std::make_unique<dolos::MappedIndex>(path);
+            } else {
+                std::ifstream file(path, std::ios::binary);
+                if (!file.is_open()) {
+                    throw Error("Failed to open index file " + path);
+                }
+                std::ostringstream content;
+                content << file.rdbuf();
+                native->index = std::make_unique<dolos::Index>(std::move(content).str());
+            }
+
+            return wrapExternal(env, std::move(native), indexTag);
+        });
+    }
+
+    // match(index, tokens: Uint16Array | string | Buffer): {name, covered, leftTotal, rightTotal}[]
+    napi_value match(const napi_env env, const napi_callback_info info) {
+        return guarded(env, [&] {
+            const auto argv = arguments(env, info, 2);
+            const auto &index = unwrapIndex(env, argv[0]);
+
+            bool isTypedArray = false;
+            napi_typedarray_type type = napi_uint8_array;
+            check(napi_is_typedarray(env, argv[1], &isTypedArray), "napi_is_typedarray");
+            if (isTypedArray) {
+                check(napi_get_typedarray_info(env, argv[1], &type, nullptr, nullptr, nullptr, nullptr),
+                      "napi_get_typedarray_info");
+            }
+
+            std::vector<uint64_t> hashes;
+            if (isTypedArray && type == napi_uint16_array) {
+                const auto tokens = typedArray<uint16_t>(env, argv[1], napi_uint16_array, "tokens");
+                hashes = dolos::fingerprint(tokens, index.k(), index.w());
+            } else {
+                const auto tokens = withSource(env, argv[1], [](const std::span<const char> source) {
+                    return dolos::tokenize(source);
+                });
+                hashes = dolos::fingerprint(tokens, index.k(), index.w());
+            }
+            return toPairs(env, index.matchHashes(hashes));
+        });
+    }
+
+    // matchHashes(index, hashes: BigUint64Array): {name, covered, leftTotal, rightTotal}[]
+    napi_value matchHashes(const napi_env env, const napi_callback_info info) {
+        return guarded(env, [&] {
+            const auto argv = arguments(env, info, 2);
+            const auto &index = unwrapIndex(env, argv[0]);
+            const auto hashes = typedArray<uint64_t>(env, argv[1], napi_biguint64_array, "hashes as BigUint64Array");
+            return toPairs(env, index.matchHashes(hashes));
+        });
+    }
+
+    // openExact(path: string): exact hash table handle
+    napi_value openExact(const napi_env env, const napi_callback_info info) {
+        return guarded(env, [&] {
+            const auto argv = arguments(env, info, 1);
+            return wrapExternal(env, std::make_unique<dolos::ExactIndex>(toString(env, argv[0])), exactTag);
+        });
+    }
+
+    // lookupExact(table, source: string | Buffer): {versions: string[], normalized: boolean} | null
+    napi_value lookupExact(const napi_env env, const napi_callback_info info) {
+        return guarded(env, [&] {
+            const auto argv = arguments(env, info, 2);
+            const auto &table = unwrapExternal<const dolos::ExactIndex>(env, argv[0], exactTag,
+                                                                        "a table returned by openExact");
+            const auto match = withSource(env, argv[1], [&](const std::span<const char> source) {
+                return table.lookup(source);
+            });
+
+            napi_value result;
+            if (!match) {
+                check(napi_get_null(env, &result), "napi_get_null");
+                return result;
+            }
+            napi_value versions, normalized;
+            check(napi_create_array_with_length(env, match->versions.size(), &versions),
+                  "napi_create_array_with_length");
+            for (size_t i = 0; i < match->versions.size(); i++) {
+                napi_value version;
+                check(napi_create_string_utf8(env, match->versions[i].data(), match->versions[i].size(), &version),
+                      "version");
+                check(napi_set_element(env, versions, i, version), "napi_set_element");
+            }
+            check(napi_get_boolean(env, match->normalized, &normalized), "normalized");
+            check(napi_create_object(env, &result), "napi_create_object");
+            check(napi_set_named_property(env, result, "versions", versions), "versions");
+            check(napi_set_named_property(env, result, "normalized", normalized), "normalized");
+            return result;
+        });
+    }
+
+    // openBanners(packages: string[]): banner scanner handle
+    napi_value openBanners(const napi_env env, const napi_callback_info info) {
+        return guarded(env, [&] {
+            const auto argv = arguments(env, info, 1);
+            uint32_t length = 0;
+            check(napi_get_array_length(env, argv[0], &length), "expected an array of package names");
+            std::vector<std::string> packages;
+            packages.reserve(length);
+            for (uint32_t i = 0; i < length; i++) {
+                napi_value element;
+                check(napi_get_element(env, argv[0], i, &element), "napi_get_element");
+                packages.emplace_back(toString(env, element));
+            }
+
+            return wrapExternal(env, std::make_unique<dolos::BannerScanner>(std::move(packages)), bannerTag);
+        });
+    }
+
+    // scanBanners(scanner, source: string | Buffer): {name, version, offset}[]
+    napi_value scanBanners(const napi_env env, const napi_callback_info info) {
+        return guarded(env, [&] {
+            const auto argv = arguments(env, info, 2);
+            const auto &scanner = unwrapExternal<const dolos::BannerScanner>(env, argv[0], bannerTag,
+                                                                             "a scanner returned by openBanners");
+            return withSource(env, argv[1], [&](const std::span<const char> source) {
+                const auto hits = scanner.scan(source);
+                napi_value result;
+                check(napi_create_array_with_length(env, hits.size(), &result), "napi_create_array_with_length");
+                for (size_t i = 0; i < hits.size(); i++) {
+                    const auto &name = scanner.package(hits[i].package);
+                    napi_value hit, nameValue, version, offset;
+                    check(napi_create_object(env, &hit), "napi_create_object");
+                    check(napi_create_string_utf8(env, name.data(), name.size(), &nameValue), "name");
+                    check(napi_create_string_utf8(env, hits[i].version.data(), hits[i].version.size(), &version),
+                          "version");
+                    check(napi_create_double(env, static_cast<double>(hits[i].offset), &offset), "offset");
+                    check(napi_set_named_property(env, hit, "name", nameValue), "name");
+                    check(napi_set_named_property(env, hit, "version", version), "version");
+                    check(napi_set_named_property(env, hit, "offset", offset), "offset");
+                    check(napi_set_element(env, result, i, hit), "napi_set_element");
+                }
+                return result;
+            });
+        });
+    }
+
+    // classifyInput(source: string | Buffer, minLength?: number): "script" | "empty" | "too_short" | "json" | ...
+    napi_value classifyInput(const napi_env env, const napi_callback_info info) {
+        return guarded(env, [&] {
+            size_t argc = 2;
+            napi_value argv[2];
+            check(napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr), "napi_get_cb_info");
+            if (argc < 1) {
+                throw Error("Expected 1 argument");
+            }
+            const size_t minLength = argc >= 2 ? toUint32(env, argv[1]) : 32;
+            return withSource(env, argv[0], [&](const std::span<const char> source) {
+                const auto name = dolos::inputClassName(dolos::classifyInput(source, minLength));
+                napi_value result;
+                check(napi_create_string_utf8(env, name.data(), name.size(), &result), "napi_create_string_utf8");
+                return result;
+            });
+        });
+    }
+
+    napi_value init(const napi_env env, const napi_value exports) {
+        const napi_property_descriptor properties[] = {
+            {"tokenize", nullptr, tokenize, nullptr, nullptr, nullptr, napi_enumerable, nullptr},
+            {"fingerprint", nullptr, fingerprint, nullptr, nullptr, nullptr, napi_enumerable, nullptr},
+            {"openIndex", nullptr, openIndex, nullptr, nullptr, nullptr, napi_enumerable, nullptr},
+            {"match", nullptr, match, nullptr, nullptr, nullptr, napi_enumerable, nullptr},
+            {"matchHashes", nullptr, matchHashes, nullptr, nullptr, nullptr, napi_enumerable, nullptr},
+            {"openExact", nullptr, openExact, nullptr, nullptr, nullptr, napi_enumerable, nullptr},
+            {"lookupExact", nullptr, lookupExact, nullptr, nullptr, nullptr, napi_enumerable, nullptr},
+            {"openBanners", nullptr, openBanners, nullptr, nullptr, nullptr, napi_enumerable, nullptr},
+            {"scanBanners", nullptr, scanBanners, nullptr, nullptr, nullptr, napi_enumerable, nullptr},
+            {"classifyInput", nullptr, classifyInput, nullptr, nullptr, nullptr, napi_enumerable, nullptr},
+        };
+        if (napi_define_properties(env, exports, std::size(properties), properties) != napi_ok) {
+            return nullptr;
+        }
+        return exports;
+    }
+}
+
+NAPI_MODULE(NODE_GYP_MODULE_NAME, init)
@@ -1,13 +1,30 @@
 #include "interface.h"
 
+#include <fstream>
 #include <sstream>
 #include <iostream>
 
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
 
+#include "../advisory.h"
+#include "../banner.h"
+#include "../batchio.h"
+#include "../classify.h"
+#include "../cluster.h"
+#include "../crawl.h"
+#include "../binary.h"
+#include "../exact.h"
+#include "../external.h"
+#include "../hashing.h"
 #include "../index.h"
+#include "../numa.h"
+#include "../registry.h"
+#include "../shard.h"
+#include "../store.h"
 #include "../tokenizer.h"
+#include "../trace.h"
+#include "../zpack.h"
 
 namespace py = pybind11;
 
@@ -19,6 +36,46 @@ PYBIND11_MODULE(dolospy, m) {
     m.def("tokenize", [](const std::string &code) {
         return dolos::tokenize(std::span(code.data(), code.size()));
     }, "Tokenize source code", py::arg("code"));
+    m.def("readFiles", [](const std::vector<std::string> &paths, const bool useIoUring) {
+        std::vector<dolos::ReadResult> results;
+        {
+            py::gil_scoped_release release;
+            dolos::BatchReader reader(64, useIoUring);
+            results = reader.readAll({paths.begin(), paths.end()});
+        }
+        py::list contents;
+        for (const auto &result: results) {
+            contents.append(result.error == 0 ? py::object(py::bytes(result.data)) : py::object(py::none()));
+        }
+        return contents;
+    }, "Read many files in one batch, None for files that could not be read", py::arg("paths"),
+          py::arg("useIoUring") = true);
+
+    m.def("startTracing", &dolos::startTracing, "Record native pipeline events of all threads, dropping earlier ones",
+          py::arg("eventsPerThread") = 1 << 16);
+    m.def("stopTracing", &dolos::stopTracing, "Stop recording native pipeline events");
+    m.def("writeTrace", [](const std::string &path) {
+        std::ofstream file(path);
+        dolos::writeTrace(file);
+        if (!file) {
+            throw std::runtime_error("Failed to write trace file " + path);
+        }
+    }, "Write the recorded events as Chrome trace JSON, loadable in Perfetto", py::arg("path"));
+
+    py::class_<dolos::MemoryUsage>(m, "MemoryUsage")
+            .def_readonly("postings", &dolos::MemoryUsage::postings)
+            .def_readonly("groupSets", &dolos::MemoryUsage::groupSets)
+            .def_readonly("tableNodes", &dolos::MemoryUsage::tableNodes)
+            .def_readonly("buckets", &dolos::MemoryUsage::buckets)
+            .def_readonly("names", &dolos::MemoryUsage::names)
+            .def_property_readonly("total", &dolos::MemoryUsage::total)
+            .def("__repr__", [](const dolos::MemoryUsage &self) {
+                std::ostringstream os;
+                os << "<dolospy.MemoryUsage postings=" << self.postings << " groupSets=" << self.groupSets
+                        << " tableNodes=" << self.tableNodes << " buckets=" << self.buckets << " names=" << self.names
+                        << " total=" << self.total() << ">";
+                return os.str();
+            });
 
     py::class_<dolos::Index>(m, "Index")
             .def(py::init<uint16_t, uint16_t>())
@@ -36,11 +93,334 @@ PYBIND11_MODULE(dolospy, m) {
             })
             .def("getPair", &dolos::Index::getPair)
             .def("serialize", &dolos::Index::serialize)
+            .def("memoryUsage", &dolos::Index::memoryUsage, "Estimated heap usage in bytes per component")
+            .def("serializeBinary", [](const dolos::Index &self, const uint32_t sketchSize, const bool compress) {
+                return py::bytes(dolos::serializeBinary(self, sketchSize, compress));
+            }, py::arg("sketchSize") = 64, py::arg("compressPostings") = true)
             .def_readonly("identifiers", &dolos::Index::identifiers)
             .def_readonly("names", &dolos::Index::names)
             .def_readonly("index", &dolos::Index::index)
             .def_readonly("group", &dolos::Index::groups);
 
+    py::class_<dolos::ExternalBuildStats>(m, "ExternalBuildStats")
+            .def_readonly("pairs", &dolos::ExternalBuildStats::pairs)
+            .def_readonly("runs", &dolos::ExternalBuildStats::runs)
+            .def_readonly("runBytes", &dolos::ExternalBuildStats::runBytes)
+            .def_readonly("hashes", &dolos::ExternalBuildStats::hashes);
+
+    py::class_<dolos::ExternalIndexBuilder>(m, "ExternalIndexBuilder")
+            .def(py::init([](const uint16_t k, const uint16_t w, const std::string &temporaryDirectory,
+                             const size_t memoryBudget, const unsigned threads, const uint32_t sketchSize,
+                             const bool compressPostings) {
+                const dolos::ExternalBuildOptions options{
+                    .temporaryDirectory = temporaryDirectory,
+                    .memoryBudget = memoryBudget,
+                    .threads = threads,
+                    .sketchSize = sketchSize,
+                    .compressPostings = compressPostings,
+                };
+                return std::make_unique<dolos::ExternalIndexBuilder>(k, w, options);
+            }), py::arg("k"), py::arg("w"), py::arg("temporaryDirectory") = "",
+                 py::arg("memoryBudget") = size_t{256} << 20, py::arg("threads") = 0, py::arg("sketchSize") = 64,
+                 py::arg("compressPostings") = true)
+            .def("addGroup", &dolos::ExternalIndexBuilder::addGroup, py::arg("name"))
+            .def("add", [](dolos::ExternalIndexBuilder &self, const uint16_t group, const std::string &code) {
+                py::gil_scoped_release release;
+                self.add(group, std::span(code.data(), code.size()));
+            }, "Fingerprints one file of the group, may be called from several threads", py::arg("group"),
+                 py::arg("code"))
+            .def("finish", [](dolos::ExternalIndexBuilder &self, const std::string &output) {
+                py::gil_scoped_release release;
+                self.finish(output);
+            }, "Merges the sorted runs into a binary index at output", py::arg("output"))
+            .def("stats", &dolos::ExternalIndexBuilder::stats);
+
+    py::class_<dolos::MadvisePolicy>(m, "MadvisePolicy")
+            .def(py::init([](const std::string &hashes, const std::string &postings, const std::string &metadata,
+                             const bool hugePages, const bool willNeed) {
+                     return dolos::MadvisePolicy{
+                         .hashes = dolos::parseAdvice(hashes),
+                         .postings = dolos::parseAdvice(postings),
+                         .metadata = dolos::parseAdvice(metadata),
+                         .hugePages = hugePages,
+                         .willNeed = willNeed,
+                     };
+                 }), py::arg("hashes") = "random", py::arg("postings") = "random", py::arg("metadata") = "normal",
+                 py::arg("hugePages") = false, py::arg("willNeed") = false)
+            .def_readwrite("hugePages", &dolos::MadvisePolicy::hugePages)
+            .def_readwrite("willNeed", &dolos::MadvisePolicy::willNeed);
+
+    py::class_<dolos::MappedIndex>(m, "MappedIndex")
+            .def(py::init<std::string, dolos::MadvisePolicy>(), py::arg("path"),
+                 py::arg("policy") = dolos::MadvisePolicy{})
+            .def("advise", &dolos::MappedIndex::advise)
+            .def("matchExternal", [](const dolos::MappedIndex &self, const std::string &code) {
+                py::gil_scoped_release release;
+                return self.matchExternal(std::span(code.data(), code.size()));
+            })
+            .def("matchTokens", &dolos::MappedIndex::matchTokens, py::call_guard<py::gil_scoped_release>())
+            .def("matchPruned", [](const dolos::MappedIndex &self, const dolos::TokenizedFile &tokens,
+                                   const double beam, const uint32_t leafGroups) {
+                py::gil_scoped_release release;
+                const auto fingerprints = dolos::fingerprint(tokens, self.k(), self.w());
+                return self.matchPruned(fingerprints, {.beam = beam, .leafGroups = leafGroups});
+            }, py::arg("tokens"), py::arg("beam") = 0.5, py::arg("leafGroups") = 8)
+            .def_property_readonly("hasHierarchy", &dolos::MappedIndex::hasHierarchy)
+            .def_property_readonly("compressedPostings", &dolos::MappedIndex::compressedPostings)
+            .def_property_readonly("k", &dolos::MappedIndex::k)
+            .def_property_readonly("w", &dolos::MappedIndex::w)
+            .def_property_readonly("groupCount", &dolos::MappedIndex::groupCount)
+            .def_property_readonly("hashCount", &dolos::MappedIndex::hashCount);
+
+    py::class_<dolos::ShardedIndex>(m, "ShardedIndex")
+            .def(py::init([](const std::vector<std::string> &addresses) {
+                py::gil_scoped_release release;
+                return std::make_unique<dolos::ShardedIndex>(addresses);
+            }), "Coordinator over the servers of all shards of an index, socket paths or host:port",
+                 py::arg("addresses"))
+            .def("matchExternal", [](dolos::ShardedIndex &self, const std::string &code) {
+                py::gil_scoped_release release;
+                return self.matchExternal(std::span(code.data(), code.size()));
+            })
+            .def("matchTokens", &dolos::ShardedIndex::matchTokens, py::call_guard<py::gil_scoped_release>())
+            .def_property_readonly("k", &dolos::ShardedIndex::k)
+            .def_property_readonly("w", &dolos::ShardedIndex::w)
+            .def_property_readonly("groupCount", &dolos::ShardedIndex::groupCount)
+            .def_property_readonly("hashCount", &dolos::ShardedIndex::hashCount)
+            .def_property_readonly("shardCount", &dolos::ShardedIndex::shardCount);
+
+    m.def("splitBinary", [](const std::string &path, const size_t count, const std::string &prefix) {
+        py::gil_scoped_release release;
+        const dolos::MappedIndex index(path);
+        std::vector<std::string> paths;
+        for (const auto &shard: dolos::splitBinary(index, count, prefix)) {
+            paths.emplace_back(shard.string());
+        }
+        return paths;
+    }, "Splits a binary index into hash range shards <prefix>.shard<i>.bin, returns their paths", py::arg("path"),
+          py::arg("count"), py::arg("prefix"));
+
+    py::class_<dolos::ExactIndex>(m, "ExactIndex")
+            .def(py::init<std::string>(), py::arg("path"))
+            .def("lookup", [](const dolos::ExactIndex &self, const std::string &code) -> py::object {
+                const auto match = self.lookup(std::span(code.data(), code.size()));
+                if (!match) {
+                    return py::none();
+                }
+                std::vector<std::string> versions(match->versions.begin(), match->versions.end());
+                return py::make_tuple(versions, match->normalized);
+            }, "pkg@version of all releases containing the file and whether only the whitespace normalized content "
+               "matched, or None", py::arg("code"))
+            .def("__len__", &dolos::ExactIndex::size);
+
+    py::class_<dolos::BannerScanner>(m, "BannerScanner")
+            .def(py::init<std::vector<std::string>, size_t>(), py::arg("packages"), py::arg("minLength") = 3)
+            .def("scan", [](const dolos::BannerScanner &self, const std::string &code) {
+                std::vector<std::tuple<std::string, std::string, uint64_t>> result;
+                for (const auto &hit: self.scan(std::span(code.data(), code.size()))) {
+                    result.emplace_back(self.package(hit.package), hit.version, hit.offset);
+                }
+                return result;
+            }, "(package, version, byte offset) of every package name followed by a version", py::arg("code"))
+            .def("__len__", &dolos::BannerScanner::size);
+
+    py::class_<dolos::AdvisoryIndex>(m, "AdvisoryIndex")
+            .def(py::init<>())
+            .def("add", &dolos::AdvisoryIndex::add, "Adds an advisory affecting the versions matched by all ranges, "
+                 "returns its number", py::arg("package"), py::arg("id"), py::arg("level"), py::arg("ranges"))
+            .def("match", [](const dolos::AdvisoryIndex &self, const std::string &package, const std::string &version) {
+                const auto advisories = self.match(package, version);
+                return std::vector<uint32_t>(advisories.begin(), advisories.end());
+            }, py::arg("package"), py::arg("version"))
+            .def("matchBatch", [](const dolos::AdvisoryIndex &self, std::vector<std::string> packages,
+                                  std::vector<std::string> versions, const unsigned threads) {
+                py::gil_scoped_release release;
+                return self.matchBatch(packages, versions, threads);
+            }, "(query, advisory) of all matches, ordered by query", py::arg("packages"), py::arg("versions"),
+                 py::arg("threads") = 0)
+            .def("package", &dolos::AdvisoryIndex::package)
+            .def("id", &dolos::AdvisoryIndex::id)
+            .def("level", &dolos::AdvisoryIndex::level)
+            .def("__len__", &dolos::AdvisoryIndex::size);
+
+    py::class_<dolos::PackWriterStats>(m, "PackWriterStats")
+            .def_readonly("hits", &dolos::PackWriterStats::hits)
+            .def_readonly("misses", &dolos::PackWriterStats::misses)
+            .def_readonly("bytesIn", &dolos::PackWriterStats::bytesIn)
+            .def_readonly("bytesOut", &dolos::PackWriterStats::bytesOut);
+
+    py::class_<dolos::PackWriter>(m, "PackWriter")
+            .def(py::init([](const std::string &directory, const uint64_t packSize, const unsigned threads,
+                             const uint32_t preset, const bool seedLoose) {
+                const dolos::PackWriterOptions options{.packSize = packSize, .threads = threads, .preset = preset};
+                return std::make_unique<dolos::PackWriter>(directory, options, seedLoose);
+            }), py::arg("directory"), py::arg("packSize") = uint64_t{1} << 30, py::arg("threads") = 0,
+                 py::arg("preset") = 6, py::arg("seedLoose") = false)
+            .def("put", [](dolos::PackWriter &self, std::string key, std::string data) {
+                py::gil_scoped_release release;
+                return self.put(std::move(key), std::move(data));
+            }, "Queues the object for compression, False if the key is already stored", py::arg("key"),
+                 py::arg("data"))
+            .def("putCompressed", [](dolos::PackWriter &self, std::string key, std::string compressed) {
+                py::gil_scoped_release release;
+                return self.putCompressed(std::move(key), std::move(compressed));
+            }, py::arg("key"), py::arg("compressed"))
+            .def("flush", &dolos::PackWriter::flush, py::call_guard<py::gil_scoped_release>())
+            .def("stats", &dolos::PackWriter::stats)
+            .def("__contains__", &dolos::PackWriter::contains);
+
+    py::class_<dolos::PackReader>(m, "PackReader")
+            .def(py::init([](const std::string &directory, const std::string &advice) {
+                return std::make_unique<dolos::PackReader>(directory, dolos::parseAdvice(advice));
+            }), py::arg("directory"), py::arg("advice") = "random")
+            .def("get", [](const dolos::PackReader &self, const std::string &key) -> py::object {
+                if (!self.contains(key)) {
+                    return py::none();
+                }
+                std::string data;
+                {
+                    py::gil_scoped_release release;
+                    data = dolos::xzDecompress(self.compressed(key));
+                }
+                return py::bytes(data);
+            }, "Decompressed content of the object, or None", py::arg("key"))
+            .def("compressed", [](const dolos::PackReader &self, const std::string &key) -> py::object {
+                if (!self.contains(key)) {
+                    return py::none();
+                }
+                const auto data = self.compressed(key);
+                return py::bytes(data.data(), data.size());
+            }, "The object as stored, the same bytes as its loose file", py::arg("key"))
+            .def("keys", &dolos::PackReader::keys)
+            .def("__contains__", &dolos::PackReader::contains)
+            .def("__len__", &dolos::PackReader::size);
+
+    py::class_<dolos::ZstdPack>(m, "ZstdPack")
+            .def(py::init([](const std::string &path, const std::string &advice) {
+                return std::make_unique<dolos::ZstdPack>(path, dolos::parseAdvice(advice));
+            }), py::arg("path"), py::arg("advice") = "random")
+            .def("get", [](const dolos::ZstdPack &self, const std::string &key) -> py::object {
+                std::optional<std::string> data;
+                {
+                    py::gil_scoped_release release;
+                    data = self.get(key);
+                }
+                return data ? py::object(py::bytes(*data)) : py::none();
+            }, "Decompressed content of the object, or None", py::arg("key"))
+            .def("keys", &dolos::ZstdPack::keys)
+            .def("__contains__", &dolos::ZstdPack::contains)
+            .def("__len__", &dolos::ZstdPack::size);
+
+    m.def("buildJobList", [](const std::vector<std::string> &files, const bool requiresSourceMap,
+                             const std::optional<std::vector<std::string>> &excludedUrls, const unsigned threads) {
+        dolos::CrawlFilter filter{.excludedUrls = excludedUrls.value_or(dolos::defaultCdnHosts()),
+                                  .requiresSourceMap = requiresSourceMap};
+        const std::vector<std::filesystem::path> paths(files.begin(), files.end());
+        py::gil_scoped_release release;
+        return dolos::buildJobList(paths, filter, threads).jobs;
+    }, "Deduplicated \"source:sourceMap\" jobs of the js responses in crawl files, CDN URLs excluded by default",
+          py::arg("files"), py::arg("requiresSourceMap") = false, py::arg("excludedUrls") = py::none(),
+          py::arg("threads") = 0);
+
+    m.def("classifyInput", [](const std::string &code, const size_t minLength) {
+        return std::string(dolos::inputClassName(dolos::classifyInput(std::span(code.data(), code.size()), minLength)));
+    }, "\"script\", or why the input can never match: \"empty\", \"too_short\", \"json\", \"html\" or \"binary\"",
+          py::arg("code"), py::arg("minLength") = 32);
+
+    m.def("clusterObjects", [](const std::string &store, const std::vector<std::string> &keys, const double threshold,
+                               const unsigned threads, const std::vector<std::string> &partitions) {
+        const dolos::ClusterOptions options{.threshold = threshold, .threads = threads};
+        py::gil_scoped_release release;
+        const auto clustering = dolos::clusterObjects(store, keys, options, partitions);
+        std::vector<std::pair<uint32_t, float>> result;
+        result.reserve(keys.size());
+        for (size_t i = 0; i < keys.size(); i++) {
+            result.emplace_back(clustering.representatives[i], clustering.similarities[i]);
+        }
+        return result;
+    }, "(representative, estimated similarity) per key, grouping near-duplicate scripts of a .zpack or store "
+       "directory, only within equal partitions if given", py::arg("store"), py::arg("keys"),
+          py::arg("threshold") = 0.9, py::arg("threads") = 0, py::arg("partitions") = std::vector<std::string>{});
+
+    m.def("parseVersionRange", [](const std::string &range) {
+        // (lower, upper) per interval as (version, side) with side -1 just before, 1 just after, None for no bound
+        std::vector<std::pair<py::object, py::object>> result;
+        const auto bound = [](const dolos::VersionBound &value) -> py::object {
+            if (value.infinity != 0) {
+                return py::none();
+            }
+            auto version = std::to_string(value.version.major) + "." + std::to_string(value.version.minor) + "."
+                           + std::to_string(value.version.patch);
+            if (!value.version.prerelease.empty()) {
+                version += "-" + value.version.prerelease;
+            }
+            return py::make_tuple(version, value.side);
+        };
+        for (const auto &interval: dolos::parseVersionRange(range)) {
+            result.emplace_back(bound(interval.lower), bound(interval.upper));
+        }
+        return result;
+    }, py::arg("range"));
+
+    py::class_<dolos::IndexRegistry>(m, "IndexRegistry")
+            .def(py::init<std::string, dolos::MadvisePolicy, std::vector<std::string>>(), py::arg("directory"),
+                 py::arg("policy") = dolos::MadvisePolicy{}, py::arg("hotPackages") = std::vector<std::string>{},
+                 py::call_guard<py::gil_scoped_release>())
+            .def("reload", &dolos::IndexRegistry::reload, py::call_guard<py::gil_scoped_release>())
+            .def("reloadAsync", &dolos::IndexRegistry::reloadAsync)
+            .def("isReloading", &dolos::IndexRegistry::isReloading)
+            .def("packages", &dolos::IndexRegistry::packages)
+            .def_property_readonly("generation", &dolos::IndexRegistry::generation)
+            .def("matchExternal", [](dolos::IndexRegistry &self, const std::string &pkg, const std::string &code) {
+                py::gil_scoped_release release;
+                return self.matchExternal(pkg, std::span(code.data(), code.size()));
+            })
+            .def("matchTokens", &dolos::IndexRegistry::matchTokens, py::call_guard<py::gil_scoped_release>());
+
+    py::class_<dolos::NodeStats>(m, "NodeStats")
+            .def_readonly("node", &dolos::NodeStats::node)
+            .def_readonly("jobs", &dolos::NodeStats::jobs)
+            .def_readonly("localHits", &dolos::NodeStats::localHits)
+            .def_readonly("sharedHits", &dolos::NodeStats::sharedHits)
+            .def_readonly("misses", &dolos::NodeStats::misses)
+            .def_property_readonly("localHitRate", &dolos::NodeStats::localHitRate)
+            .def("__repr__", [](const dolos::NodeStats &self) {
+                std::ostringstream os;
+                os << "<dolospy.NodeStats node=" << self.node << " jobs=" << self.jobs << " localHits=" << self.
+                        localHits << " sharedHits=" << self.sharedHits << " misses=" << self.misses << ">";
+                return os.str();
+            });
+
+    py::class_<dolos::NumaMatcher>(m, "NumaMatcher")
+            .def(py::init([](const std::string &directory, const std::string &topology, const std::string &placement,
+                             const std::vector<std::string> &hotPackages, const uint32_t workersPerNode) {
+                     py::gil_scoped_release release;
+                     return std::make_unique<dolos::NumaMatcher>(directory, dolos::NumaConfig{
+                                                                     .topology = topology,
+                                                                     .placement = dolos::parsePlacement(placement),
+                                                                     .hotPackages = hotPackages,
+                                                                     .workersPerNode = workersPerNode,
+                                                                 });
+                 }), py::arg("directory"), py::arg("topology") = "", py::arg("placement") = "shared",
+                 py::arg("hotPackages") = std::vector<std::string>{}, py::arg("workersPerNode") = 0)
+            .def("reload", &dolos::NumaMatcher::reload, py::call_guard<py::gil_scoped_release>())
+            .def("replicate", &dolos::NumaMatcher::replicate, py::call_guard<py::gil_scoped_release>())
+            .def("match", [](dolos::NumaMatcher &self, std::string pkg, std::string code,
+                             const std::optional<uint32_t> node) {
+                py::gil_scoped_release release;
+                return self.submit(std::move(pkg), std::move(code), node).get();
+            }, py::arg("pkg"), py::arg("code"), py::arg("node") = py::none())
+            .def("matchMany", &dolos::NumaMatcher::matchMany, py::call_guard<py::gil_scoped_release>())
+            .def("nodes", [](const dolos::NumaMatcher &self) {
+                std::vector<std::vector<uint32_t>> cpus;
+                for (const auto &node: self.getTopology().nodes) {
+                    cpus.emplace_back(node.cpus);
+                }
+                return cpus;
+            })
+            .def("stats", &dolos::NumaMatcher::stats)
+            .def("resetStats", &dolos::NumaMatcher::resetStats);
+
     py::class_<dolos::Pair>(m, "Pair")
             .def_readonly("left", &dolos::Pair::left)
             .def_readonly("right", &dolos::Pair::right)
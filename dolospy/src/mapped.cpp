@@ -0,0 +1,117 @@
+#include "mapped.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace dolos {
+    Advice parseAdvice(const std::string_view name) {
+        if (name == "normal") return Advice::Normal;
+        if (name == "random") return Advice::Random;
+        if (name == "sequential") return Advice::Sequential;
+        if (name == "willneed") return Advice::WillNeed;
+        throw std::invalid_argument("Unknown madvise policy '" + std::string(name) + "'");
+    }
+
+    MappedFile::MappedFile(const std::filesystem::path &path) {
+        const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            throw std::runtime_error("Failed to open " + path.string() + ": " + std::strerror(errno));
+        }
+
+        struct stat st{};
+        if (fstat(fd, &st) != 0) {
+            close(fd);
+            throw std::runtime_error("Failed to stat " + path.string() + ": " + std::strerror(errno));
+        }
+
+        length = static_cast<size_t>(st.st_size);
+        if (length > 0) {
+            void *addr = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+            if (addr == MAP_FAILED) {
+                close(fd);
+                throw std::runtime_error("Failed to map " + path.string() + ": " + std::strerror(errno));
+            }
+            begin = static_cast<const char *>(addr);
+        }
+        close(fd);
+    }
+
+    MappedFile MappedFile::copy(const std::span<const char> data) {
+        MappedFile result;
+        result.length = data.size();
+        if (result.length == 0) {
+            return result;
+        }
+
+        void *addr = mmap(nullptr, result.length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (addr == MAP_FAILED) {
+            throw std::runtime_error(std::string("Failed to allocate a copy: ") + std::strerror(errno));
+        }
+        result.begin = static_cast<const char *>(addr);
+        std::memcpy(addr, data.data(), result.length);
+        mprotect(addr, result.length, PROT_READ);
+        return result;
+    }
+
+    MappedFile::MappedFile(MappedFile &&other) noexcept : begin(std::exchange(other.begin, nullptr)),
+                                                          length(std::exchange(other.length, 0)) {
+    }
+
+    MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+        if (this != &other) {
+            if (begin) {
+                munmap(const_cast<char *>(begin), length);
+            }
+            begin = std::exchange(other.begin, nullptr);
+            length = std::exchange(other.length, 0);
+        }
+        return *this;
+    }
+
+    MappedFile::~MappedFile() {
+        if (begin) {
+            munmap(const_cast<char *>(begin), length);
+        }
+    }
+
+    bool MappedFile::advise(const Advice advice, const size_t offset, const size_t count) const {
+        if (!begin || offset >= length) {
+            return true;
+        }
+
+        int flag = MADV_NORMAL;
+        switch (advice) {
+            case Advice::Normal: flag = MADV_NORMAL;
+                break;
+            case Advice::Random: flag = MADV_RANDOM;
+                break;
+            case Advice::Sequential: flag = MADV_SEQUENTIAL;
+                break;
+            case Advice::WillNeed: flag = MADV_WILLNEED;
+                break;
+        }
+
+        // madvise needs a page aligned start, the mapping itself always is
+        const auto pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        const size_t first = offset / pageSize * pageSize;
+        const size_t last = std::min(length, offset + std::min(count, length - offset));
+        return madvise(const_cast<char *>(begin) + first, last - first, flag) == 0;
+    }
+
+    bool MappedFile::adviseHugePages() const {
+#ifdef MADV_HUGEPAGE
+        return begin && madvise(const_cast<char *>(begin), length, MADV_HUGEPAGE) == 0;
+#else
+        return false;
+#endif
+    }
+}
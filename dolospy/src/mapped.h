@@ -0,0 +1,52 @@
+#ifndef MAPPED_H
+#define MAPPED_H
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <string_view>
+
+namespace dolos {
+    enum class Advice {
+        Normal,
+        Random,
+        Sequential,
+        WillNeed,
+    };
+
+    Advice parseAdvice(std::string_view name);
+
+    // Read-only memory mapping of a whole file
+    class MappedFile {
+        const char *begin = nullptr;
+        size_t length = 0;
+
+    public:
+        MappedFile() = default;
+
+        explicit MappedFile(const std::filesystem::path &path);
+
+        // Read-only anonymous copy of the data, e.g. of another mapping instead of its page cache pages, placed on
+        // the NUMA node of the calling thread by first touch
+        static MappedFile copy(std::span<const char> data);
+
+        MappedFile(const MappedFile &) = delete;
+        MappedFile &operator=(const MappedFile &) = delete;
+        MappedFile(MappedFile &&other) noexcept;
+        MappedFile &operator=(MappedFile &&other) noexcept;
+
+        ~MappedFile();
+
+        std::span<const char> data() const { return {begin, length}; }
+        size_t size() const { return length; }
+
+        // Applies the advice to the pages overlapping [offset, offset + count). Returns false if the kernel refused.
+        bool advise(Advice advice, size_t offset = 0, size_t count = SIZE_MAX) const;
+
+        // Asks for transparent huge pages, which only has an effect if the kernel supports THP for the page cache
+        bool adviseHugePages() const;
+    };
+}
+
+#endif //MAPPED_H
@@ -0,0 +1,352 @@
+#include "numa.h"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <fstream>
+#include <iostream>
+#include <ranges>
+
+#include <linux/mempolicy.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "tokenizer.h"
+
+namespace fs = std::filesystem;
+
+namespace dolos {
+    namespace {
+        // Applies MPOL_INTERLEAVE over the given nodes to all allocations of the current thread
+        class InterleaveScope {
+            bool active = false;
+
+        public:
+            explicit InterleaveScope(const NumaTopology &topology) {
+                if (topology.simulated || topology.nodes.size() < 2) {
+                    return;
+                }
+                std::vector<unsigned long> mask(1);
+                constexpr size_t bits = sizeof(unsigned long) * 8;
+                uint32_t maxNode = 0;
+                for (const auto &node: topology.nodes) {
+                    if (node.id / bits >= mask.size()) {
+                        mask.resize(node.id / bits + 1);
+                    }
+                    mask[node.id / bits] |= 1ul << (node.id % bits);
+                    maxNode = std::max(maxNode, node.id);
+                }
+                active = syscall(SYS_set_mempolicy, MPOL_INTERLEAVE, mask.data(), maxNode + 2) == 0;
+                if (!active) {
+                    std::cerr << "Failed to set interleaved memory policy, continuing with default" << std::endl;
+                }
+            }
+
+            InterleaveScope(const InterleaveScope &) = delete;
+            InterleaveScope &operator=(const InterleaveScope &) = delete;
+
+            ~InterleaveScope() {
+                if (active) {
+                    syscall(SYS_set_mempolicy, MPOL_DEFAULT, nullptr, 0);
+                }
+            }
+        };
+
+        std::string_view trim(std::string_view s) {
+            while (!s.empty() && std::isspace(static_cast<unsigned char>(s.front()))) s.remove_prefix(1);
+            while (!s.empty() && std::isspace(static_cast<unsigned char>(s.back()))) s.remove_suffix(1);
+            return s;
+        }
+
+        uint32_t parseNumber(const std::string_view s) {
+            uint32_t value = 0;
+            const auto t = trim(s);
+            if (const auto [ptr, ec] = std::from_chars(t.data(), t.data() + t.size(), value);
+                ec != std::errc() || ptr != t.data() + t.size()) {
+                throw std::invalid_argument("Invalid CPU number '" + std::string(s) + "'");
+            }
+            return value;
+        }
+    }
+
+    std::vector<uint32_t> NumaTopology::parseCpuList(const std::string_view list) {
+        std::vector<uint32_t> cpus;
+        for (const auto part: list | std::views::split(',')) {
+            const auto range = trim(std::string_view(part.begin(), part.end()));
+            if (range.empty()) {
+                continue;
+            }
+            if (const auto dash = range.find('-'); dash != std::string_view::npos) {
+                const auto first = parseNumber(range.substr(0, dash));
+                const auto last = parseNumber(range.substr(dash + 1));
+                for (auto cpu = first; cpu <= last; cpu++) {
+                    cpus.emplace_back(cpu);
+                }
+            } else {
+                cpus.emplace_back(parseNumber(range));
+            }
+        }
+        return cpus;
+    }
+
+    NumaTopology NumaTopology::parse(const std::string_view spec) {
+        NumaTopology topology;
+        topology.simulated = true;
+        for (const auto part: spec | std::views::split(';')) {
+            auto cpus = parseCpuList(std::string_view(part.begin(), part.end()));
+            if (cpus.empty()) {
+                throw std::invalid_argument("Empty NUMA node in topology '" + std::string(spec) + "'");
+            }
+            topology.nodes.emplace_back(NumaNode{
+                .id = static_cast<uint32_t>(topology.nodes.size()),
+                .cpus = std::move(cpus),
+            });
+        }
+        return topology;
+    }
+
+    NumaTopology NumaTopology::detect() {
+        NumaTopology topology;
+
+        std::error_code ec;
+        for (const auto &entry: fs::directory_iterator("/sys/devices/system/node", ec)) {
+            const auto name = entry.path().filename().string();
+            if (!name.starts_with("node") || name.size() == 4 || !std::isdigit(static_cast<unsigned char>(name[4]))) {
+                continue;
+            }
+            std::ifstream file(entry.path() / "cpulist");
+            std::string cpulist;
+            std::getline(file, cpulist);
+            auto cpus = parseCpuList(cpulist);
+            if (cpus.empty()) {
+                // Memory-only node
+                continue;
+            }
+            topology.nodes.emplace_back(NumaNode{
+                .id = parseNumber(std::string_view(name).substr(4)),
+                .cpus = std::move(cpus),
+            });
+        }
+
+        if (topology.nodes.empty()) {
+            NumaNode node{.id = 0, .cpus = {}};
+            for (uint32_t cpu = 0; cpu < std::max(1u, std::thread::hardware_concurrency()); cpu++) {
+                node.cpus.emplace_back(cpu);
+            }
+            topology.nodes.emplace_back(std::move(node));
+        }
+
+        std::ranges::sort(topology.nodes, {}, &NumaNode::id);
+        return topology;
+    }
+
+    bool pinCurrentThread(const std::vector<uint32_t> &cpus) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (const auto cpu: cpus) {
+            if (cpu < CPU_SETSIZE) {
+                CPU_SET(cpu, &set);
+            }
+        }
+        return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+    }
+
+    Placement parsePlacement(const std::string_view name) {
+        if (name == "shared") return Placement::Shared;
+        if (name == "replicate") return Placement::Replicate;
+        if (name == "interleave") return Placement::Interleave;
+        throw std::invalid_argument("Unknown placement '" + std::string(name) + "'");
+    }
+
+    NumaMatcher::NumaMatcher(const fs::path &directory, NumaConfig config) : config(std::move(config)) {
+        topology = this->config.topology.empty() ? NumaTopology::detect() : NumaTopology::parse(this->config.topology);
+
+        {
+            // MPOL_INTERLEAVE only places page cache pages allocated by this thread. Mapped indexes are read ahead
+            // while the policy is active, otherwise the workers would fault them in on their own nodes later.
+            std::optional<InterleaveScope> scope;
+            MadvisePolicy policy;
+            if (this->config.placement == Placement::Interleave) {
+                scope.emplace(topology);
+                policy.willNeed = true;
+            }
+            registry = std::make_unique<IndexRegistry>(directory, policy);
+        }
+
+        for (const auto &numaNode: topology.nodes) {
+            auto node = std::make_unique<Node>();
+            node->node = numaNode;
+            node->replicas.store(std::make_shared<const Replicas>());
+            nodes.emplace_back(std::move(node));
+        }
+
+        if (this->config.placement == Placement::Replicate) {
+            replicate();
+        }
+
+        for (const auto &node: nodes) {
+            const auto count = this->config.workersPerNode > 0
+                                   ? this->config.workersPerNode
+                                   : static_cast<uint32_t>(node->node.cpus.size());
+            for (uint32_t i = 0; i < count; i++) {
+                workers.emplace_back([this, &node = *node] {
+                    if (!pinCurrentThread(node.node.cpus)) {
+                        std::cerr << "Failed to pin worker to NUMA node " << node.node.id << std::endl;
+                    }
+                    work(node);
+                });
+            }
+        }
+    }
+
+    NumaMatcher::~NumaMatcher() {
+        stopping = true;
+        for (const auto &node: nodes) {
+            // Taking the lock orders the store before the predicate check of a worker about to wait
+            { std::lock_guard lock(node->mutex); }
+            node->cv.notify_all();
+        }
+        workers.clear();
+    }
+
+    uint64_t NumaMatcher::reload() {
+        uint64_t generation;
+        {
+            std::optional<InterleaveScope> scope;
+            if (config.placement == Placement::Interleave) {
+                scope.emplace(topology);
+            }
+            generation = registry->reload();
+        }
+        if (config.placement == Placement::Replicate) {
+            replicate();
+        }
+        return generation;
+    }
+
+    void NumaMatcher::replicate() {
+        std::vector<std::jthread> threads;
+        threads.reserve(nodes.size());
+        for (const auto &node: nodes) {
+            // Copies are made by a thread on the target node, so first-touch places their pages there
+            threads.emplace_back([this, &node = *node] {
+                pinCurrentThread(node.node.cpus);
+                auto replicas = std::make_shared<Replicas>();
+                const auto snapshot = registry->acquire();
+                for (const auto &pkg: config.hotPackages) {
+                    const auto it = snapshot->packages.find(pkg);
+                    if (it == snapshot->packages.end()) {
+                        continue;
+                    }
+                    const auto &file = it->second;
+                    if (file.index) {
+                        replicas->emplace(pkg, Replica{.index = std::make_shared<const Index>(*file.index),
+                                                       .mapped = nullptr});
+                        continue;
+                    }
+                    // Page cache pages of a mapped index live on one node, so the file is copied into node memory.
+                    // The copy is taken from the mapping of the snapshot, the file on disk may have been replaced.
+                    try {
+                        auto mapped = std::make_shared<const MappedIndex>(
+                            MappedFile::copy(file.mapped->fileData()), file.path);
+                        replicas->emplace(pkg, Replica{.index = nullptr, .mapped = std::move(mapped)});
+                    } catch (const std::exception &e) {
+                        std::cerr << "Failed to replicate " << pkg << " on NUMA node " << node.node.id << ": "
+                                << e.what() << std::endl;
+                    }
+                }
+                node.replicas.store(std::move(replicas));
+            });
+        }
+    }
+
+    void NumaMatcher::work(Node &node) {
+        while (true) {
+            Job job;
+            {
+                std::unique_lock lock(node.mutex);
+                node.cv.wait(lock, [&] { return stopping || !node.queue.empty(); });
+                if (node.queue.empty()) {
+                    return;
+                }
+                job = std::move(node.queue.front());
+                node.queue.pop_front();
+            }
+
+            try {
+                job.result.set_value(run(node, job));
+            } catch (...) {
+                job.result.set_exception(std::current_exception());
+            }
+        }
+    }
+
+    MatchResult NumaMatcher::run(Node &node, const Job &job) {
+        node.jobs.fetch_add(1, std::memory_order_relaxed);
+        const auto tokens = tokenize(std::span(job.code.data(), job.code.size()));
+
+        const auto replicas = node.replicas.load();
+        if (const auto it = replicas->find(job.pkg); it != replicas->end()) {
+            node.localHits.fetch_add(1, std::memory_order_relaxed);
+            const auto &replica = it->second;
+            return replica.index ? replica.index->matchTokens(tokens) : replica.mapped->matchTokens(tokens);
+        }
+
+        auto result = registry->matchTokens(job.pkg, tokens);
+        (result ? node.sharedHits : node.misses).fetch_add(1, std::memory_order_relaxed);
+        return result;
+    }
+
+    std::future<MatchResult> NumaMatcher::submit(std::string pkg, std::string code, const std::optional<uint32_t> node) {
+        auto &target = *nodes[node.value_or(nextNode.fetch_add(1, std::memory_order_relaxed)) % nodes.size()];
+        Job job{.pkg = std::move(pkg), .code = std::move(code), .result = {}};
+        auto future = job.result.get_future();
+        {
+            std::lock_guard lock(target.mutex);
+            target.queue.emplace_back(std::move(job));
+        }
+        target.cv.notify_one();
+        return future;
+    }
+
+    std::vector<MatchResult> NumaMatcher::matchMany(const std::vector<std::pair<std::string, std::string>> &jobs) {
+        std::vector<std::future<MatchResult>> futures;
+        futures.reserve(jobs.size());
+        for (const auto &[pkg, code]: jobs) {
+            futures.emplace_back(submit(pkg, code));
+        }
+
+        std::vector<MatchResult> results;
+        results.reserve(jobs.size());
+        for (auto &future: futures) {
+            results.emplace_back(future.get());
+        }
+        return results;
+    }
+
+    std::vector<NodeStats> NumaMatcher::stats() const {
+        std::vector<NodeStats> result;
+        result.reserve(nodes.size());
+        for (const auto &node: nodes) {
+            result.emplace_back(NodeStats{
+                .node = node->node.id,
+                .jobs = node->jobs.load(),
+                .localHits = node->localHits.load(),
+                .sharedHits = node->sharedHits.load(),
+                .misses = node->misses.load(),
+            });
+        }
+        return result;
+    }
+
+    void NumaMatcher::resetStats() {
+        for (const auto &node: nodes) {
+            node->jobs.store(0);
+            node->localHits.store(0);
+            node->sharedHits.store(0);
+            node->misses.store(0);
+        }
+    }
+}
@@ -0,0 +1,149 @@
+#ifndef NUMA_H
+#define NUMA_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "index.h"
+#include "registry.h"
+
+namespace dolos {
+    struct NumaNode {
+        uint32_t id;
+        std::vector<uint32_t> cpus;
+    };
+
+    struct NumaTopology {
+        std::vector<NumaNode> nodes;
+        // Simulated topologies only pin threads, memory policies are not applied
+        bool simulated = false;
+
+        // Reads /sys/devices/system/node, falls back to a single node with all CPUs
+        static NumaTopology detect();
+
+        // Parses a simulated topology like "0-3;4-7": one Linux cpulist per node, separated by ';'
+        static NumaTopology parse(std::string_view spec);
+
+        static std::vector<uint32_t> parseCpuList(std::string_view list);
+    };
+
+    bool pinCurrentThread(const std::vector<uint32_t> &cpus);
+
+    enum class Placement {
+        // All nodes read the indexes as loaded by the registry
+        Shared,
+        // Hot packages are copied to every node, everything else is shared
+        Replicate,
+        // Registry generations are loaded with pages interleaved over all nodes. Mapped indexes are read ahead
+        // while loading, pages another process already holds in the page cache keep their node.
+        Interleave,
+    };
+
+    Placement parsePlacement(std::string_view name);
+
+    struct NumaConfig {
+        // Empty means detect, see NumaTopology::parse for the format
+        std::string topology;
+        Placement placement = Placement::Shared;
+        std::vector<std::string> hotPackages;
+        // 0 means one worker per CPU of the node
+        uint32_t workersPerNode = 0;
+    };
+
+    struct NodeStats {
+        uint32_t node;
+        uint64_t jobs;
+        // Lookups answered from a node-local replica
+        uint64_t localHits;
+        // Lookups answered from the shared registry generation
+        uint64_t sharedHits;
+        uint64_t misses;
+
+        double localHitRate() const {
+            const auto hits = localHits + sharedHits;
+            return hits == 0 ? 0.0 : static_cast<double>(localHits) / static_cast<double>(hits);
+        }
+    };
+
+    using MatchResult = std::optional<std::vector<Pair>>;
+
+    // Worker pool with one job queue per NUMA node. Workers are pinned to the CPUs of their node and only see
+    // the replicas placed on that node, everything else is looked up in the shared registry. The registry is
+    // owned by the matcher so that its generations can be loaded with the configured memory policy.
+    class NumaMatcher {
+        // A copy of a JSON index or of the file of a binary one, exactly one is set
+        struct Replica {
+            std::shared_ptr<const Index> index;
+            std::shared_ptr<const MappedIndex> mapped;
+        };
+
+        using Replicas = std::unordered_map<std::string, Replica>;
+
+        struct Job {
+            std::string pkg;
+            std::string code;
+            std::promise<MatchResult> result;
+        };
+
+        struct alignas(64) Node {
+            NumaNode node;
+            std::mutex mutex;
+            std::condition_variable cv;
+            std::deque<Job> queue;
+            std::atomic<std::shared_ptr<const Replicas>> replicas;
+            std::atomic<uint64_t> jobs{0}, localHits{0}, sharedHits{0}, misses{0};
+        };
+
+        NumaConfig config;
+        NumaTopology topology;
+        std::unique_ptr<IndexRegistry> registry;
+        std::vector<std::unique_ptr<Node>> nodes;
+        std::vector<std::jthread> workers;
+        std::atomic<size_t> nextNode{0};
+        std::atomic<bool> stopping{false};
+
+        void work(Node &node);
+
+        MatchResult run(Node &node, const Job &job);
+
+    public:
+        NumaMatcher(const std::filesystem::path &directory, NumaConfig config);
+
+        NumaMatcher(const NumaMatcher &) = delete;
+        NumaMatcher &operator=(const NumaMatcher &) = delete;
+
+        ~NumaMatcher();
+
+        const NumaTopology &getTopology() const { return topology; }
+
+        IndexRegistry &getRegistry() { return *registry; }
+
+        // Reloads the registry (interleaved if configured) and refreshes the replicas of hot packages
+        uint64_t reload();
+
+        // Copies the hot packages of the current registry generation onto every node
+        void replicate();
+
+        std::future<MatchResult> submit(std::string pkg, std::string code, std::optional<uint32_t> node = std::nullopt);
+
+        std::vector<MatchResult> matchMany(const std::vector<std::pair<std::string, std::string>> &jobs);
+
+        std::vector<NodeStats> stats() const;
+
+        void resetStats();
+    };
+}
+
+#endif //NUMA_H
@@ -0,0 +1,45 @@
+#include "parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace dolos {
+    void parallelFor(const size_t count, unsigned threads, const std::function<void(size_t)> &fn) {
+        if (threads == 0) {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        std::atomic<size_t> next{0};
+        std::atomic<bool> failed{false};
+        std::exception_ptr failure;
+        std::mutex failureMutex;
+
+        const auto work = [&] {
+            for (size_t i; !failed.load(std::memory_order_relaxed) && (i = next.fetch_add(1)) < count;) {
+                try {
+                    fn(i);
+                } catch (...) {
+                    std::lock_guard lock(failureMutex);
+                    if (!failure) {
+                        failure = std::current_exception();
+                    }
+                    failed = true;
+                }
+            }
+        };
+
+        {
+            std::vector<std::jthread> workers;
+            for (size_t t = 1; t < std::min<size_t>(threads, count); t++) {
+                workers.emplace_back(work);
+            }
+            work();
+        }
+        if (failure) {
+            std::rethrow_exception(failure);
+        }
+    }
+}
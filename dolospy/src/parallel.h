@@ -0,0 +1,13 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <cstddef>
+#include <functional>
+
+namespace dolos {
+    // Runs fn(i) for every i < count on the given number of threads (0: one per core), the calling thread included.
+    // Stops handing out work after the first failure and rethrows it.
+    void parallelFor(size_t count, unsigned threads, const std::function<void(size_t)> &fn);
+}
+
+#endif //PARALLEL_H
@@ -0,0 +1,218 @@
+#include "postings.h"
+
+#include <array>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <tmmintrin.h>
+#define DOLOS_POSTINGS_SSSE3
+#endif
+
+namespace dolos {
+    namespace {
+        // Per control byte: the data bytes of its four values, and the shuffle spreading them into 32 bit lanes
+        struct DecodeTables {
+            std::array<uint8_t, 256> lengths{};
+            std::array<std::array<uint8_t, 16>, 256> shuffles{};
+        };
+
+        // An encoded list with its bounds checked
+        struct List {
+            const uint8_t *control;
+            const uint8_t *data;
+            size_t values;
+        };
+    }
+
+    static constexpr DecodeTables makeTables() {
+        DecodeTables tables;
+        for (size_t control = 0; control < 256; control++) {
+            uint8_t offset = 0;
+            for (size_t lane = 0; lane < 4; lane++) {
+                const uint8_t length = ((control >> (2 * lane)) & 3) + 1;
+                for (uint8_t byte = 0; byte < 4; byte++) {
+                    // Shuffle indices with the top bit set produce zero bytes
+                    tables.shuffles[control][4 * lane + byte] = byte < length ? offset + byte : 0x80;
+                }
+                offset += length;
+            }
+            tables.lengths[control] = offset;
+        }
+        return tables;
+    }
+
+    static constexpr DecodeTables tables = makeTables();
+
+    static uint8_t lengthCode(const uint32_t value) {
+        return value < (1u << 8) ? 0 : value < (1u << 16) ? 1 : value < (1u << 24) ? 2 : 3;
+    }
+
+    uint32_t encodePostings(const std::span<const Run> runs, std::vector<uint8_t> &lists, const uint64_t base) {
+        if (runs.size() == 1 && runs[0].first < 0x8000) {
+            return static_cast<uint32_t>(runs[0].first) << 16 | static_cast<uint32_t>(runs[0].last - runs[0].first);
+        }
+        if (base + lists.size() >= listSlot) {
+            throw std::runtime_error("Posting lists exceed 2 GiB, write the index without compressed postings");
+        }
+        const auto slot = listSlot | static_cast<uint32_t>(base + lists.size());
+
+        for (uint64_t count = runs.size(); ; count >>= 7) {
+            lists.emplace_back(static_cast<uint8_t>(count >= 0x80 ? (count & 0x7f) | 0x80 : count));
+            if (count < 0x80) {
+                break;
+            }
+        }
+        const size_t control = lists.size(), values = 2 * runs.size();
+        lists.resize(control + (values + 3) / 4, 0);
+        uint32_t previous = 0;
+        size_t i = 0;
+        const auto put = [&](const uint32_t value) {
+            const auto code = lengthCode(value);
+            lists[control + i / 4] |= code << (2 * (i % 4));
+            for (uint8_t byte = 0; byte <= code; byte++) {
+                lists.emplace_back(static_cast<uint8_t>(value >> (8 * byte)));
+            }
+            i++;
+        };
+        for (const auto [first, last]: runs) {
+            put(first - previous);
+            put(last - first);
+            previous = last;
+        }
+        return slot;
+    }
+
+    static List openList(const uint32_t slot, const std::span<const uint8_t> lists) {
+        size_t position = slot & ~listSlot;
+        uint64_t runs = 0;
+        for (unsigned shift = 0; ; shift += 7) {
+            if (position >= lists.size() || shift > 28) {
+                throw std::runtime_error("Corrupt binary index: posting list out of bounds");
+            }
+            const auto byte = lists[position++];
+            runs |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if (byte < 0x80) {
+                break;
+            }
+        }
+
+        const size_t values = 2 * runs, controlBytes = (values + 3) / 4;
+        if (controlBytes > lists.size() - position) {
+            throw std::runtime_error("Corrupt binary index: posting list out of bounds");
+        }
+        // Values take at most 4 bytes, only lists near the end of the section need their exact length. Unused codes
+        // of the last control byte are zero and counted as one byte each.
+        const size_t available = lists.size() - position - controlBytes;
+        if (4 * values + listPadding > available) {
+            size_t dataBytes = 0;
+            for (size_t i = 0; i < controlBytes; i++) {
+                dataBytes += tables.lengths[lists[position + i]];
+            }
+            dataBytes -= 4 * controlBytes - values;
+            if (dataBytes + listPadding > available) {
+                throw std::runtime_error("Corrupt binary index: posting list out of bounds");
+            }
+        }
+        return {.control = lists.data() + position, .data = lists.data() + position + controlBytes, .values = values};
+    }
+
+    // Decodes values from i on (a multiple of 2) and calls fn with the bounds of each run
+    template<typename Fn>
+    static void scalarRuns(const List &list, size_t i, const uint8_t *data, uint32_t bound, Fn &&fn) {
+        const auto next = [&] {
+            const auto code = (list.control[i / 4] >> (2 * (i % 4))) & 3;
+            uint32_t value = 0;
+            for (int byte = 0; byte <= code; byte++) {
+                value |= static_cast<uint32_t>(data[byte]) << (8 * byte);
+            }
+            data += code + 1;
+            i++;
+            return value;
+        };
+        while (i < list.values) {
+            const auto first = bound + next();
+            bound = first + next();
+            fn(first, bound);
+        }
+    }
+
+#ifdef DOLOS_POSTINGS_SSSE3
+    // Four values per step: one shuffle spreads their bytes into lanes, two shifted adds and the carry of the
+    // previous step turn the differences into run bounds
+    template<typename Fn>
+    [[gnu::target("ssse3")]] static void vectorRuns(const List &list, Fn &&fn) {
+        const uint8_t *data = list.data;
+        auto carry = _mm_setzero_si128();
+        size_t i = 0;
+        for (; i + 4 <= list.values; i += 4) {
+            const auto control = list.control[i / 4];
+            const auto shuffle = _mm_loadu_si128(reinterpret_cast<const __m128i *>(tables.shuffles[control].data()));
+            auto bounds = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(data)), shuffle);
+            data += tables.lengths[control];
+            bounds = _mm_add_epi32(bounds, _mm_slli_si128(bounds, 4));
+            bounds = _mm_add_epi32(bounds, _mm_slli_si128(bounds, 8));
+            bounds = _mm_add_epi32(bounds, carry);
+            carry = _mm_shuffle_epi32(bounds, 0xff);
+
+            alignas(16) uint32_t values[4];
+            _mm_store_si128(reinterpret_cast<__m128i *>(values), bounds);
+            fn(values[0], values[1]);
+            fn(values[2], values[3]);
+        }
+        scalarRuns(list, i, data, static_cast<uint32_t>(_mm_cvtsi128_si32(carry)), fn);
+    }
+#endif
+
+    bool vectorizedPostings() {
+#ifdef DOLOS_POSTINGS_SSSE3
+        static const bool supported = __builtin_cpu_supports("ssse3");
+        return supported;
+#else
+        return false;
+#endif
+    }
+
+    template<typename Fn>
+    static void forEachRun(const uint32_t slot, const std::span<const uint8_t> lists, const bool vectorized,
+                           Fn &&fn) {
+        if ((slot & listSlot) == 0) {
+            const auto first = slot >> 16;
+            fn(first, first + (slot & 0xffff));
+            return;
+        }
+        const auto list = openList(slot, lists);
+#ifdef DOLOS_POSTINGS_SSSE3
+        if (vectorized) {
+            vectorRuns(list, fn);
+            return;
+        }
+#else
+        static_cast<void>(vectorized);
+#endif
+        scalarRuns(list, 0, list.data, 0, fn);
+    }
+
+    void accumulatePostings(const uint32_t slot, const std::span<const uint8_t> lists, const std::span<uint32_t> counts,
+                            const bool vectorized) {
+        forEachRun(slot, lists, vectorized, [&](const uint32_t first, const uint32_t last) {
+            if (first > last || last >= counts.size()) {
+                throw std::runtime_error("Corrupt binary index: run out of range");
+            }
+            counts[first] += 1;
+            if (last + 1 < counts.size()) {
+                counts[last + 1] -= 1;
+            }
+        });
+    }
+
+    void decodePostings(const uint32_t slot, const std::span<const uint8_t> lists, std::vector<Run> &runs,
+                        const bool vectorized) {
+        runs.clear();
+        forEachRun(slot, lists, vectorized, [&](const uint32_t first, const uint32_t last) {
+            if (first > last || last > UINT16_MAX) {
+                throw std::runtime_error("Corrupt binary index: run out of range");
+            }
+            runs.emplace_back(Run{.first = static_cast<uint16_t>(first), .last = static_cast<uint16_t>(last)});
+        });
+    }
+}
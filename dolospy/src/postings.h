@@ -0,0 +1,41 @@
+#ifndef POSTINGS_H
+#define POSTINGS_H
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace dolos {
+    // Inclusive range of group ids. Groups are added in version order, so a fingerprint introduced in one release
+    // and removed in a later one is a single run.
+    struct Run {
+        uint16_t first, last;
+    };
+
+    // Posting lists of binary index version 4. Every hash has a 32 bit slot: with the top bit clear it holds a single
+    // run inline (first in bits 16-30, last - first in bits 0-15), which is how most fingerprints appear. Otherwise
+    // the low 31 bits are the offset of an encoded list: the run count as varint, then the differences between
+    // consecutive run bounds (first, last, first, ...) in StreamVByte layout, 2 bit length codes for four values per
+    // control byte followed by the data bytes of those values.
+    static constexpr uint32_t listSlot = uint32_t{1} << 31;
+
+    // Bytes after the last list, so vector loads never read past the section
+    static constexpr size_t listPadding = 16;
+
+    // Slot of the runs, appends an encoded list if they do not fit inline. Lists written out earlier take up the
+    // first base bytes of the section.
+    uint32_t encodePostings(std::span<const Run> runs, std::vector<uint8_t> &lists, uint64_t base = 0);
+
+    // Whether this CPU has the SSSE3 shuffles of the vectorized decoder
+    bool vectorizedPostings();
+
+    // Adds 1 at the first group and subtracts 1 after the last group of every run, the difference array of
+    // MappedIndex::countShared. Throws on runs outside counts or lists.
+    void accumulatePostings(uint32_t slot, std::span<const uint8_t> lists, std::span<uint32_t> counts,
+                            bool vectorized = vectorizedPostings());
+
+    void decodePostings(uint32_t slot, std::span<const uint8_t> lists, std::vector<Run> &runs,
+                        bool vectorized = vectorizedPostings());
+}
+
+#endif //POSTINGS_H
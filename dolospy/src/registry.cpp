@@ -0,0 +1,246 @@
+#include "registry.h"
+
+#include <algorithm>
+#include <iostream>
+#include <ranges>
+#include <string_view>
+#include <system_error>
+
+#include "batchio.h"
+#include "trace.h"
+
+namespace fs = std::filesystem;
+
+namespace dolos {
+    static constexpr std::string_view jsonSuffix = ".index.json";
+    static constexpr std::string_view binarySuffix = ".index.bin";
+
+    const Index *Generation::find(const std::string &pkg) const {
+        const auto it = packages.find(pkg);
+        return it == packages.end() ? nullptr : it->second.index.get();
+    }
+
+    const MappedIndex *Generation::findMapped(const std::string &pkg) const {
+        const auto it = packages.find(pkg);
+        return it == packages.end() ? nullptr : it->second.mapped.get();
+    }
+
+    std::optional<std::vector<Pair>> Generation::matchTokens(const std::string &pkg,
+                                                             const TokenizedFile &tokens) const {
+        const auto it = packages.find(pkg);
+        if (it == packages.end()) {
+            return std::nullopt;
+        }
+        if (it->second.mapped) {
+            return it->second.mapped->matchTokens(tokens);
+        }
+        return it->second.index->matchTokens(tokens);
+    }
+
+    IndexRegistry::Snapshot::Snapshot(Snapshot &&other) noexcept : generation(other.generation),
+                                                                   counter(other.counter) {
+        other.counter = nullptr;
+    }
+
+    IndexRegistry::Snapshot::~Snapshot() {
+        if (counter) {
+            counter->value.fetch_sub(1);
+        }
+    }
+
+    IndexRegistry::IndexRegistry(fs::path directory, const MadvisePolicy policy, std::vector<std::string> hotPackages)
+        : directory(std::move(directory)), policy(policy), hotPackages(std::move(hotPackages)) {
+        reload();
+    }
+
+    IndexRegistry::~IndexRegistry() {
+        if (background.joinable()) {
+            background.join();
+        }
+        delete current.load();
+    }
+
+    size_t IndexRegistry::shard() {
+        static std::atomic<size_t> next{0};
+        thread_local const size_t assigned = next.fetch_add(1) % shards;
+        return assigned;
+    }
+
+    IndexRegistry::Snapshot IndexRegistry::acquire() {
+        const size_t s = shard();
+        while (true) {
+            const auto e = epoch.load();
+            auto &counter = readers[e & 1][s];
+            counter.value.fetch_add(1);
+            // If a reload flipped the epoch in between, the writer might not wait for this counter anymore
+            if (epoch.load() == e) {
+                return {current.load(), &counter};
+            }
+            counter.value.fetch_sub(1);
+        }
+    }
+
+    void IndexRegistry::synchronize(const uint64_t retiredEpoch) {
+        DOLOS_TRACE("registry.synchronize", "lock");
+        const auto &counters = readers[retiredEpoch & 1];
+        while (true) {
+            int64_t active = 0;
+            for (const auto &counter: counters) {
+                active += counter.value.load();
+            }
+            if (active == 0) {
+                return;
+            }
+            std::this_thread::yield();
+        }
+    }
+
+    uint64_t IndexRegistry::reload() {
+        std::unique_lock lock(reloadMutex, std::defer_lock);
+        {
+            DOLOS_TRACE("registry.reloadLock", "lock");
+            lock.lock();
+        }
+        DOLOS_TRACE("registry.reload", "index");
+
+        const Generation *previous = current.load();
+        auto next = std::make_unique<Generation>();
+        next->number = previous ? previous->number + 1 : 1;
+
+        const auto findPrevious = [&](const std::string &pkg) -> const IndexFile * {
+            if (!previous) {
+                return nullptr;
+            }
+            const auto it = previous->packages.find(pkg);
+            return it == previous->packages.end() ? nullptr : &it->second;
+        };
+
+        // Probably caught the file while it was being rewritten, keep the old one for now
+        const auto keepPrevious = [&](const std::string &pkg, IndexFile &file, const char *error) {
+            std::cerr << "Failed to load " << file.path << ": " << error << std::endl;
+            const IndexFile *old = findPrevious(pkg);
+            if (old) {
+                file = *old;
+            }
+            return old != nullptr;
+        };
+
+        // Binary indexes take precedence over JSON ones of the same package
+        std::unordered_map<std::string, fs::directory_entry> candidates;
+        for (const auto &entry: fs::directory_iterator(directory)) {
+            const auto filename = entry.path().filename().string();
+            if (!entry.is_regular_file()) {
+                continue;
+            }
+            if (filename.ends_with(binarySuffix)) {
+                candidates.insert_or_assign(filename.substr(0, filename.size() - binarySuffix.size()), entry);
+            } else if (filename.ends_with(jsonSuffix)) {
+                candidates.try_emplace(filename.substr(0, filename.size() - jsonSuffix.size()), entry);
+            }
+        }
+
+        // JSON files are read in one batch and parsed as they arrive, binary ones are only mapped
+        std::vector<std::pair<std::string, IndexFile>> toRead;
+        for (const auto &[pkg, entry]: candidates) {
+            IndexFile file{
+                .path = entry.path(),
+                .mtime = entry.last_write_time(),
+                .size = entry.file_size(),
+                .index = nullptr,
+                .mapped = nullptr,
+            };
+
+            const IndexFile *old = findPrevious(pkg);
+            if (old && old->path == file.path && old->mtime == file.mtime && old->size == file.size) {
+                file.index = old->index;
+                file.mapped = old->mapped;
+            } else if (file.path.filename().string().ends_with(jsonSuffix)) {
+                toRead.emplace_back(pkg, std::move(file));
+                continue;
+            } else {
+                try {
+                    auto filePolicy = policy;
+                    filePolicy.willNeed |= std::ranges::find(hotPackages, pkg) != hotPackages.end();
+                    file.mapped = std::make_shared<const MappedIndex>(file.path, filePolicy);
+                } catch (const std::exception &e) {
+                    if (!keepPrevious(pkg, file, e.what())) {
+                        continue;
+                    }
+                }
+            }
+
+            next->packages.emplace(pkg, std::move(file));
+        }
+
+        std::vector<fs::path> paths;
+        paths.reserve(toRead.size());
+        for (const auto &file: toRead | std::views::values) {
+            paths.emplace_back(file.path);
+        }
+
+        BatchReader reader;
+        reader.read(paths, [&](const size_t i, ReadResult result) {
+            auto &[pkg, file] = toRead[i];
+            try {
+                if (result.error != 0) {
+                    throw std::system_error(result.error, std::generic_category(), "read");
+                }
+                file.index = std::make_shared<const Index>(result.data);
+            } catch (const std::exception &e) {
+                if (!keepPrevious(pkg, file, e.what())) {
+                    return;
+                }
+            }
+            next->packages.emplace(pkg, std::move(file));
+        });
+
+        const auto number = next->number;
+        if (const Generation *retired = current.exchange(next.release())) {
+            synchronize(epoch.fetch_add(1));
+            delete retired;
+        }
+
+        return number;
+    }
+
+    bool IndexRegistry::reloadAsync() {
+        if (reloading.exchange(true)) {
+            return false;
+        }
+        if (background.joinable()) {
+            background.join();
+        }
+        background = std::jthread([this] {
+            try {
+                reload();
+            } catch (const std::exception &e) {
+                std::cerr << "Reloading " << directory << " failed: " << e.what() << std::endl;
+            }
+            reloading.store(false);
+        });
+        return true;
+    }
+
+    uint64_t IndexRegistry::generation() {
+        return acquire()->number;
+    }
+
+    std::vector<std::string> IndexRegistry::packages() {
+        const auto snapshot = acquire();
+        std::vector<std::string> result;
+        result.reserve(snapshot->packages.size());
+        for (const auto &pkg: snapshot->packages | std::views::keys) {
+            result.emplace_back(pkg);
+        }
+        return result;
+    }
+
+    std::optional<std::vector<Pair>> IndexRegistry::matchTokens(const std::string &pkg, const TokenizedFile &tokens) {
+        return acquire()->matchTokens(pkg, tokens);
+    }
+
+    std::optional<std::vector<Pair>> IndexRegistry::matchExternal(const std::string &pkg,
+                                                                  const std::span<const char> sourceCode) {
+        return matchTokens(pkg, tokenize(sourceCode));
+    }
+}
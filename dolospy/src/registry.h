@@ -0,0 +1,118 @@
+#ifndef REGISTRY_H
+#define REGISTRY_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "binary.h"
+#include "index.h"
+#include "tokenizer.h"
+
+namespace dolos {
+    struct IndexFile {
+        std::filesystem::path path;
+        std::filesystem::file_time_type mtime;
+        std::uintmax_t size;
+        // Exactly one of both is set, depending on whether the file is JSON or binary
+        std::shared_ptr<const Index> index;
+        std::shared_ptr<const MappedIndex> mapped;
+    };
+
+    // One immutable set of loaded indexes. Never modified after publication.
+    struct Generation {
+        uint64_t number = 0;
+        std::unordered_map<std::string, IndexFile> packages;
+
+        const Index *find(const std::string &pkg) const;
+
+        const MappedIndex *findMapped(const std::string &pkg) const;
+
+        std::optional<std::vector<Pair>> matchTokens(const std::string &pkg, const TokenizedFile &tokens) const;
+    };
+
+    // Holds all <pkg>.index.json (in memory) and <pkg>.index.bin (mapped) files of a directory and allows swapping
+    // in a new generation while queries are running. Readers never take a lock: they register in a sharded reader
+    // counter of the current epoch and load the generation pointer. A reload publishes the new generation, flips
+    // the epoch and waits until all readers of the old epoch are gone before freeing the old generation.
+    class IndexRegistry {
+        static constexpr size_t shards = 64;
+
+        struct alignas(64) ReaderCounter {
+            std::atomic<int64_t> value{0};
+        };
+
+        std::filesystem::path directory;
+        MadvisePolicy policy;
+        std::vector<std::string> hotPackages;
+        std::atomic<const Generation *> current{nullptr};
+        std::atomic<uint64_t> epoch{0};
+        std::array<std::array<ReaderCounter, shards>, 2> readers;
+
+        std::mutex reloadMutex;
+        std::jthread background;
+        std::atomic<bool> reloading{false};
+
+        static size_t shard();
+
+        void synchronize(uint64_t retiredEpoch);
+
+    public:
+        class Snapshot {
+            friend class IndexRegistry;
+
+            const Generation *generation;
+            ReaderCounter *counter;
+
+            Snapshot(const Generation *generation, ReaderCounter *counter) : generation(generation), counter(counter) {
+            }
+
+        public:
+            Snapshot(const Snapshot &) = delete;
+            Snapshot &operator=(const Snapshot &) = delete;
+            Snapshot(Snapshot &&other) noexcept;
+            ~Snapshot();
+
+            const Generation &operator*() const { return *generation; }
+            const Generation *operator->() const { return generation; }
+        };
+
+        // The policy is applied to every binary index, hot packages are additionally prefetched when mapped
+        explicit IndexRegistry(std::filesystem::path directory, MadvisePolicy policy = {},
+                               std::vector<std::string> hotPackages = {});
+
+        IndexRegistry(const IndexRegistry &) = delete;
+        IndexRegistry &operator=(const IndexRegistry &) = delete;
+
+        ~IndexRegistry();
+
+        Snapshot acquire();
+
+        // Loads a new generation and publishes it. Unchanged files (same mtime and size) are shared with the
+        // previous generation. Returns the new generation number.
+        uint64_t reload();
+
+        // Like reload(), but on a background thread. Returns false if a reload is already in progress.
+        bool reloadAsync();
+
+        bool isReloading() const { return reloading.load(); }
+
+        uint64_t generation();
+
+        std::vector<std::string> packages();
+
+        std::optional<std::vector<Pair>> matchTokens(const std::string &pkg, const TokenizedFile &tokens);
+
+        std::optional<std::vector<Pair>> matchExternal(const std::string &pkg, std::span<const char> sourceCode);
+    };
+}
+
+#endif //REGISTRY_H
@@ -0,0 +1,648 @@
+#include "shard.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <utility>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "hashing.h"
+#include "postings.h"
+#include "trace.h"
+
+namespace dolos {
+    namespace {
+        enum class FrameType : uint32_t {
+            // Empty request, answered with a ShardDescription, the group sizes, name offsets and names
+            Describe = 1,
+            // Fingerprints of the shard's range as uint64_t, answered with a SharedCount per group with a match
+            Count = 2,
+            // Answer to a failed request, the message as payload
+            Error = 3,
+        };
+
+        struct Frame {
+            FrameType type;
+            uint32_t reserved;
+            uint64_t size;
+        };
+
+        struct ShardDescription {
+            static constexpr char expectedMagic[8] = {'D', 'O', 'L', 'O', 'S', 'S', 'H', 'D'};
+            static constexpr uint32_t currentVersion = 1;
+
+            char magic[8];
+            uint32_t version;
+            uint16_t k, w;
+            uint32_t groupCount;
+            uint16_t shard, shardCount;
+            uint64_t hashCount;
+            uint64_t firstHash, lastHash;
+            uint64_t namesSize;
+        };
+
+        struct SharedCount {
+            uint32_t group, count;
+        };
+
+        // Closes the descriptor unless released
+        class Descriptor {
+            int fd;
+
+        public:
+            explicit Descriptor(const int fd) : fd(fd) {
+            }
+
+            Descriptor(const Descriptor &) = delete;
+            Descriptor &operator=(const Descriptor &) = delete;
+
+            ~Descriptor() {
+                if (fd >= 0) {
+                    close(fd);
+                }
+            }
+
+            int get() const { return fd; }
+
+            int release() { return std::exchange(fd, -1); }
+        };
+    }
+
+    // Larger requests are refused, 2^27 fingerprints are far beyond any script
+    static constexpr uint64_t maxFrameSize = uint64_t{1} << 30;
+
+    // Writes a binary index holding the hashes [begin, end) of the source, kept in memory until written
+    static void writeShard(const MappedIndex &index, const size_t begin, const size_t end, const uint16_t shard,
+                           const uint16_t shardCount, const std::filesystem::path &output) {
+        const auto hashes = index.allHashes().subspan(begin, end - begin);
+        const auto compressed = index.compressedPostings();
+        std::vector<uint64_t> offsets;
+        std::vector<uint32_t> slots;
+        std::vector<Run> postings;
+        std::vector<uint8_t> lists;
+        std::vector<Run> buffer;
+        for (const auto hash: hashes) {
+            const auto runs = index.lookup(hash, buffer);
+            if (compressed) {
+                slots.emplace_back(encodePostings(runs, lists));
+            } else {
+                offsets.emplace_back(postings.size());
+                postings.insert(postings.end(), runs.begin(), runs.end());
+            }
+        }
+        if (compressed) {
+            lists.resize(lists.size() + listPadding, 0);
+        } else {
+            offsets.emplace_back(postings.size());
+        }
+
+        std::vector<uint32_t> groupSizes, nameOffsets;
+        std::string names;
+        for (uint16_t group = 0; group < index.groupCount(); group++) {
+            groupSizes.emplace_back(index.groupSize(group));
+            nameOffsets.emplace_back(names.size());
+            names += index.name(group);
+        }
+        nameOffsets.emplace_back(names.size());
+
+        BinaryHeader header{};
+        header.version = compressed ? BinaryHeader::currentVersion : BinaryHeader::uncompressedVersion;
+        header.k = index.k();
+        header.w = index.w();
+        header.groupCount = index.groupCount();
+        header.shard = shard;
+        header.shardCount = shardCount;
+        header.hashCount = hashes.size();
+        header.postingsSize = compressed ? lists.size() : postings.size();
+        header.namesSize = names.size();
+        header = layoutBinary(header);
+
+        std::string data(binarySize(header), '\0');
+        const auto write = [&](const uint64_t offset, const void *section, const size_t size) {
+            if (size > 0) {
+                std::memcpy(data.data() + offset, section, size);
+            }
+        };
+        write(0, &header, sizeof(header));
+        write(header.hashesOffset, hashes.data(), hashes.size_bytes());
+        if (compressed) {
+            write(header.offsetsOffset, slots.data(), slots.size() * sizeof(uint32_t));
+            write(header.postingsOffset, lists.data(), lists.size());
+        } else {
+            write(header.offsetsOffset, offsets.data(), offsets.size() * sizeof(uint64_t));
+            write(header.postingsOffset, postings.data(), postings.size() * sizeof(Run));
+        }
+        write(header.groupSizesOffset, groupSizes.data(), groupSizes.size() * sizeof(uint32_t));
+        write(header.nameOffsetsOffset, nameOffsets.data(), nameOffsets.size() * sizeof(uint32_t));
+        write(header.namesOffset, names.data(), names.size());
+
+        const auto temporary = output.string() + ".tmp";
+        std::ofstream file(temporary, std::ios::binary);
+        file.write(data.data(), static_cast<std::streamsize>(data.size()));
+        file.close();
+        if (!file) {
+            throw std::runtime_error("Failed to write " + output.string());
+        }
+        std::filesystem::rename(temporary, output);
+    }
+
+    std::vector<std::filesystem::path> splitBinary(const MappedIndex &index, const size_t count,
+                                                   const std::filesystem::path &prefix) {
+        const auto limit = std::min<uint64_t>(index.hashCount(), UINT16_MAX);
+        if (count == 0 || count > limit) {
+            throw std::invalid_argument("Expected between 1 and " + std::to_string(limit) + " shards");
+        }
+        if (index.shardCount() > 0) {
+            throw std::invalid_argument("The index is a shard already");
+        }
+
+        std::vector<std::filesystem::path> paths;
+        const auto hashCount = index.hashCount();
+        for (size_t i = 0; i < count; i++) {
+            DOLOS_TRACE("shard.write", "io");
+            const auto path = prefix.string() + ".shard" + std::to_string(i) + ".bin";
+            writeShard(index, hashCount * i / count, hashCount * (i + 1) / count, static_cast<uint16_t>(i),
+                       static_cast<uint16_t>(count), path);
+            paths.emplace_back(path);
+        }
+        return paths;
+    }
+
+    ShardAddress ShardAddress::parse(const std::string_view address) {
+        ShardAddress result;
+        if (address.starts_with("unix:") || address.find('/') != std::string_view::npos) {
+            result.local = true;
+            result.path = address.starts_with("unix:") ? address.substr(5) : address;
+            return result;
+        }
+        const auto colon = address.rfind(':');
+        if (colon == std::string_view::npos || colon + 1 == address.size()) {
+            throw std::invalid_argument("Expected a socket path or host:port, got " + std::string(address));
+        }
+        // IPv6 hosts in brackets, [::1]:7000
+        auto host = address.substr(0, colon);
+        if (host.size() >= 2 && host.front() == '[' && host.back() == ']') {
+            host = host.substr(1, host.size() - 2);
+        }
+        result.host = host;
+        result.port = address.substr(colon + 1);
+        return result;
+    }
+
+    std::string ShardAddress::toString() const {
+        if (local) {
+            return path;
+        }
+        return (host.find(':') == std::string::npos ? host : "[" + host + "]") + ":" + port;
+    }
+
+    // Connected socket of the address, or with listen a bound and listening one. An empty host listens on all
+    // interfaces and connects to the loopback.
+    static int openSocket(const ShardAddress &address, const bool listen) {
+        if (address.local) {
+            sockaddr_un local{};
+            local.sun_family = AF_UNIX;
+            if (address.path.empty() || address.path.size() >= sizeof(local.sun_path)) {
+                throw std::invalid_argument("Invalid Unix socket path " + address.path);
+            }
+            std::memcpy(local.sun_path, address.path.data(), address.path.size());
+            const auto *raw = reinterpret_cast<const sockaddr *>(&local);
+
+            Descriptor socket(::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0));
+            if (socket.get() < 0) {
+                throw std::system_error(errno, std::generic_category(), "Failed to create a socket");
+            }
+            if (listen) {
+                // Left behind by a server that was killed
+                if (std::filesystem::is_socket(address.path)) {
+                    std::filesystem::remove(address.path);
+                }
+                if (bind(socket.get(), raw, sizeof(local)) != 0 || ::listen(socket.get(), SOMAXCONN) != 0) {
+                    throw std::system_error(errno, std::generic_category(), "Failed to listen on " + address.path);
+                }
+            } else if (connect(socket.get(), raw, sizeof(local)) != 0) {
+                throw std::system_error(errno, std::generic_category(), "Failed to connect to " + address.path);
+            }
+            return socket.release();
+        }
+
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = listen ? AI_PASSIVE : 0;
+        addrinfo *results = nullptr;
+        const auto host = address.host.empty() ? nullptr : address.host.c_str();
+        if (const auto error = getaddrinfo(host, address.port.c_str(), &hints, &results); error != 0) {
+            throw std::runtime_error("Failed to resolve " + address.toString() + ": " + gai_strerror(error));
+        }
+        const std::unique_ptr<addrinfo, decltype(&freeaddrinfo)> owner(results, freeaddrinfo);
+
+        int error = 0;
+        for (const auto *result = results; result != nullptr; result = result->ai_next) {
+            Descriptor socket(::socket(result->ai_family, result->ai_socktype | SOCK_CLOEXEC, result->ai_protocol));
+            if (socket.get() < 0) {
+                error = errno;
+                continue;
+            }
+            const int one = 1;
+            if (listen) {
+                setsockopt(socket.get(), SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+                if (bind(socket.get(), result->ai_addr, result->ai_addrlen) == 0
+                    && ::listen(socket.get(), SOMAXCONN) == 0) {
+                    return socket.release();
+                }
+            } else {
+                // Every request is answered before the next one, Nagle's algorithm would only delay it
+                setsockopt(socket.get(), IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                if (connect(socket.get(), result->ai_addr, result->ai_addrlen) == 0) {
+                    return socket.release();
+                }
+            }
+            error = errno;
+        }
+        throw std::system_error(error, std::generic_category(),
+                                (listen ? "Failed to listen on " : "Failed to connect to ") + address.toString());
+    }
+
+    static void sendAll(const int socket, const void *data, size_t size, const int flags = 0) {
+        const auto *bytes = static_cast<const char *>(data);
+        while (size > 0) {
+            const auto sent = send(socket, bytes, size, flags | MSG_NOSIGNAL);
+            if (sent < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::system_error(errno, std::generic_category(), "Failed to send a shard request");
+            }
+            bytes += sent;
+            size -= static_cast<size_t>(sent);
+        }
+    }
+
+    // False if the peer closed the connection before the first byte
+    static bool receiveAll(const int socket, void *data, const size_t size) {
+        auto *bytes = static_cast<char *>(data);
+        size_t received = 0;
+        while (received < size) {
+            const auto count = recv(socket, bytes + received, size - received, 0);
+            if (count < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::system_error(errno, std::generic_category(), "Failed to receive a shard frame");
+            }
+            if (count == 0) {
+                if (received == 0) {
+                    return false;
+                }
+                throw std::runtime_error("Shard connection closed in the middle of a frame");
+            }
+            received += static_cast<size_t>(count);
+        }
+        return true;
+    }
+
+    static void sendFrame(const int socket, const FrameType type, const void *payload, const size_t size) {
+        const Frame frame{.type = type, .reserved = 0, .size = size};
+        // The header waits for the payload instead of going out as a packet of its own
+        sendAll(socket, &frame, sizeof(frame), size > 0 ? MSG_MORE : 0);
+        sendAll(socket, payload, size);
+    }
+
+    // Payload of the next frame into a buffer of whole T, false if the peer closed the connection
+    template<typename T>
+    static bool receiveFrame(const int socket, Frame &frame, std::vector<T> &payload) {
+        if (!receiveAll(socket, &frame, sizeof(frame))) {
+            return false;
+        }
+        if (frame.size > maxFrameSize) {
+            throw std::runtime_error("Shard frame of " + std::to_string(frame.size) + " bytes exceeds the limit");
+        }
+        payload.resize((frame.size + sizeof(T) - 1) / sizeof(T));
+        if (frame.size > 0 && !receiveAll(socket, payload.data(), frame.size)) {
+            throw std::runtime_error("Shard connection closed in the middle of a frame");
+        }
+        return true;
+    }
+
+    // ShardDescription followed by the group sizes, name offsets and names
+    static std::string describe(const MappedIndex &index) {
+        const auto hashes = index.allHashes();
+        ShardDescription description{};
+        std::memcpy(description.magic, ShardDescription::expectedMagic, sizeof(description.magic));
+        description.version = ShardDescription::currentVersion;
+        description.k = index.k();
+        description.w = index.w();
+        description.groupCount = index.groupCount();
+        description.shard = index.shard();
+        // A whole index serves as the only shard
+        description.shardCount = std::max<uint16_t>(index.shardCount(), 1);
+        description.hashCount = hashes.size();
+        description.firstHash = hashes.front();
+        description.lastHash = hashes.back();
+
+        std::vector<uint32_t> groupSizes, nameOffsets;
+        std::string names;
+        for (uint16_t group = 0; group < index.groupCount(); group++) {
+            groupSizes.emplace_back(index.groupSize(group));
+            nameOffsets.emplace_back(names.size());
+            names += index.name(group);
+        }
+        nameOffsets.emplace_back(names.size());
+        description.namesSize = names.size();
+
+        std::string out(reinterpret_cast<const char *>(&description), sizeof(description));
+        out.append(reinterpret_cast<const char *>(groupSizes.data()), groupSizes.size() * sizeof(uint32_t));
+        out.append(reinterpret_cast<const char *>(nameOffsets.data()), nameOffsets.size() * sizeof(uint32_t));
+        return out + names;
+    }
+
+    // Answers requests until the coordinator disconnects
+    static void serveConnection(const MappedIndex &index, const int socket) {
+        std::vector<uint32_t> counts(index.groupCount());
+        std::vector<uint64_t> payload;
+        Frame frame{};
+        while (receiveFrame(socket, frame, payload)) {
+            auto type = frame.type;
+            std::string answer;
+            try {
+                if (frame.type == FrameType::Describe) {
+                    answer = describe(index);
+                } else if (frame.type == FrameType::Count) {
+                    if (frame.size % sizeof(uint64_t) != 0) {
+                        throw std::runtime_error("Fingerprints of a partial hash");
+                    }
+                    index.countShared(payload, counts);
+                    for (uint32_t group = 0; group < counts.size(); group++) {
+                        if (counts[group] != 0) {
+                            const SharedCount shared{.group = group, .count = counts[group]};
+                            answer.append(reinterpret_cast<const char *>(&shared), sizeof(shared));
+                        }
+                    }
+                } else {
+                    throw std::runtime_error("Unknown request " + std::to_string(static_cast<uint32_t>(frame.type)));
+                }
+            } catch (const std::exception &e) {
+                type = FrameType::Error;
+                answer = e.what();
+            }
+            sendFrame(socket, type, answer.data(), answer.size());
+        }
+    }
+
+    ShardServer::ShardServer(const std::filesystem::path &shard, const std::string_view address,
+                             const MadvisePolicy &policy)
+        : index(std::make_shared<const MappedIndex>(shard, policy)), address(ShardAddress::parse(address)) {
+        if (index->hashCount() == 0) {
+            throw std::runtime_error("Shard " + shard.string() + " holds no hashes");
+        }
+        listener = openSocket(this->address, true);
+    }
+
+    ShardServer::~ShardServer() {
+        close(listener);
+        if (address.local) {
+            std::error_code error;
+            std::filesystem::remove(address.path, error);
+        }
+    }
+
+    void ShardServer::serve() {
+        for (;;) {
+            const int client = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+            if (client < 0) {
+                // Interrupted, or the coordinator gave up before the connection was accepted
+                if (errno == EINTR || errno == ECONNABORTED) {
+                    continue;
+                }
+                throw std::system_error(errno, std::generic_category(), "Failed to accept on " + address.toString());
+            }
+            if (!address.local) {
+                const int one = 1;
+                setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            }
+            // Shares the index, so connections may outlive the server
+            std::thread([index = index, client] {
+                const Descriptor socket(client);
+                try {
+                    serveConnection(*index, socket.get());
+                } catch (const std::exception &) {
+                    // A broken connection only ends itself
+                }
+            }).detach();
+        }
+    }
+
+    // Payload of the answer to a request, throws the message of an error answer
+    static std::vector<char> receiveAnswer(const int socket, const FrameType expected, const ShardAddress &address) {
+        Frame frame{};
+        std::vector<char> payload;
+        if (!receiveFrame(socket, frame, payload)) {
+            throw std::runtime_error("Shard " + address.toString() + " closed the connection");
+        }
+        if (frame.type == FrameType::Error) {
+            const std::string message(payload.begin(), payload.end());
+            throw std::runtime_error("Shard " + address.toString() + ": " + message);
+        }
+        if (frame.type != expected) {
+            throw std::runtime_error("Unexpected answer from shard " + address.toString());
+        }
+        return payload;
+    }
+
+    ShardedIndex::ShardedIndex(const std::span<const std::string> addresses) {
+        if (addresses.empty()) {
+            throw std::invalid_argument("Expected at least one shard");
+        }
+        uint16_t shardCount = 0;
+        try {
+            for (const auto &text: addresses) {
+                auto &shard = shards.emplace_back(Shard{.address = ShardAddress::parse(text)});
+                const auto where = shard.address.toString();
+                const auto socket = connection(shard);
+                sendFrame(socket, FrameType::Describe, nullptr, 0);
+                const auto payload = receiveAnswer(socket, FrameType::Describe, shard.address);
+
+                ShardDescription description{};
+                if (payload.size() >= sizeof(description)) {
+                    std::memcpy(&description, payload.data(), sizeof(description));
+                }
+                if (payload.size() < sizeof(description)
+                    || std::memcmp(description.magic, ShardDescription::expectedMagic, sizeof(description.magic)) != 0
+                    || description.version != ShardDescription::currentVersion) {
+                    throw std::runtime_error("Shard " + where + " speaks another protocol");
+                }
+                const size_t groupCount = description.groupCount;
+                if (payload.size() != sizeof(description) + (2 * groupCount + 1) * sizeof(uint32_t)
+                                      + description.namesSize || description.hashCount == 0) {
+                    throw std::runtime_error("Invalid description from shard " + where);
+                }
+                std::vector<uint32_t> sizes(groupCount), offsets(groupCount + 1);
+                const auto *data = payload.data() + sizeof(description);
+                std::memcpy(sizes.data(), data, sizes.size() * sizeof(uint32_t));
+                data += sizes.size() * sizeof(uint32_t);
+                std::memcpy(offsets.data(), data, offsets.size() * sizeof(uint32_t));
+                data += offsets.size() * sizeof(uint32_t);
+                std::vector<std::string> shardNames;
+                for (size_t group = 0; group < groupCount; group++) {
+                    if (offsets[group] > offsets[group + 1] || offsets[group + 1] > description.namesSize) {
+                        throw std::runtime_error("Invalid description from shard " + where);
+                    }
+                    shardNames.emplace_back(data + offsets[group], data + offsets[group + 1]);
+                }
+
+                if (&shard == &shards.front()) {
+                    k_ = description.k;
+                    w_ = description.w;
+                    shardCount = description.shardCount;
+                    groupSizes = std::move(sizes);
+                    names = std::move(shardNames);
+                } else if (description.k != k_ || description.w != w_ || description.shardCount != shardCount
+                           || sizes != groupSizes || shardNames != names) {
+                    throw std::runtime_error("Shard " + where + " belongs to another index than "
+                                             + shards.front().address.toString());
+                }
+                shard.number = description.shard;
+                shard.firstHash = description.firstHash;
+                shard.lastHash = description.lastHash;
+                shard.hashCount = description.hashCount;
+            }
+
+            // Every shard exactly once, a missing one would silently lose its matches
+            std::ranges::sort(shards, {}, &Shard::number);
+            for (size_t i = 0; i < shards.size(); i++) {
+                if (shards.size() != shardCount || shards[i].number != i) {
+                    throw std::runtime_error("Expected each of the " + std::to_string(shardCount)
+                                             + " shards of the index once");
+                }
+            }
+        } catch (...) {
+            disconnect();
+            throw;
+        }
+    }
+
+    ShardedIndex::~ShardedIndex() {
+        disconnect();
+    }
+
+    int ShardedIndex::connection(Shard &shard) {
+        if (shard.socket < 0) {
+            shard.socket = openSocket(shard.address, false);
+        }
+        return shard.socket;
+    }
+
+    void ShardedIndex::disconnect() {
+        for (auto &shard: shards) {
+            if (shard.socket >= 0) {
+                close(shard.socket);
+                shard.socket = -1;
+            }
+        }
+    }
+
+    uint64_t ShardedIndex::hashCount() const {
+        uint64_t count = 0;
+        for (const auto &shard: shards) {
+            count += shard.hashCount;
+        }
+        return count;
+    }
+
+    void ShardedIndex::countShared(const std::span<const uint64_t> fingerprints, const std::span<uint32_t> counts) {
+        if (counts.size() != groupCount()) {
+            throw std::invalid_argument("Expected one counter per group");
+        }
+        std::ranges::fill(counts, 0);
+
+        // Each shard gets the fingerprints from its first hash up to the next shard's, those outside the hashes of
+        // their shard cannot match and stay here. Duplicates are kept, as countShared counts them twice.
+        std::vector<std::vector<uint64_t>> parts(shards.size());
+        {
+            DOLOS_TRACE("shard.route", "lookup");
+            for (const auto hash: fingerprints) {
+                const auto next = std::ranges::upper_bound(shards, hash, {}, &Shard::firstHash);
+                if (next != shards.begin() && hash <= std::prev(next)->lastHash) {
+                    parts[next - shards.begin() - 1].emplace_back(hash);
+                }
+            }
+        }
+
+        std::lock_guard lock(mutex);
+        try {
+            // All requests go out before the first answer is read, so the shards count at the same time
+            {
+                DOLOS_TRACE("shard.scatter", "io");
+                for (size_t i = 0; i < shards.size(); i++) {
+                    if (!parts[i].empty()) {
+                        sendFrame(connection(shards[i]), FrameType::Count, parts[i].data(),
+                                  parts[i].size() * sizeof(uint64_t));
+                    }
+                }
+            }
+            DOLOS_TRACE("shard.gather", "io");
+            for (size_t i = 0; i < shards.size(); i++) {
+                if (parts[i].empty()) {
+                    continue;
+                }
+                const auto payload = receiveAnswer(shards[i].socket, FrameType::Count, shards[i].address);
+                if (payload.size() % sizeof(SharedCount) != 0) {
+                    throw std::runtime_error("Invalid counts from shard " + shards[i].address.toString());
+                }
+                for (size_t offset = 0; offset < payload.size(); offset += sizeof(SharedCount)) {
+                    SharedCount shared{};
+                    std::memcpy(&shared, payload.data() + offset, sizeof(shared));
+                    if (shared.group >= counts.size()) {
+                        throw std::runtime_error("Invalid counts from shard " + shards[i].address.toString());
+                    }
+                    counts[shared.group] += shared.count;
+                }
+            }
+        } catch (...) {
+            // Unread answers would be taken for those of the next request
+            disconnect();
+            throw;
+        }
+    }
+
+    std::vector<Pair> ShardedIndex::matchExternal(const std::span<const char> sourceCode) {
+        return matchTokens(tokenize(sourceCode));
+    }
+
+    std::vector<Pair> ShardedIndex::matchTokens(const TokenizedFile &tokens) {
+        const auto fingerprints = fingerprint(tokens, k_, w_);
+        return matchHashes(fingerprints);
+    }
+
+    std::vector<Pair> ShardedIndex::matchHashes(const std::span<const uint64_t> fingerprints) {
+        std::vector<uint32_t> sharedHashes(groupCount());
+        countShared(fingerprints, sharedHashes);
+
+        DOLOS_TRACE("emit.pairs", "emit");
+        const std::string external = "external";
+        const auto total = static_cast<uint32_t>(fingerprints.size());
+        std::vector<Pair> pairs;
+        pairs.reserve(groupCount());
+        for (uint32_t identifier = 0; identifier < groupCount(); identifier++) {
+            pairs.emplace_back(Pair{
+                .left = external,
+                .right = names[identifier],
+                .covered = sharedHashes[identifier],
+                .leftTotal = total,
+                .rightTotal = groupSizes[identifier],
+            });
+        }
+        return pairs;
+    }
+}
@@ -0,0 +1,112 @@
+#ifndef SHARD_H
+#define SHARD_H
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "binary.h"
+#include "index.h"
+#include "tokenizer.h"
+
+namespace dolos {
+    // Splits a binary index into count shards of about the same number of hashes, each a binary index of its own
+    // holding one contiguous range of hashes with the postings encoding of the source. Groups, names and group sizes
+    // are those of the whole index, so every shard reports the global totals; the hierarchy is left out. Each shard
+    // is built in memory and written as <prefix>.shard<i>.bin, returns the paths in hash order.
+    std::vector<std::filesystem::path> splitBinary(const MappedIndex &index, size_t count,
+                                                   const std::filesystem::path &prefix);
+
+    // A Unix socket path (anything with a '/', or unix:<path>) or host:port for TCP
+    struct ShardAddress {
+        bool local = false;
+        std::string path;
+        std::string host, port;
+
+        static ShardAddress parse(std::string_view address);
+
+        std::string toString() const;
+    };
+
+    // Serves countShared of one shard to coordinators. Requests are length prefixed frames in host byte order, so
+    // shard and coordinator hosts need the same endianness.
+    class ShardServer {
+        std::shared_ptr<const MappedIndex> index;
+        ShardAddress address;
+        int listener = -1;
+
+    public:
+        ShardServer(const std::filesystem::path &shard, std::string_view address, const MadvisePolicy &policy = {});
+
+        ShardServer(const ShardServer &) = delete;
+        ShardServer &operator=(const ShardServer &) = delete;
+
+        // Closes the listening socket and removes a Unix socket file
+        ~ShardServer();
+
+        const MappedIndex &shard() const { return *index; }
+
+        // Accepts connections forever, each served by a thread of its own
+        [[noreturn]] void serve();
+    };
+
+    // Coordinator over the shard servers of one index: splits the fingerprints of a file by hash range, sends each
+    // shard its part and sums the per-group counts. The results are those of a MappedIndex on the unsplit index.
+    // Keeps one connection per shard, requests of several threads take turns, and a failed request reconnects on the
+    // next call.
+    class ShardedIndex {
+        struct Shard {
+            ShardAddress address;
+            int socket = -1;
+            uint16_t number = 0;
+            uint64_t firstHash = 0, lastHash = 0, hashCount = 0;
+        };
+
+        std::vector<Shard> shards;
+        uint16_t k_, w_;
+        std::vector<uint32_t> groupSizes;
+        std::vector<std::string> names;
+        std::mutex mutex;
+
+        // Connection of the shard, opened if needed
+        int connection(Shard &shard);
+
+        void disconnect();
+
+    public:
+        // Connects to all shards and checks they cover disjoint hash ranges of the same index
+        explicit ShardedIndex(std::span<const std::string> addresses);
+
+        ShardedIndex(const ShardedIndex &) = delete;
+        ShardedIndex &operator=(const ShardedIndex &) = delete;
+
+        ~ShardedIndex();
+
+        uint16_t k() const { return k_; }
+        uint16_t w() const { return w_; }
+        uint32_t groupCount() const { return static_cast<uint32_t>(names.size()); }
+        size_t shardCount() const { return shards.size(); }
+
+        uint64_t hashCount() const;
+
+        std::string_view name(uint16_t group) const { return names.at(group); }
+
+        uint32_t groupSize(uint16_t group) const { return groupSizes.at(group); }
+
+        std::vector<Pair> matchExternal(std::span<const char> sourceCode);
+
+        std::vector<Pair> matchTokens(const TokenizedFile &tokens);
+
+        std::vector<Pair> matchHashes(std::span<const uint64_t> fingerprints);
+
+        // Shared hashes per group, counts needs exactly groupCount() entries
+        void countShared(std::span<const uint64_t> fingerprints, std::span<uint32_t> counts);
+    };
+}
+
+#endif //SHARD_H
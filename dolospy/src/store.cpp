@@ -0,0 +1,387 @@
+#include "store.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <optional>
+#include <ranges>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef DOLOS_HAVE_LZMA
+#include <lzma.h>
+#endif
+
+#include "batchio.h"
+#include "trace.h"
+
+namespace dolos {
+#ifdef DOLOS_HAVE_LZMA
+    std::string xzCompress(const std::span<const char> data, const uint32_t preset) {
+        DOLOS_TRACE("store.compress", "compress");
+        // The stream encoder, not lzma_easy_buffer_encode, whose block headers differ from Python's output
+        lzma_stream stream = LZMA_STREAM_INIT;
+        if (const auto ret = lzma_easy_encoder(&stream, preset, LZMA_CHECK_CRC64); ret != LZMA_OK) {
+            throw std::runtime_error("xz encoder failed: " + std::to_string(ret));
+        }
+        std::string result(lzma_stream_buffer_bound(data.size()), '\0');
+        stream.next_in = reinterpret_cast<const uint8_t *>(data.data());
+        stream.avail_in = data.size();
+        stream.next_out = reinterpret_cast<uint8_t *>(result.data());
+        stream.avail_out = result.size();
+        const auto ret = lzma_code(&stream, LZMA_FINISH);
+        result.resize(stream.total_out);
+        lzma_end(&stream);
+        if (ret != LZMA_STREAM_END) {
+            throw std::runtime_error("xz compression failed: " + std::to_string(ret));
+        }
+        return result;
+    }
+
+    std::string xzDecompress(const std::span<const char> data) {
+        lzma_stream stream = LZMA_STREAM_INIT;
+        if (const auto ret = lzma_stream_decoder(&stream, UINT64_MAX, LZMA_CONCATENATED); ret != LZMA_OK) {
+            throw std::runtime_error("xz decoder failed: " + std::to_string(ret));
+        }
+        std::string result(std::max<size_t>(data.size() * 4, 4096), '\0');
+        stream.next_in = reinterpret_cast<const uint8_t *>(data.data());
+        stream.avail_in = data.size();
+        lzma_ret ret = LZMA_OK;
+        while (ret == LZMA_OK) {
+            if (stream.total_out == result.size()) {
+                result.resize(result.size() * 2);
+            }
+            stream.next_out = reinterpret_cast<uint8_t *>(result.data()) + stream.total_out;
+            stream.avail_out = result.size() - stream.total_out;
+            ret = lzma_code(&stream, stream.avail_in == 0 ? LZMA_FINISH : LZMA_RUN);
+        }
+        result.resize(stream.total_out);
+        lzma_end(&stream);
+        if (ret != LZMA_STREAM_END) {
+            throw std::runtime_error("xz decompression failed: " + std::to_string(ret));
+        }
+        return result;
+    }
+#else
+    std::string xzCompress(std::span<const char>, uint32_t) {
+        throw std::runtime_error("dolos was built without liblzma");
+    }
+
+    std::string xzDecompress(std::span<const char>) {
+        throw std::runtime_error("dolos was built without liblzma");
+    }
+#endif
+
+    static std::filesystem::path packPath(const std::filesystem::path &directory, const uint32_t pack,
+                                          const char *extension) {
+        char name[32];
+        std::snprintf(name, sizeof(name), "pack-%06u.%s", pack, extension);
+        return directory / name;
+    }
+
+    // Number of pack-<n>.idx, empty for any other name
+    static std::optional<uint32_t> packNumber(const std::string &name) {
+        if (!name.starts_with("pack-") || !name.ends_with(".idx")) {
+            return std::nullopt;
+        }
+        uint32_t number = 0;
+        const char *begin = name.data() + 5, *end = name.data() + name.size() - 4;
+        const auto [ptr, error] = std::from_chars(begin, end, number);
+        if (error != std::errc() || ptr != end) {
+            return std::nullopt;
+        }
+        return number;
+    }
+
+    static void writeAll(const int fd, const char *data, size_t size, const std::optional<uint64_t> offset,
+                         const std::filesystem::path &path) {
+        uint64_t position = offset.value_or(0);
+        while (size > 0) {
+            const auto n = offset ? pwrite(fd, data, size, static_cast<off_t>(position)) : write(fd, data, size);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                throw std::system_error(n < 0 ? errno : EIO, std::generic_category(),
+                                        "Failed to write " + path.string());
+            }
+            data += n;
+            size -= static_cast<size_t>(n);
+            position += static_cast<uint64_t>(n);
+        }
+    }
+
+    std::unordered_map<std::string, PackLocation> readPackIndexes(const std::filesystem::path &directory,
+                                                                  uint32_t &packCount) {
+        std::unordered_map<std::string, PackLocation> locations;
+        packCount = 0;
+        if (!std::filesystem::is_directory(directory)) {
+            return locations;
+        }
+
+        for (const auto &file: std::filesystem::directory_iterator(directory)) {
+            const auto pack = packNumber(file.path().filename().string());
+            if (!pack) {
+                continue;
+            }
+            packCount = std::max(packCount, *pack + 1);
+
+            std::error_code error;
+            const auto packSize = std::filesystem::file_size(packPath(directory, *pack, "pack"), error);
+            if (error) {
+                std::cerr << "Skipping " << file.path().string() << ": " << error.message() << std::endl;
+                continue;
+            }
+            const auto [data, readError] = readWithPread(file.path());
+            if (readError != 0) {
+                throw std::system_error(readError, std::generic_category(), "Failed to read " + file.path().string());
+            }
+
+            PackIndexHeader header{};
+            if (data.size() < sizeof(header)) {
+                continue;
+            }
+            std::memcpy(&header, data.data(), sizeof(header));
+            if (std::memcmp(header.magic, PackIndexHeader::expectedMagic, sizeof(header.magic)) != 0
+                || header.version != PackIndexHeader::currentVersion) {
+                throw std::runtime_error("Not a pack index: " + file.path().string());
+            }
+
+            // A crash may leave a partial entry at the end, and entries whose data never reached the pack
+            for (size_t position = sizeof(header); position + sizeof(PackIndexEntry) <= data.size();) {
+                PackIndexEntry entry{};
+                std::memcpy(&entry, data.data() + position, sizeof(entry));
+                position += sizeof(entry);
+                if (entry.keyLength > data.size() - position) {
+                    break;
+                }
+                std::string key(data.data() + position, entry.keyLength);
+                position += entry.keyLength;
+                if (entry.offset > packSize || entry.size > packSize - entry.offset) {
+                    continue;
+                }
+                locations.insert_or_assign(std::move(key), PackLocation{*pack, entry.offset, entry.size});
+            }
+        }
+        return locations;
+    }
+
+    PackWriter::PackWriter(std::filesystem::path directory, const PackWriterOptions &options, const bool seedLoose)
+        : directory(std::move(directory)), options(options) {
+        std::filesystem::create_directories(this->directory);
+        for (auto &key: readPackIndexes(this->directory, packNumber) | std::views::keys) {
+            keys.emplace(std::move(key));
+        }
+        if (seedLoose) {
+            for (const auto &file: std::filesystem::directory_iterator(this->directory)) {
+                auto name = file.path().filename().string();
+                if (file.is_regular_file() && !name.starts_with("pack-")) {
+                    keys.emplace(std::move(name));
+                }
+            }
+        }
+
+        const unsigned threads = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+        for (unsigned i = 0; i < threads; i++) {
+            workers.emplace_back([this] { work(); });
+        }
+    }
+
+    PackWriter::~PackWriter() {
+        try {
+            flush();
+        } catch (const std::exception &e) {
+            std::cerr << "Pack writer failed: " << e.what() << std::endl;
+        }
+        {
+            std::lock_guard lock(mutex);
+            stopping = true;
+        }
+        queueChanged.notify_all();
+        workers.clear();
+        closePack();
+    }
+
+    void PackWriter::openPack() {
+        const auto pack = packPath(directory, packNumber, "pack");
+        const auto index = packPath(directory, packNumber, "idx");
+        // Exclusive, two writers on one directory would corrupt each other's packs
+        packFd = open(pack.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        if (packFd < 0) {
+            throw std::system_error(errno, std::generic_category(), "Failed to create " + pack.string());
+        }
+        indexFd = open(index.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_APPEND | O_CLOEXEC, 0644);
+        if (indexFd < 0) {
+            throw std::system_error(errno, std::generic_category(), "Failed to create " + index.string());
+        }
+        PackIndexHeader header{};
+        std::memcpy(header.magic, PackIndexHeader::expectedMagic, sizeof(header.magic));
+        header.version = PackIndexHeader::currentVersion;
+        writeAll(indexFd, reinterpret_cast<const char *>(&header), sizeof(header), std::nullopt, index);
+        packOffset = 0;
+        packNumber++;
+    }
+
+    void PackWriter::closePack() {
+        if (packFd >= 0) {
+            fsync(packFd);
+            close(packFd);
+            packFd = -1;
+        }
+        if (indexFd >= 0) {
+            fsync(indexFd);
+            close(indexFd);
+            indexFd = -1;
+        }
+    }
+
+    void PackWriter::append(const std::string &key, const std::string &compressed) {
+        DOLOS_TRACE("store.append", "io");
+        std::lock_guard lock(appendMutex);
+        if (packFd < 0 || packOffset >= options.packSize) {
+            closePack();
+            openPack();
+        }
+        const auto pack = packPath(directory, packNumber - 1, "pack");
+        writeAll(packFd, compressed.data(), compressed.size(), packOffset, pack);
+
+        std::string record(sizeof(PackIndexEntry) + key.size(), '\0');
+        const PackIndexEntry entry{.offset = packOffset, .size = compressed.size(),
+                                   .keyLength = static_cast<uint32_t>(key.size()), .reserved = 0};
+        std::memcpy(record.data(), &entry, sizeof(entry));
+        std::memcpy(record.data() + sizeof(entry), key.data(), key.size());
+        writeAll(indexFd, record.data(), record.size(), std::nullopt, packPath(directory, packNumber - 1, "idx"));
+        packOffset += compressed.size();
+    }
+
+    void PackWriter::work() {
+        while (true) {
+            Job job;
+            {
+                std::unique_lock lock(mutex);
+                queueChanged.wait(lock, [&] { return stopping || !queue.empty(); });
+                if (queue.empty()) {
+                    return;
+                }
+                job = std::move(queue.front());
+                queue.pop_front();
+            }
+            queueChanged.notify_all();
+
+            try {
+                const auto compressed = job.compressed ? std::move(job.data) : xzCompress(job.data, options.preset);
+                append(job.key, compressed);
+                std::lock_guard lock(mutex);
+                counters.bytesOut += compressed.size();
+            } catch (...) {
+                std::lock_guard lock(mutex);
+                // Nothing of the object was indexed, a later put must store it again
+                keys.erase(job.key);
+                if (!failure) {
+                    failure = std::current_exception();
+                }
+            }
+
+            {
+                std::lock_guard lock(mutex);
+                pending--;
+            }
+            queueChanged.notify_all();
+        }
+    }
+
+    bool PackWriter::enqueue(std::string key, std::string data, const bool compressed) {
+        if (key.empty() || key.find('/') != std::string::npos) {
+            throw std::invalid_argument("Invalid object key: " + key);
+        }
+        std::unique_lock lock(mutex);
+        if (failure) {
+            std::rethrow_exception(failure);
+        }
+        if (keys.contains(key)) {
+            counters.hits++;
+            return false;
+        }
+        keys.emplace(key);
+        counters.misses++;
+        counters.bytesIn += data.size();
+
+        queueChanged.wait(lock, [&] { return queue.size() < options.queueLength; });
+        queue.emplace_back(Job{.key = std::move(key), .data = std::move(data), .compressed = compressed});
+        pending++;
+        lock.unlock();
+        queueChanged.notify_all();
+        return true;
+    }
+
+    bool PackWriter::put(std::string key, std::string data) {
+        return enqueue(std::move(key), std::move(data), false);
+    }
+
+    bool PackWriter::putCompressed(std::string key, std::string compressed) {
+        return enqueue(std::move(key), std::move(compressed), true);
+    }
+
+    bool PackWriter::contains(const std::string &key) {
+        std::lock_guard lock(mutex);
+        return keys.contains(key);
+    }
+
+    void PackWriter::flush() {
+        {
+            std::unique_lock lock(mutex);
+            queueChanged.wait(lock, [&] { return pending == 0; });
+            if (failure) {
+                std::rethrow_exception(std::exchange(failure, nullptr));
+            }
+        }
+        std::lock_guard lock(appendMutex);
+        if (packFd >= 0 && (fdatasync(packFd) != 0 || fdatasync(indexFd) != 0)) {
+            throw std::system_error(errno, std::generic_category(), "Failed to sync pack");
+        }
+    }
+
+    PackWriterStats PackWriter::stats() {
+        std::lock_guard lock(mutex);
+        return counters;
+    }
+
+    PackReader::PackReader(const std::filesystem::path &directory, const Advice advice) {
+        uint32_t packCount = 0;
+        locations = readPackIndexes(directory, packCount);
+        packs.resize(packCount);
+        for (uint32_t pack = 0; pack < packCount; pack++) {
+            if (const auto path = packPath(directory, pack, "pack"); std::filesystem::exists(path)) {
+                packs[pack] = MappedFile(path);
+                packs[pack].advise(advice);
+            }
+        }
+    }
+
+    std::span<const char> PackReader::compressed(const std::string &key) const {
+        const auto it = locations.find(key);
+        if (it == locations.end()) {
+            return {};
+        }
+        const auto &[pack, offset, size] = it->second;
+        return packs[pack].data().subspan(offset, size);
+    }
+
+    std::vector<std::string> PackReader::keys() const {
+        std::vector<std::string> result;
+        result.reserve(locations.size());
+        for (const auto &key: locations | std::views::keys) {
+            result.emplace_back(key);
+        }
+        std::ranges::sort(result);
+        return result;
+    }
+}
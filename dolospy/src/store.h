@@ -0,0 +1,155 @@
+#ifndef STORE_H
+#define STORE_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "mapped.h"
+
+namespace dolos {
+    // xz compression as done by Python's lzma.compress, so objects decompress the same from packs and loose files
+    std::string xzCompress(std::span<const char> data, uint32_t preset = 6);
+
+    std::string xzDecompress(std::span<const char> data);
+
+    // Object store of content addressed objects in pack files. Every pack-<n>.pack holds the xz streams of its
+    // objects back to back, pack-<n>.idx lists key, offset and size of each. An index entry is only written after its
+    // data, so a crash at most loses the objects whose entries are missing.
+    struct PackIndexHeader {
+        static constexpr char expectedMagic[8] = {'D', 'O', 'L', 'O', 'S', 'P', 'K', 'I'};
+        static constexpr uint32_t currentVersion = 1;
+
+        char magic[8];
+        uint32_t version;
+        uint32_t reserved;
+    };
+
+    // Followed by keyLength bytes of key
+    struct PackIndexEntry {
+        uint64_t offset;
+        uint64_t size;
+        uint32_t keyLength;
+        uint32_t reserved;
+    };
+
+    struct PackLocation {
+        uint32_t pack;
+        uint64_t offset, size;
+    };
+
+    // Index entries of all packs in the directory, entries pointing past the end of their pack are dropped
+    std::unordered_map<std::string, PackLocation> readPackIndexes(const std::filesystem::path &directory,
+                                                                  uint32_t &packCount);
+
+    struct PackWriterOptions {
+        // A new pack is started once the current one exceeds this size
+        uint64_t packSize = 1ull << 30;
+        // Compression threads, 0 for one per core
+        unsigned threads = 0;
+        uint32_t preset = 6;
+        // Objects waiting for compression before put blocks
+        size_t queueLength = 1024;
+    };
+
+    struct PackWriterStats {
+        uint64_t hits = 0, misses = 0;
+        uint64_t bytesIn = 0, bytesOut = 0;
+    };
+
+    // Appends objects to the packs of a directory. Keys already in the store (or queued) are skipped, the rest is
+    // compressed on a thread pool and appended by whichever thread finishes it.
+    class PackWriter {
+        struct Job {
+            std::string key;
+            std::string data;
+            bool compressed;
+        };
+
+        std::filesystem::path directory;
+        PackWriterOptions options;
+
+        // Guards everything below up to the workers
+        std::mutex mutex;
+        std::condition_variable queueChanged;
+        std::deque<Job> queue;
+        size_t pending = 0;
+        bool stopping = false;
+        std::exception_ptr failure;
+        std::unordered_set<std::string> keys;
+        PackWriterStats counters;
+
+        // Guards the current pack and its index
+        std::mutex appendMutex;
+        uint32_t packNumber = 0;
+        int packFd = -1, indexFd = -1;
+        uint64_t packOffset = 0;
+
+        std::vector<std::jthread> workers;
+
+        void openPack();
+
+        void closePack();
+
+        void append(const std::string &key, const std::string &compressed);
+
+        void work();
+
+        bool enqueue(std::string key, std::string data, bool compressed);
+
+    public:
+        // Loads the keys of existing packs, and of loose objects (one compressed file per key) if seedLoose is set
+        explicit PackWriter(std::filesystem::path directory, const PackWriterOptions &options = {},
+                            bool seedLoose = false);
+
+        PackWriter(const PackWriter &) = delete;
+        PackWriter &operator=(const PackWriter &) = delete;
+
+        // Waits for all queued objects
+        ~PackWriter();
+
+        // Queues the object for compression, false if the key is already stored. Blocks while the queue is full.
+        bool put(std::string key, std::string data);
+
+        // Stores an already xz compressed object as is, as when importing loose objects
+        bool putCompressed(std::string key, std::string compressed);
+
+        bool contains(const std::string &key);
+
+        // Waits until every queued object is written and synced, rethrows the first failure of a worker
+        void flush();
+
+        PackWriterStats stats();
+    };
+
+    // Read access to the packs of a directory
+    class PackReader {
+        std::unordered_map<std::string, PackLocation> locations;
+        std::vector<MappedFile> packs;
+
+    public:
+        // The advice applies to the pack files, lookups touch one object each so readahead rarely helps
+        explicit PackReader(const std::filesystem::path &directory, Advice advice = Advice::Random);
+
+        size_t size() const { return locations.size(); }
+
+        bool contains(const std::string &key) const { return locations.contains(key); }
+
+        // The xz stream of the object, empty if the key is not stored
+        std::span<const char> compressed(const std::string &key) const;
+
+        std::vector<std::string> keys() const;
+    };
+}
+
+#endif //STORE_H
@@ -3,8 +3,11 @@
 #include <tree_sitter/api.h>
 #include <tree_sitter/tree-sitter-javascript.h>
 
+#include "trace.h"
+
 namespace dolos {
     std::vector<uint16_t> tokenize(const std::span<const char> buffer) {
+        DOLOS_TRACE("tokenize", "parse");
         TSParser *parser = ts_parser_new();
         ts_parser_set_language(parser, tree_sitter_javascript());
         TSTree *tree = ts_parser_parse_string(parser, nullptr, buffer.data(), buffer.size());
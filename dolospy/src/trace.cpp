@@ -0,0 +1,224 @@
+#include "trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <pthread.h>
+#include <unistd.h>
+
+namespace dolos {
+    std::atomic<bool> tracingEnabled{false};
+
+    namespace {
+        struct Event {
+            const char *name;
+            const char *category;
+            uint64_t start, end;
+        };
+
+        struct ThreadBuffer {
+            pid_t tid;
+            std::string threadName;
+            // Taken by the owning thread for every event, so it is only contended while writeTrace copies the buffer
+            std::mutex mutex;
+            // Trace the events belong to, a buffer of an older trace is reset on its next event
+            uint64_t generation = 0;
+            // Grows up to capacity events, then the oldest are overwritten
+            std::vector<Event> events;
+            size_t capacity = 0;
+            // Events recorded in this trace, the slot of the next one is count % capacity
+            uint64_t count = 0;
+            // The thread exited, nothing is recorded into the buffer anymore
+            bool finished = false;
+        };
+
+        std::mutex buffersMutex;
+        // Buffers outlive their threads, so the events of finished workers still end up in the trace. Buffers of
+        // finished threads are dropped by the next startTracing.
+        std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+        std::atomic<uint64_t> traceGeneration{0};
+        std::atomic<size_t> traceCapacity{1 << 16};
+        std::atomic<uint64_t> traceOrigin{0};
+
+        void releaseBuffer(const std::shared_ptr<ThreadBuffer> &buffer);
+
+        // Hands the buffer back when its thread exits, so short-lived threads do not keep their events forever
+        struct LocalBuffer {
+            std::shared_ptr<ThreadBuffer> buffer;
+
+            ~LocalBuffer() {
+                if (buffer) {
+                    releaseBuffer(buffer);
+                }
+            }
+        };
+
+        thread_local LocalBuffer localBuffer;
+
+        uint64_t now() {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        ThreadBuffer &threadBuffer() {
+            if (!localBuffer.buffer) {
+                auto buffer = std::make_shared<ThreadBuffer>();
+                buffer->tid = gettid();
+                char name[16] = {};
+                if (pthread_getname_np(pthread_self(), name, sizeof(name)) == 0) {
+                    buffer->threadName = name;
+                }
+                std::lock_guard lock(buffersMutex);
+                buffers.emplace_back(buffer);
+                localBuffer.buffer = std::move(buffer);
+            }
+            return *localBuffer.buffer;
+        }
+
+        // Events of the current trace stay until the next startTracing, anything older is dropped right away
+        void releaseBuffer(const std::shared_ptr<ThreadBuffer> &buffer) {
+            std::lock_guard lock(buffersMutex);
+            std::lock_guard bufferLock(buffer->mutex);
+            if (buffer->generation != traceGeneration.load(std::memory_order_acquire) || buffer->count == 0) {
+                std::erase(buffers, buffer);
+                return;
+            }
+            buffer->finished = true;
+            buffer->events.shrink_to_fit();
+        }
+
+        void writeString(std::ostream &out, const std::string_view value) {
+            out << '"';
+            for (const char c: value) {
+                if (c == '"' || c == '\\') {
+                    out << '\\' << c;
+                } else if (static_cast<unsigned char>(c) >= 0x20) {
+                    out << c;
+                }
+            }
+            out << '"';
+        }
+
+        // Chrome traces use microseconds
+        void writeTimestamp(std::ostream &out, const uint64_t nanoseconds) {
+            out << nanoseconds / 1000 << '.' << std::setw(3) << std::setfill('0') << nanoseconds % 1000
+                    << std::setfill(' ');
+        }
+    }
+
+    void startTracing(const size_t eventsPerThread) {
+        {
+            std::lock_guard lock(buffersMutex);
+            traceCapacity = std::max<size_t>(1, eventsPerThread);
+            traceOrigin = now();
+            traceGeneration.fetch_add(1, std::memory_order_release);
+            // The events of the previous trace are dropped, live threads grow their buffers again on the next event
+            std::erase_if(buffers, [](const std::shared_ptr<ThreadBuffer> &buffer) {
+                std::lock_guard bufferLock(buffer->mutex);
+                if (buffer->finished) {
+                    return true;
+                }
+                buffer->events = {};
+                buffer->count = 0;
+                return false;
+            });
+        }
+        tracingEnabled = true;
+    }
+
+    void stopTracing() {
+        tracingEnabled = false;
+    }
+
+    void TraceScope::begin() {
+        start = now();
+    }
+
+    void TraceScope::end() {
+        const auto stop = now();
+        auto &buffer = threadBuffer();
+
+        const auto generation = traceGeneration.load(std::memory_order_acquire);
+        std::lock_guard lock(buffer.mutex);
+        if (buffer.generation != generation) {
+            buffer.events.clear();
+            buffer.capacity = traceCapacity.load();
+            buffer.count = 0;
+            buffer.generation = generation;
+        }
+
+        const Event event{
+            .name = name,
+            .category = category,
+            .start = start,
+            .end = stop,
+        };
+        if (buffer.events.size() < buffer.capacity) {
+            buffer.events.emplace_back(event);
+        } else {
+            buffer.events[buffer.count % buffer.capacity] = event;
+        }
+        buffer.count++;
+    }
+
+    void writeTrace(std::ostream &out) {
+        std::lock_guard lock(buffersMutex);
+        const auto generation = traceGeneration.load(std::memory_order_acquire);
+        const auto origin = traceOrigin.load();
+        const auto pid = getpid();
+
+        uint64_t dropped = 0;
+        bool first = true;
+        const auto separator = [&] {
+            out << (first ? "\n" : ",\n");
+            first = false;
+        };
+
+        out << "{\"traceEvents\":[";
+        std::vector<Event> events;
+        for (const auto &buffer: buffers) {
+            // Threads still recording only wait for the copy, not for the output
+            {
+                std::lock_guard bufferLock(buffer->mutex);
+                if (buffer->generation != generation) {
+                    continue;
+                }
+                const auto capacity = buffer->capacity;
+                const auto begin = buffer->count > capacity ? buffer->count - capacity : 0;
+                dropped += begin;
+                events.clear();
+                for (auto i = begin; i < buffer->count; i++) {
+                    events.emplace_back(buffer->events[i % capacity]);
+                }
+            }
+
+            separator();
+            out << R"({"name":"thread_name","ph":"M","pid":)" << pid << R"(,"tid":)" << buffer->tid
+                    << R"(,"args":{"name":)";
+            writeString(out, buffer->threadName.empty() ? "thread " + std::to_string(buffer->tid) : buffer->threadName);
+            out << "}}";
+
+            for (const auto &event: events) {
+                // Events that started before the trace was started are clipped to its beginning
+                const auto start = std::max(event.start, origin);
+                separator();
+                out << R"({"name":)";
+                writeString(out, event.name);
+                out << R"(,"cat":)";
+                writeString(out, event.category);
+                out << R"(,"ph":"X","ts":)";
+                writeTimestamp(out, start - origin);
+                out << R"(,"dur":)";
+                writeTimestamp(out, event.end - std::min(start, event.end));
+                out << R"(,"pid":)" << pid << R"(,"tid":)" << buffer->tid << "}";
+            }
+        }
+        out << "\n],\"displayTimeUnit\":\"ns\",\"otherData\":{\"droppedEvents\":" << dropped << "}}\n";
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+namespace dolos {
+    // Timeline of the native pipeline in the Chrome trace format, loadable in Perfetto or chrome://tracing.
+    // While tracing is enabled, every thread records its scoped events into its own ring buffer, so recording only
+    // takes the uncontended lock of that buffer. When a buffer is full, the oldest events of that thread are
+    // overwritten.
+
+    extern std::atomic<bool> tracingEnabled;
+
+    // Starts a new trace, dropping the events of the previous one
+    void startTracing(size_t eventsPerThread = 1 << 16);
+
+    void stopTracing();
+
+    // Writes the recorded events as Chrome trace JSON. Safe while threads are still recording, their events after
+    // the copy of their buffer are left out.
+    void writeTrace(std::ostream &out);
+
+    // Records the time between construction and destruction as one event of the current thread.
+    // Name and category must be string literals.
+    class TraceScope {
+        const char *name;
+        const char *category;
+        uint64_t start = 0;
+
+    public:
+        TraceScope(const char *name, const char *category) : name(name), category(category) {
+            if (tracingEnabled.load(std::memory_order_relaxed)) {
+                begin();
+            }
+        }
+
+        TraceScope(const TraceScope &) = delete;
+        TraceScope &operator=(const TraceScope &) = delete;
+
+        ~TraceScope() {
+            if (start != 0) {
+                end();
+            }
+        }
+
+    private:
+        void begin();
+
+        void end();
+    };
+}
+
+#define DOLOS_TRACE_CONCAT_(a, b) a##b
+#define DOLOS_TRACE_CONCAT(a, b) DOLOS_TRACE_CONCAT_(a, b)
+
+// Traces the rest of the enclosing scope, e.g. DOLOS_TRACE("tokenize", "parse")
+#define DOLOS_TRACE(name, category) const dolos::TraceScope DOLOS_TRACE_CONCAT(traceScope, __LINE__)(name, category)
+
+#endif //TRACE_H
@@ -0,0 +1,408 @@
+#include "zpack.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <utility>
+
+#ifdef DOLOS_HAVE_ZSTD
+#include <zdict.h>
+#include <zstd.h>
+#endif
+
+#include "batchio.h"
+#include "parallel.h"
+#include "store.h"
+#include "trace.h"
+
+namespace dolos {
+    std::string_view ZstdPack::key(const ZstdPackEntry &entry) const {
+        if (entry.keyOffset > keyData.size() || entry.keyLength > keyData.size() - entry.keyOffset) {
+            throw std::runtime_error("Corrupt zpack: key out of range");
+        }
+        return keyData.substr(entry.keyOffset, entry.keyLength);
+    }
+
+    const ZstdPackEntry *ZstdPack::find(const std::string_view key) const {
+        const auto it = std::ranges::lower_bound(entries, key, {}, [&](const ZstdPackEntry &entry) {
+            return this->key(entry);
+        });
+        return it != entries.end() && this->key(*it) == key ? &*it : nullptr;
+    }
+
+    std::vector<std::string> ZstdPack::keys() const {
+        std::vector<std::string> result;
+        result.reserve(entries.size());
+        for (const auto &entry: entries) {
+            result.emplace_back(key(entry));
+        }
+        return result;
+    }
+
+#ifdef DOLOS_HAVE_ZSTD
+    static constexpr size_t sectionAlignment = 64;
+
+    static size_t align(const size_t offset) {
+        return (offset + sectionAlignment - 1) / sectionAlignment * sectionAlignment;
+    }
+
+    template<typename T>
+    static std::span<const T> section(const std::span<const char> data, const uint64_t offset, const uint64_t count) {
+        if (offset % alignof(T) != 0 || offset > data.size() || count > (data.size() - offset) / sizeof(T)) {
+            throw std::runtime_error("Corrupt zpack: section out of bounds");
+        }
+        return {reinterpret_cast<const T *>(data.data() + offset), static_cast<size_t>(count)};
+    }
+
+    namespace {
+        // An xz object of the source store, mapped from a pack or tar, or a loose file read when needed
+        struct Input {
+            std::string key;
+            std::span<const char> data;
+            std::filesystem::path path;
+        };
+    }
+
+    static uint64_t tarNumber(const char *field, const size_t size) {
+        // GNU base-256 for sizes beyond the 8 GiB of octal fields
+        if (static_cast<unsigned char>(field[0]) & 0x80) {
+            uint64_t value = static_cast<unsigned char>(field[0]) & 0x7f;
+            for (size_t i = 1; i < size; i++) {
+                value = value << 8 | static_cast<unsigned char>(field[i]);
+            }
+            return value;
+        }
+        uint64_t value = 0;
+        for (size_t i = 0; i < size && field[i] != '\0'; i++) {
+            if (field[i] >= '0' && field[i] <= '7') {
+                value = value * 8 + static_cast<uint64_t>(field[i] - '0');
+            }
+        }
+        return value;
+    }
+
+    static std::string tarString(const char *field, const size_t size) {
+        return {field, strnlen(field, size)};
+    }
+
+    // path= record of a pax extended header
+    static std::string paxPath(const std::span<const char> records) {
+        std::string_view rest(records.data(), records.size());
+        while (!rest.empty()) {
+            const auto space = rest.find(' ');
+            size_t length = 0;
+            for (size_t i = 0; i < space && i < rest.size(); i++) {
+                length = length * 10 + static_cast<size_t>(rest[i] - '0');
+            }
+            if (space == std::string_view::npos || length <= space + 1 || length > rest.size()) {
+                break;
+            }
+            const auto record = rest.substr(space + 1, length - space - 2);
+            if (record.starts_with("path=")) {
+                return std::string(record.substr(5));
+            }
+            rest.remove_prefix(length);
+        }
+        return {};
+    }
+
+    // Regular files of a tar as written by tar -c of the store directory, keyed by file name
+    static void tarInputs(const std::span<const char> data, std::vector<Input> &inputs) {
+        constexpr size_t blockSize = 512;
+        std::string nextName;
+        for (size_t offset = 0; offset + blockSize <= data.size();) {
+            const char *block = data.data() + offset;
+            // Two zero blocks end the archive
+            if (block[0] == '\0') {
+                break;
+            }
+            const auto size = tarNumber(block + 124, 12);
+            const char type = block[156];
+            offset += blockSize;
+            if (size > data.size() - offset) {
+                throw std::runtime_error("Truncated tar member " + tarString(block, 100));
+            }
+            const auto content = data.subspan(offset, size);
+            offset += (size + blockSize - 1) / blockSize * blockSize;
+
+            // GNU long names and pax headers name the member that follows
+            if (type == 'L') {
+                nextName = tarString(content.data(), content.size());
+                continue;
+            }
+            if (type == 'x') {
+                nextName = paxPath(content);
+                continue;
+            }
+            std::string name = std::exchange(nextName, {});
+            if (name.empty()) {
+                name = tarString(block, 100);
+                if (std::memcmp(block + 257, "ustar", 5) == 0 && block[345] != '\0') {
+                    name = tarString(block + 345, 155) + "/" + name;
+                }
+            }
+            if (type != '0' && type != '\0' && type != '7') {
+                continue;
+            }
+            const auto slash = name.rfind('/');
+            auto key = slash == std::string::npos ? name : name.substr(slash + 1);
+            inputs.emplace_back(Input{.key = std::move(key), .data = content, .path = {}});
+        }
+    }
+
+    static size_t check(const size_t result, const char *what) {
+        if (ZSTD_isError(result)) {
+            throw std::runtime_error(std::string(what) + ": " + ZSTD_getErrorName(result));
+        }
+        return result;
+    }
+
+    static std::string decompressInput(const Input &input) {
+        if (input.path.empty()) {
+            return xzDecompress(input.data);
+        }
+        const auto [data, error] = readWithPread(input.path);
+        if (error != 0) {
+            throw std::system_error(error, std::generic_category(), "Failed to read " + input.path.string());
+        }
+        return xzDecompress(data);
+    }
+
+    // Samples spread evenly over all objects, the start of each as larger samples add little to training
+    static std::string trainDictionary(const std::vector<Input> &inputs, const ZstdPackOptions &options) {
+        DOLOS_TRACE("zpack.train", "compress");
+        constexpr size_t maxSamples = 16384;
+        const size_t count = std::min(inputs.size(), maxSamples);
+        const size_t sampleSize = std::clamp<size_t>(options.sampleBytes / std::max<size_t>(count, 1), 4 << 10,
+                                                     128 << 10);
+        std::vector<std::string> samples(count);
+        parallelFor(count, options.threads, [&](const size_t i) {
+            samples[i] = decompressInput(inputs[i * inputs.size() / count]);
+            samples[i].resize(std::min(samples[i].size(), sampleSize));
+        });
+
+        std::string buffer;
+        std::vector<size_t> sizes;
+        for (const auto &sample: samples) {
+            if (buffer.size() + sample.size() > options.sampleBytes) {
+                break;
+            }
+            buffer += sample;
+            sizes.emplace_back(sample.size());
+        }
+        // Too little input to train on, the frames are compressed without dictionary
+        if (sizes.size() < 8 || options.dictionarySize == 0) {
+            return {};
+        }
+        std::string dictionary(options.dictionarySize, '\0');
+        const auto size = ZDICT_trainFromBuffer(dictionary.data(), dictionary.size(), buffer.data(), sizes.data(),
+                                                static_cast<unsigned>(sizes.size()));
+        if (ZDICT_isError(size)) {
+            return {};
+        }
+        dictionary.resize(size);
+        return dictionary;
+    }
+
+    static std::vector<Input> collectInputs(const std::filesystem::path &source, std::unique_ptr<PackReader> &packs,
+                                            MappedFile &tar) {
+        std::vector<Input> inputs;
+        if (std::filesystem::is_directory(source)) {
+            packs = std::make_unique<PackReader>(source);
+            for (auto &key: packs->keys()) {
+                const auto data = packs->compressed(key);
+                inputs.emplace_back(Input{.key = std::move(key), .data = data, .path = {}});
+            }
+            for (const auto &entry: std::filesystem::directory_iterator(source)) {
+                auto name = entry.path().filename().string();
+                if (entry.is_regular_file() && !name.starts_with("pack-") && !packs->contains(name)) {
+                    inputs.emplace_back(Input{.key = std::move(name), .data = {}, .path = entry.path()});
+                }
+            }
+        } else {
+            tar = MappedFile(source);
+            tar.advise(Advice::Sequential);
+            tarInputs(tar.data(), inputs);
+        }
+        // Sorted for the index, the first copy of a key wins
+        std::ranges::stable_sort(inputs, {}, &Input::key);
+        const auto duplicates = std::ranges::unique(inputs, {}, &Input::key);
+        inputs.erase(duplicates.begin(), duplicates.end());
+        return inputs;
+    }
+
+    static void pad(std::ofstream &out) {
+        const auto position = static_cast<size_t>(out.tellp());
+        const std::string padding(align(position) - position, '\0');
+        out.write(padding.data(), static_cast<std::streamsize>(padding.size()));
+    }
+
+    ZstdPackStats buildZstdPack(const std::filesystem::path &source, const std::filesystem::path &output,
+                                const ZstdPackOptions &options) {
+        std::unique_ptr<PackReader> packs;
+        MappedFile tar;
+        const auto inputs = collectInputs(source, packs, tar);
+        const auto dictionary = trainDictionary(inputs, options);
+
+        const unsigned threads = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+        const auto cdict = std::unique_ptr<ZSTD_CDict, decltype(&ZSTD_freeCDict)>(
+            dictionary.empty() ? nullptr : ZSTD_createCDict(dictionary.data(), dictionary.size(), options.level),
+            ZSTD_freeCDict);
+        std::vector<std::unique_ptr<ZSTD_CCtx, decltype(&ZSTD_freeCCtx)>> contexts;
+        for (unsigned i = 0; i < threads; i++) {
+            auto &context = contexts.emplace_back(ZSTD_createCCtx(), ZSTD_freeCCtx);
+            check(ZSTD_CCtx_setParameter(context.get(), ZSTD_c_compressionLevel, options.level), "zstd level");
+            check(ZSTD_CCtx_setParameter(context.get(), ZSTD_c_checksumFlag, 1), "zstd checksum");
+            check(ZSTD_CCtx_refCDict(context.get(), cdict.get()), "zstd dictionary");
+        }
+
+        auto temporary = output;
+        temporary += ".tmp";
+        std::ofstream out(temporary, std::ios::binary);
+        ZstdPackHeader header{};
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        pad(out);
+        header.dictionaryOffset = static_cast<uint64_t>(out.tellp());
+        header.dictionarySize = dictionary.size();
+        out.write(dictionary.data(), static_cast<std::streamsize>(dictionary.size()));
+        pad(out);
+
+        // Batches keep memory bounded, each thread takes objects of a batch until it is done
+        ZstdPackStats stats;
+        std::vector<ZstdPackEntry> entries(inputs.size());
+        const size_t batchSize = std::max<size_t>(256, threads * 64);
+        std::vector<std::string> frames;
+        for (size_t first = 0; first < inputs.size(); first += batchSize) {
+            const size_t count = std::min(batchSize, inputs.size() - first);
+            frames.assign(count, {});
+            std::atomic<size_t> next{0};
+            parallelFor(threads, threads, [&](const size_t thread) {
+                DOLOS_TRACE("zpack.compress", "compress");
+                for (size_t i; (i = next.fetch_add(1)) < count;) {
+                    const auto raw = decompressInput(inputs[first + i]);
+                    auto &frame = frames[i];
+                    frame.resize(ZSTD_compressBound(raw.size()));
+                    frame.resize(check(ZSTD_compress2(contexts[thread].get(), frame.data(), frame.size(), raw.data(),
+                                                      raw.size()), "zstd compression"));
+                    entries[first + i].rawSize = raw.size();
+                }
+            });
+            for (size_t i = 0; i < count; i++) {
+                auto &entry = entries[first + i];
+                entry.offset = static_cast<uint64_t>(out.tellp());
+                entry.size = static_cast<uint32_t>(frames[i].size());
+                out.write(frames[i].data(), static_cast<std::streamsize>(frames[i].size()));
+                stats.rawBytes += entry.rawSize;
+            }
+        }
+        pad(out);
+
+        std::string keys;
+        for (size_t i = 0; i < inputs.size(); i++) {
+            entries[i].keyOffset = keys.size();
+            entries[i].keyLength = static_cast<uint32_t>(inputs[i].key.size());
+            keys += inputs[i].key;
+        }
+        header.entriesOffset = static_cast<uint64_t>(out.tellp());
+        out.write(reinterpret_cast<const char *>(entries.data()),
+                  static_cast<std::streamsize>(entries.size() * sizeof(ZstdPackEntry)));
+        pad(out);
+        header.keysOffset = static_cast<uint64_t>(out.tellp());
+        header.keysSize = keys.size();
+        out.write(keys.data(), static_cast<std::streamsize>(keys.size()));
+        stats.packBytes = static_cast<uint64_t>(out.tellp());
+
+        // The header last, a file cut short is never taken for a valid pack
+        std::memcpy(header.magic, ZstdPackHeader::expectedMagic, sizeof(header.magic));
+        header.version = ZstdPackHeader::currentVersion;
+        header.level = options.level;
+        header.objectCount = entries.size();
+        out.seekp(0);
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        out.close();
+        if (!out) {
+            throw std::runtime_error("Failed to write " + temporary.string());
+        }
+        std::filesystem::rename(temporary, output);
+
+        stats.objects = entries.size();
+        return stats;
+    }
+
+    ZstdPack::ZstdPack(const std::filesystem::path &path, const Advice advice) : file(path) {
+        const auto data = file.data();
+        if (data.size() < sizeof(ZstdPackHeader)) {
+            throw std::runtime_error("Not a zpack: " + path.string());
+        }
+        header = reinterpret_cast<const ZstdPackHeader *>(data.data());
+        if (std::memcmp(header->magic, ZstdPackHeader::expectedMagic, sizeof(header->magic)) != 0) {
+            throw std::runtime_error("Not a zpack: " + path.string());
+        }
+        if (header->version != ZstdPackHeader::currentVersion) {
+            throw std::runtime_error("Unsupported zpack version " + std::to_string(header->version) + ", convert "
+                                     + path.string() + " again");
+        }
+
+        entries = section<ZstdPackEntry>(data, header->entriesOffset, header->objectCount);
+        const auto keys = section<char>(data, header->keysOffset, header->keysSize);
+        keyData = std::string_view(keys.data(), keys.size());
+        const auto digest = section<char>(data, header->dictionaryOffset, header->dictionarySize);
+        if (!digest.empty()) {
+            dictionary = ZSTD_createDDict(digest.data(), digest.size());
+            if (!dictionary) {
+                throw std::runtime_error("Corrupt zpack dictionary: " + path.string());
+            }
+        }
+        // Random by default: lookups touch one frame each, readahead would mostly load neighbours nobody asked for
+        file.advise(advice, align(header->dictionaryOffset + header->dictionarySize),
+                    header->entriesOffset - align(header->dictionaryOffset + header->dictionarySize));
+    }
+
+    ZstdPack::~ZstdPack() {
+        ZSTD_freeDDict(static_cast<ZSTD_DDict *>(dictionary));
+    }
+
+    std::optional<std::string> ZstdPack::get(const std::string_view key) const {
+        const auto *entry = find(key);
+        if (!entry) {
+            return std::nullopt;
+        }
+        DOLOS_TRACE("zpack.get", "compress");
+        const auto frame = file.data();
+        if (entry->offset > frame.size() || entry->size > frame.size() - entry->offset) {
+            throw std::runtime_error("Corrupt zpack: frame out of bounds");
+        }
+        // One decompression context per thread, they are too large to create per object
+        thread_local const std::unique_ptr<ZSTD_DCtx, decltype(&ZSTD_freeDCtx)> context(ZSTD_createDCtx(),
+                                                                                        ZSTD_freeDCtx);
+        std::string result(entry->rawSize, '\0');
+        const auto size = check(ZSTD_decompress_usingDDict(context.get(), result.data(), result.size(),
+                                                           frame.data() + entry->offset, entry->size,
+                                                           static_cast<const ZSTD_DDict *>(dictionary)),
+                                "zstd decompression");
+        if (size != result.size()) {
+            throw std::runtime_error("Corrupt zpack: object " + std::string(key) + " has the wrong size");
+        }
+        return result;
+    }
+#else
+    ZstdPackStats buildZstdPack(const std::filesystem::path &, const std::filesystem::path &, const ZstdPackOptions &) {
+        throw std::runtime_error("dolos was built without libzstd");
+    }
+
+    ZstdPack::ZstdPack(const std::filesystem::path &, Advice) : header(nullptr) {
+        throw std::runtime_error("dolos was built without libzstd");
+    }
+
+    ZstdPack::~ZstdPack() = default;
+
+    std::optional<std::string> ZstdPack::get(std::string_view) const {
+        throw std::runtime_error("dolos was built without libzstd");
+    }
+#endif
+}
@@ -0,0 +1,96 @@
+#ifndef ZPACK_H
+#define ZPACK_H
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "mapped.h"
+
+namespace dolos {
+    // Layout of a .zpack file, objects compressed one zstd frame each with a dictionary trained on the objects. All
+    // sections start 64 byte aligned at the given offsets:
+    //   dictionary char[dictionarySize]
+    //   frames     the frames back to back, in key order
+    //   entries    ZstdPackEntry[objectCount], sorted by key
+    //   keys       char[keysSize]
+    struct ZstdPackHeader {
+        static constexpr char expectedMagic[8] = {'D', 'O', 'L', 'O', 'S', 'Z', 'P', 'K'};
+        static constexpr uint32_t currentVersion = 1;
+
+        char magic[8];
+        uint32_t version;
+        int32_t level;
+        uint64_t objectCount;
+        uint64_t dictionaryOffset;
+        uint64_t dictionarySize;
+        uint64_t entriesOffset;
+        uint64_t keysOffset;
+        uint64_t keysSize;
+    };
+
+    struct ZstdPackEntry {
+        uint64_t keyOffset;
+        uint64_t offset;
+        uint64_t rawSize;
+        uint32_t keyLength;
+        uint32_t size;
+    };
+
+    struct ZstdPackOptions {
+        int level = 19;
+        size_t dictionarySize = 112640;
+        // Training input, taken evenly spread over all objects
+        size_t sampleBytes = 64ull << 20;
+        unsigned threads = 0;
+    };
+
+    struct ZstdPackStats {
+        uint64_t objects = 0;
+        uint64_t rawBytes = 0;
+        uint64_t packBytes = 0;
+    };
+
+    // Converts an xz object store, either a store directory (packs and loose files) or a tar of one, to a .zpack.
+    // Objects are recompressed in batches on all threads; the output is written next to the target and renamed.
+    ZstdPackStats buildZstdPack(const std::filesystem::path &source, const std::filesystem::path &output,
+                                const ZstdPackOptions &options = {});
+
+    // Random access to the objects of a mapped .zpack
+    class ZstdPack {
+        MappedFile file;
+        const ZstdPackHeader *header;
+        std::span<const ZstdPackEntry> entries;
+        std::string_view keyData;
+        // ZSTD_DDict, digested once and shared by all threads
+        void *dictionary = nullptr;
+
+        std::string_view key(const ZstdPackEntry &entry) const;
+
+        const ZstdPackEntry *find(std::string_view key) const;
+
+    public:
+        // The advice applies to the frames, header, dictionary and index keep the default readahead
+        explicit ZstdPack(const std::filesystem::path &path, Advice advice = Advice::Random);
+
+        ZstdPack(const ZstdPack &) = delete;
+        ZstdPack &operator=(const ZstdPack &) = delete;
+
+        ~ZstdPack();
+
+        size_t size() const { return header->objectCount; }
+
+        bool contains(std::string_view key) const { return find(key) != nullptr; }
+
+        // Decompressed content of the object, empty if the key is not stored
+        std::optional<std::string> get(std::string_view key) const;
+
+        std::vector<std::string> keys() const;
+    };
+}
+
+#endif //ZPACK_H
@@ -99,6 +99,14 @@ def build_job_list_from_single_file(file) -> set:
 
 
 def build_job_list(files) -> set:
+    try:
+        import dolospy
+    except ImportError:
+        dolospy = None
+    if dolospy is not None and hasattr(dolospy, "buildJobList"):
+        # Walks the raw BSON natively, same filters as build_job_list_from_single_file
+        return set(dolospy.buildJobList(files, requiresSourceMap=REQUIRES_SOURCE_MAP, excludedUrls=CDN_HOSTS, threads=WORKER))
+
     jobs = set()
 
     with multiprocessing.Pool(WORKER) as pool:
@@ -108,6 +116,75 @@ def build_job_list(files) -> set:
     return jobs
 
 
+def load_clusters(path: str, jobs: set, object_storage: str) -> dict:
+    """
+    Near-duplicate clusters as job -> (representative, similarity), read from path if it covers all jobs with
+    representatives among them, otherwise computed with dolospy and stored there for the next run. Only jobs with the
+    same source map share a cluster, as the compartments are identified with the map.
+    """
+    clusters = {}
+    if os.path.exists(path):
+        with open(path) as f:
+            for line in f:
+                job, representative, similarity = line.rstrip("\n").split("\t")
+                clusters[job] = (representative, float(similarity))
+        if all(
+            job in clusters
+            and clusters[job][0] in jobs
+            and clusters[job][0].split(":")[1] == job.split(":")[1]
+            for job in jobs
+        ):
+            return clusters
+
+    if not object_storage.endswith(".zpack") and not os.path.isdir(object_storage):
+        raise SystemExit(
+            "Computing clusters needs a .zpack or store directory as object storage, "
+            "for a tar run `dolos cluster` on its store first and pass the TSV with --clusters"
+        )
+
+    import dolospy
+    ordered = sorted(jobs)
+    print(f"Clustering {len(ordered)} scripts ...", flush=True)
+    assignments = dolospy.clusterObjects(
+        object_storage,
+        [job.split(":")[0] for job in ordered],
+        threads=WORKER,
+        partitions=[job.split(":")[1] for job in ordered],
+    )
+    clusters = {
+        job: (ordered[representative], similarity) for job, (representative, similarity) in zip(ordered, assignments)
+    }
+    with open(path, "w") as f:
+        for job, (representative, similarity) in clusters.items():
+            f.write(f"{job}\t{representative}\t{similarity}\n")
+    return clusters
+
+
+def propagate_clusters(output_file: str, members: dict, clusters: dict):
+    """Copies the result of each representative to the members of its cluster that have none yet"""
+    wanted = set(members.values())
+    representatives = {}
+    existing = set()
+    try:
+        with open(output_file, "rb") as f:
+            for result in bson.decode_file_iter(f):
+                existing.add(result["id"])
+                if result["id"] in wanted:
+                    representatives[result["id"]] = result
+    except FileNotFoundError:
+        return
+
+    with open(output_file, "ab") as f:
+        for job, representative in members.items():
+            if job in existing or representative not in representatives:
+                continue
+            result = dict(representatives[representative])
+            result["id"] = job
+            result["clusterRepresentative"] = representative
+            result["clusterSimilarity"] = clusters[job][1]
+            f.write(bson.encode(result))
+
+
 def worker(
         worker_id: int,
         next_job: multiprocessing.Value,
@@ -115,9 +192,41 @@ def worker(
         output_file: str,
         output_lock: multiprocessing.Lock,
         index: dict,
+        zpack: str | None = None,
+        store: str | None = None,
 ):
     shm_meta = multiprocessing.shared_memory.SharedMemory(create=False, name=SHM_META_NAME)
-    shm_data = multiprocessing.shared_memory.SharedMemory(create=False, name=SHM_DATA_NAME)
+
+    if zpack is not None:
+        # Mapped by every worker, the page cache shares it
+        import dolospy
+        objects = dolospy.ZstdPack(zpack)
+
+        def load(key):
+            return objects.get(key).decode()
+    elif store is not None:
+        # Packs are mapped by every worker, loose objects are read from their files
+        import dolospy
+        objects = dolospy.PackReader(store)
+
+        def load(key):
+            data = objects.get(key)
+            if data is None:
+                with open(os.path.join(store, key), "rb") as f:
+                    data = lzma.decompress(f.read())
+            return data.decode()
+    else:
+        shm_data = multiprocessing.shared_memory.SharedMemory(create=False, name=SHM_DATA_NAME)
+
+        def load(key):
+            offset, size = index[key]
+            # noinspection PyTypeChecker
+            return lzma.decompress(shm_data.buf[offset:offset + size]).decode()
+
+    try:
+        from dolospy import classifyInput as classify_input
+    except ImportError:
+        classify_input = None
 
     PORT = int(os.getenv("PORT", "6666")) + int(worker_id)
 
@@ -157,17 +266,21 @@ def worker(
             assert source_hash in index, f"source_hash not in object storage"
 
             try:
-                offset, size = index[source_hash]
-                # noinspection PyTypeChecker
-                source = lzma.decompress(shm_data.buf[offset:offset + size]).decode()
+                source = load(source_hash)
 
                 if len(sourcemap_hash) == 0:
                     sourcemap = None
                 else:
                     assert sourcemap_hash in index, f" {sourcemap_hash=} not in object storage"
-                    offset, size = index[sourcemap_hash]
-                    # noinspection PyTypeChecker
-                    sourcemap = lzma.decompress(shm_data.buf[offset:offset + size]).decode()
+                    sourcemap = load(sourcemap_hash)
+
+                reason = classify_input(source) if classify_input else "script"
+                if reason != "script":
+                    # What identify.mjs answers for inputs that can never match, without sending the payload
+                    with output_lock:
+                        with open(output_file, "ab") as f:
+                            f.write(bson.encode({"id": job, "error": f"Input skipped: {reason}"}))
+                    continue
 
                 try:
                     resp = requests.post(f"http://localhost:{PORT}/identify/without_truths/compartments", json={"source": source, "map": sourcemap})
@@ -194,7 +307,7 @@ def worker(
                     if server.poll() is not None:
                         server = start_server()
 
-            except (lzma.LZMAError, UnicodeDecodeError) as e:
+            except (lzma.LZMAError, RuntimeError, UnicodeDecodeError) as e:
                 print(f"Worker {worker_id}: Unexpected {type(e)} for {job}", file=sys.stderr)
 
     finally:
@@ -224,7 +337,15 @@ def main():
         "--object-storage",
         type=str,
         required=True,
-        help=f"tar of the object storage",
+        help=f"tar of the object storage, its store directory (packs and loose files), or a .zpack converted from "
+             f"either with `dolos zpack build`",
+    )
+    parser.add_argument(
+        "--clusters",
+        type=str,
+        help="TSV of near-duplicate clusters (job, representative, similarity), computed with dolospy if missing. "
+             "Only representatives are identified, their results are copied to the other members. "
+             "Computing needs a store directory or .zpack, for a tar run `dolos cluster` on its store first.",
     )
     parser.add_argument(
         "files",
@@ -259,22 +380,42 @@ def main():
         print(f"Building job list from {len(args.files)} files", flush=True)
         jobs = build_job_list(args.files)
 
-        # Step 0: Load storage into mem
-        FILESIZE = os.stat(args.object_storage).st_size
-        shm_data = multiprocessing.shared_memory.SharedMemory(create=True, size=FILESIZE, name=SHM_DATA_NAME)
-
-        print(f"Reading {args.object_storage=} into RAM (this may take a while) ... ", flush=True)
-        bs = 1024 * 1024
-        with open(args.object_storage, mode="rb") as f:
-            for offset in tqdm(range(0, FILESIZE, bs), unit="MByte", miniters=1500):
-                shm_data.buf[offset : offset + bs] = f.read(bs)
-
-        print(f"Building tar index (this may take a while) ... ", flush=True)
-        index = {}
-        # noinspection PyTypeChecker
-        with tarfile.open(fileobj=io.BytesIO(shm_data.buf), mode="r|") as tf:
-            while (member := tf.next()) is not None:
-                index[member.name.rsplit("/", 1)[-1]] = (member.offset_data, member.size)
+        zpack = store = None
+        if args.object_storage.endswith(".zpack"):
+            # Dictionary compressed and indexed, nothing to load or index up front
+            import dolospy
+            zpack = args.object_storage
+            index = set(dolospy.ZstdPack(zpack).keys())
+        elif os.path.isdir(args.object_storage):
+            # Store directory of object-storage.py, pack indexes and loose file names are the keys
+            import dolospy
+            store = args.object_storage
+            index = set(dolospy.PackReader(store).keys())
+            index.update(name for name in os.listdir(store) if not name.startswith("pack-"))
+        else:
+            # Step 0: Load storage into mem
+            FILESIZE = os.stat(args.object_storage).st_size
+            shm_data = multiprocessing.shared_memory.SharedMemory(create=True, size=FILESIZE, name=SHM_DATA_NAME)
+
+            print(f"Reading {args.object_storage=} into RAM (this may take a while) ... ", flush=True)
+            bs = 1024 * 1024
+            with open(args.object_storage, mode="rb") as f:
+                for offset in tqdm(range(0, FILESIZE, bs), unit="MByte", miniters=1500):
+                    shm_data.buf[offset : offset + bs] = f.read(bs)
+
+            print(f"Building tar index (this may take a while) ... ", flush=True)
+            index = {}
+            # noinspection PyTypeChecker
+            with tarfile.open(fileobj=io.BytesIO(shm_data.buf), mode="r|") as tf:
+                while (member := tf.next()) is not None:
+                    index[member.name.rsplit("/", 1)[-1]] = (member.offset_data, member.size)
+
+        members = {}
+        if args.clusters:
+            clusters = load_clusters(args.clusters, jobs, args.object_storage)
+            members = {job: clusters[job][0] for job in jobs if clusters[job][0] != job}
+            jobs -= members.keys()
+            print(f"{len(members)} jobs are near-duplicates of another job", flush=True)
 
         # Step 2: Read output file and remove existing
         print(f"Found {len(jobs)} jobs", flush=True)
@@ -302,7 +443,7 @@ def main():
         # Step 4: Create worker
         processes = []
         for i in range(WORKER):
-            processes.append(multiprocessing.Process(target=worker, args=(i, next_job, len(jobs), OUTPUT, output_lock, index)))
+            processes.append(multiprocessing.Process(target=worker, args=(i, next_job, len(jobs), OUTPUT, output_lock, index, zpack, store)))
 
         for process in processes:
             process.start()
@@ -318,6 +459,9 @@ def main():
         for process in processes:
             process.join()
 
+        if members:
+            propagate_clusters(OUTPUT, members, clusters)
+
     finally:
         if shm_data:
             shm_data.close()
@@ -83,6 +83,14 @@ def build_job_list_from_single_file(file) -> set:
 
 
 def build_job_list(files) -> set:
+    try:
+        import dolospy
+    except ImportError:
+        dolospy = None
+    if dolospy is not None and hasattr(dolospy, "buildJobList"):
+        # Walks the raw BSON natively, same filters as build_job_list_from_single_file
+        return set(dolospy.buildJobList(files, requiresSourceMap=True, excludedUrls=[], threads=WORKER))
+
     jobs = set()
 
     with multiprocessing.Pool(WORKER) as pool:
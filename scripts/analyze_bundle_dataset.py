@@ -397,6 +397,8 @@ def identify_scaffold(
                                 json={
                                     "source": script,
                                     "map": sourcemap,
+                                    # Lets identify.mjs reuse results of the previous scan of this URL (SCAN_STATE_DIR)
+                                    "url": url,
                                 },
                                 headers=HEADERS,
                             )
@@ -11,6 +11,7 @@ import {
     identifyWebpackChunkCompartments,
     identifyWebpackCompartments,
 } from "./identify_compartments.mjs";
+import native from "./native.mjs";
 import { MightBeJsonError } from "./utils.mjs";
 
 const languagePicker = new LanguagePicker();
@@ -18,31 +19,278 @@ const javascript = await languagePicker.findLanguage("javascript");
 
 const tokenizer = await javascript.createTokenizer();
 
+/** @type {Map<string, {mtimeMs: number, index: any}>} */
+const nativeIndexes = new Map();
+
+/**
+ * Open the binary index next to indexFile with the native matcher, if both exist
+ *
+ * @param {string} indexFile Path of the <pkg>.index.json file
+ * @returns {Promise<any | null>} Native index handle
+ */
+async function openNativeIndex(indexFile) {
+    if (!native) return null;
+    const binaryFile = indexFile.replace(/\.json$/, ".bin");
+    let stat;
+    try {
+        stat = await fs.stat(binaryFile);
+    } catch (e) {
+        return null;
+    }
+    const cached = nativeIndexes.get(binaryFile);
+    if (cached && cached.mtimeMs === stat.mtimeMs) return cached.index;
+    const index = native.openIndex(binaryFile);
+    nativeIndexes.set(binaryFile, { mtimeMs: stat.mtimeMs, index });
+    return index;
+}
+
+/** @type {{path: string, mtimeMs: number, table: any} | null} */
+let exactTable = null;
+
+/**
+ * Open the exact content hash table (EXACT_INDEX, default $INDEX_DIR/exact.bin) with the native matcher
+ *
+ * @param {string} indexDir Directory of the indexes
+ * @returns {Promise<any | null>} Native table handle, null if there is no table
+ */
+async function openExactTable(indexDir) {
+    if (!native?.openExact) return null;
+    const path = process.env.EXACT_INDEX ?? `${indexDir}/exact.bin`;
+    let stat;
+    try {
+        stat = await fs.stat(path);
+    } catch (e) {
+        return null;
+    }
+    if (exactTable && exactTable.path === path && exactTable.mtimeMs === stat.mtimeMs) return exactTable.table;
+    const table = native.openExact(path);
+    exactTable = { path, mtimeMs: stat.mtimeMs, table };
+    return table;
+}
+
+/**
+ * Releases containing exactly this file, before any tokenizing. Byte identical files are checked first, then files
+ * that only differ in whitespace.
+ *
+ * @param {string} indexDir Directory of the indexes
+ * @param {string} source Source code of the file
+ * @returns {Promise<{versions: string[], normalized: boolean} | null>}
+ */
+async function lookupExact(indexDir, source) {
+    const table = await openExactTable(indexDir).catch((e) => {
+        console.log("Exact table not usable");
+        console.log(`${e}`);
+        return null;
+    });
+    return table ? native.lookupExact(table, source) : null;
+}
+
+/**
+ * Similarity entry of a release the exact table found, shaped like those of useCachedIndex with full coverage
+ *
+ * @param {string} pkgVers Release as pkg@vers
+ * @returns {{name: string, similarity: object}}
+ */
+function exactSimilarity(pkgVers) {
+    return {
+        name: pkgVers,
+        similarity: { leftCovered: 1, leftTotal: 1, rightCovered: 1, rightTotal: 1, longest: null },
+    };
+}
+
+/** @type {{mtimeMs: number, scanner: any} | null} */
+let bannerScanner = null;
+
+/**
+ * Banner scanner over the names of all packages with an index in indexDir, rebuilt when the directory changes
+ *
+ * @param {string} indexDir Directory of the indexes
+ * @returns {Promise<any | null>} Native scanner handle, null without the native addon
+ */
+async function openBannerScanner(indexDir) {
+    if (!native?.openBanners) return null;
+    const stat = await fs.stat(indexDir);
+    if (bannerScanner && bannerScanner.mtimeMs === stat.mtimeMs) return bannerScanner.scanner;
+    const packages = (await fs.readdir(indexDir))
+        .filter((file) => file.endsWith(".index.json"))
+        .map((file) => file.slice(0, -".index.json".length).replace("+", "/"));
+    const scanner = native.openBanners(packages);
+    bannerScanner = { mtimeMs: stat.mtimeMs, scanner };
+    return scanner;
+}
+
+/**
+ * Why the input can never match, decided on its bytes before any parsing: "empty", "too_short", "json", "html" or
+ * "binary". Null for scripts and without the native addon.
+ *
+ * @param {string} source Source code of the file
+ * @returns {string | null}
+ */
+function skipReason(source) {
+    if (!native?.classifyInput || typeof source !== "string") return null;
+    const inputClass = native.classifyInput(source, Number(process.env.MIN_SCRIPT_LENGTH ?? 32));
+    return inputClass === "script" ? null : inputClass;
+}
+
+/**
+ * Key of a script URL that stays the same across deployments: query and fragment dropped, content hashes in the
+ * file name (main.3f9a2c81.js) replaced
+ *
+ * @param {string} url URL of the script
+ * @returns {string} Stable key
+ */
+function scanKey(url) {
+    return url.split(/[?#]/, 1)[0].replace(/[0-9a-f]{8,}/gi, "*");
+}
+
+/**
+ * Per package compartment digests and similarities of the previous scan of the URL (SCAN_STATE_DIR/<sha1 of key>.json)
+ *
+ * @param {string} url URL of the script
+ * @returns {Promise<{key: string, path: string, packages: Record<string, any>} | null>} Null without SCAN_STATE_DIR
+ */
+async function loadScanState(url) {
+    if (!process.env.SCAN_STATE_DIR || !url) return null;
+    const key = scanKey(url);
+    const path = `${process.env.SCAN_STATE_DIR}/${crypto.createHash("sha1").update(key).digest("hex")}.json`;
+    try {
+        const state = JSON.parse(await fs.readFile(path, { encoding: "utf8" }));
+        return { key, path, packages: state.key === key ? state.packages : {} };
+    } catch (e) {
+        return { key, path, packages: {} };
+    }
+}
+
+/**
+ * Replaces the state of the URL, written next to it and renamed so a concurrent reader never sees a partial file.
+ * The state is only a cache, failing to write it is logged and never fails the request.
+ *
+ * @param {{key: string, path: string}} state State as loaded
+ * @param {Record<string, any>} packages Digests and similarities of this scan
+ */
+async function saveScanState(state, packages) {
+    // Unique per call, concurrent scans of the same URL must not write the same temporary file
+    const temporary = `${state.path}.${process.pid}.${crypto.randomUUID()}.tmp`;
+    try {
+        await fs.writeFile(temporary, JSON.stringify({ key: state.key, packages }));
+        await fs.rename(temporary, state.path);
+    } catch (e) {
+        console.log("Scan state not saved", state.path);
+        console.log(`${e}`);
+        await fs.rm(temporary, { force: true }).catch(() => {});
+    }
+}
+
+/**
+ * Modification time of the index used for a package, so results are not reused across index rebuilds
+ *
+ * @param {string} indexFile Path of the <pkg>.index.json file
+ * @returns {Promise<number | null>}
+ */
+async function indexStamp(indexFile) {
+    for (const file of [indexFile.replace(/\.json$/, ".bin"), indexFile]) {
+        try {
+            return (await fs.stat(file)).mtimeMs;
+        } catch (e) {
+            // try the next one
+        }
+    }
+    return null;
+}
+
+/**
+ * Similarities of every package's compartments, reusing those of the previous scan of the same URL for packages
+ * whose compartments are unchanged
+ *
+ * @param {string} indexDir Directory of the indexes
+ * @param {Record<string, string>} nodeModules Grouped compartment code per package
+ * @param {string | undefined} url URL of the script, enables incremental matching with SCAN_STATE_DIR
+ * @returns {Promise<{similarities: any[], incremental: {reused: string[], rematched: string[]} | undefined}>}
+ */
+async function matchCompartments(indexDir, nodeModules, url) {
+    const state = await loadScanState(url);
+    if (!state) {
+        const similarities = await Promise.all(
+            Object.entries(nodeModules).map((nm) =>
+                useCachedIndex([`${indexDir}/${nm[0].replace("/", "+")}.index.json`], nm[1]),
+            ),
+        );
+        return { similarities, incremental: undefined };
+    }
+
+    const packages = {};
+    const incremental = { reused: [], rematched: [] };
+    const similarities = await Promise.all(
+        Object.entries(nodeModules).map(async ([pkg, code]) => {
+            const indexFile = `${indexDir}/${pkg.replace("/", "+")}.index.json`;
+            const digest = crypto.createHash("sha1").update(code).digest("hex");
+            const stamp = await indexStamp(indexFile);
+            const previous = state.packages[pkg];
+            if (previous && previous.digest === digest && previous.stamp === stamp) {
+                incremental.reused.push(pkg);
+                packages[pkg] = previous;
+                return previous.similarities;
+            }
+            incremental.rematched.push(pkg);
+            const result = await useCachedIndex([indexFile], code);
+            packages[pkg] = { digest, stamp, similarities: result };
+            return result;
+        }),
+    );
+    await saveScanState(state, packages);
+    return { similarities, incremental };
+}
+
 export async function useCachedIndex(indexFiles, bundle) {
-    const bundleTf = tokenizer.tokenizeFile(new File("bundle", bundle));
+    let bundleTf = null;
+    let nativeTokens = null;
     const allSimilarities = {};
 
     for (const indexFile of indexFiles) {
+        const nativeIndex = await openNativeIndex(indexFile).catch((e) => {
+            console.log("Native index not usable", indexFile);
+            console.log(`${e}`);
+            return null;
+        });
+        if (nativeIndex) nativeTokens ??= native.tokenize(bundle);
+        else bundleTf ??= tokenizer.tokenizeFile(new File("bundle", bundle));
+
         const similarities = [];
         try {
-            const data = await fs.readFile(indexFile, { encoding: "utf8" }).then(JSON.parse);
-            const index = deserializeFingerprintIndex(data);
-            const tokenizedFiles = index.entries().map((entry) => entry.file);
-
-            index.addFiles([bundleTf]);
-
-            for (let i = 0; i < tokenizedFiles.length; i++) {
-                const pair = index.getPair(bundleTf, tokenizedFiles[i]);
-                similarities.push({
-                    name: tokenizedFiles[i].path,
-                    similarity: {
-                        leftCovered: pair.leftCovered,
-                        leftTotal: pair.leftTotal,
-                        rightCovered: pair.rightCovered,
-                        rightTotal: pair.rightTotal,
-                        longest: pair.longest,
-                    },
-                });
+            if (nativeIndex) {
+                // Covered fingerprints are symmetric and the native matcher does not track the longest fragment
+                for (const pair of native.match(nativeIndex, nativeTokens)) {
+                    similarities.push({
+                        name: pair.name,
+                        similarity: {
+                            leftCovered: pair.covered,
+                            leftTotal: pair.leftTotal,
+                            rightCovered: pair.covered,
+                            rightTotal: pair.rightTotal,
+                            longest: null,
+                        },
+                    });
+                }
+            } else {
+                const data = await fs.readFile(indexFile, { encoding: "utf8" }).then(JSON.parse);
+                const index = deserializeFingerprintIndex(data);
+                const tokenizedFiles = index.entries().map((entry) => entry.file);
+
+                index.addFiles([bundleTf]);
+
+                for (let i = 0; i < tokenizedFiles.length; i++) {
+                    const pair = index.getPair(bundleTf, tokenizedFiles[i]);
+                    similarities.push({
+                        name: tokenizedFiles[i].path,
+                        similarity: {
+                            leftCovered: pair.leftCovered,
+                            leftTotal: pair.leftTotal,
+                            rightCovered: pair.rightCovered,
+                            rightTotal: pair.rightTotal,
+                            longest: pair.longest,
+                        },
+                    });
+                }
             }
         } catch (e) {
             // If no index file is found return empty array
@@ -144,11 +392,20 @@ async function main() {
 
                 const wantsPnpm = Boolean(request.headers.get("X-Wants-Pnpm"));
 
+                // Same status as inputs the parser rejects as JSON, callers already ignore those
+                const reason = url.pathname.startsWith("/identify/") ? skipReason(body.source) : null;
+                if (reason)
+                    return new Response(`Input skipped: ${reason}`, {
+                        status: 501,
+                        statusText: "Input can not match",
+                        headers: { "X-Skip-Reason": reason },
+                    });
+
                 switch (url.pathname) {
                     case "/alive":
                         return new Response("", { status: 200, statusText: "OK" });
                     case "/identify/versions/compartments": {
-                        const { source, map } = body;
+                        const { source, map, url: scriptUrl } = body;
                         const groundTruth = fetchPnpmVersions(map);
                         if (wantsPnpm && groundTruth.length === 0) {
                             return new Response(
@@ -172,16 +429,17 @@ async function main() {
                                   };
                         const nodeModules = extractGroupedNpmModules(modules);
                         Object.values(modules).forEach((m) => (delete m.ast, delete m.text));
-                        const similarities = await Promise.all(
-                            Object.entries(nodeModules).map((nm) =>
-                                useCachedIndex([`${indexDir}/${nm[0].replace("/", "+")}.index.json`], nm[1]),
-                            ),
+                        // With a URL and SCAN_STATE_DIR only packages whose compartments changed since the
+                        // previous scan of that URL are matched again
+                        const { similarities, incremental } = await matchCompartments(indexDir, nodeModules, scriptUrl);
+                        return new Response(
+                            JSON.stringify({ similarities, modules, dependencies, groundTruth, incremental }),
+                            {
+                                status: 200,
+                                statusText: "OK",
+                                headers: { "content-type": "application/json" },
+                            },
                         );
-                        return new Response(JSON.stringify({ similarities, modules, dependencies, groundTruth }), {
-                            status: 200,
-                            statusText: "OK",
-                            headers: { "content-type": "application/json" },
-                        });
                     }
                     case "/identify/versions/no_compartments": {
                         const { source, map } = body;
@@ -193,14 +451,35 @@ async function main() {
                                 headers: { "content-type": "application/json" },
                             });
                         }
+                        // Unmodified library files are identified without tokenizing, fuzzy matching only runs for
+                        // packages the exact table has no release for
+                        const exact = await lookupExact(indexDir, source);
                         const similarities = await Promise.all(
                             groundTruth
                                 .map((pkgVers) => pkgVers.rsplit("@", 1)[0])
-                                .map((pkg) =>
-                                    useCachedIndex([`${indexDir}/${pkg.replace("/", "+")}.index.json`], source),
-                                ),
+                                .map((pkg) => {
+                                    const indexFile = `${indexDir}/${pkg.replace("/", "+")}.index.json`;
+                                    const exactVersions = (exact?.versions ?? []).filter(
+                                        (pkgVers) => pkgVers.rsplit("@", 1)[0] === pkg,
+                                    );
+                                    return exactVersions.length > 0
+                                        ? { [indexFile]: exactVersions.map(exactSimilarity) }
+                                        : useCachedIndex([indexFile], source);
+                                }),
                         );
-                        return new Response(JSON.stringify({ similarities, groundTruth }), {
+                        return new Response(JSON.stringify({ similarities, exact, groundTruth }), {
+                            status: 200,
+                            statusText: "OK",
+                            headers: { "content-type": "application/json" },
+                        });
+                    }
+                    case "/identify/libraries/strings": {
+                        // Package names followed by a version, as in license banners and version constants
+                        const { source } = body;
+                        const scanner = await openBannerScanner(indexDir);
+                        const hits = scanner ? native.scanBanners(scanner, source) : [];
+                        const matchedFingerprints = [...new Set(hits.map((hit) => `${hit.name}@${hit.version}`))];
+                        return new Response(JSON.stringify({ matchedFingerprints, hits }), {
                             status: 200,
                             statusText: "OK",
                             headers: { "content-type": "application/json" },
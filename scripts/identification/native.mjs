@@ -0,0 +1,18 @@
+import { createRequire } from "node:module";
+
+/**
+ * Native matcher from dolospy (`dolosnode.node`), or null if it is not available.
+ * Set DOLOS_NATIVE to the path of the addon, or to an empty string to disable it.
+ */
+const addonPath = process.env.DOLOS_NATIVE ?? new URL("../../dolospy/dolosnode.node", import.meta.url).pathname;
+
+let native = null;
+if (addonPath) {
+    try {
+        native = createRequire(import.meta.url)(addonPath);
+    } catch (e) {
+        if (process.env.DOLOS_NATIVE) console.log(`Failed to load native matcher ${addonPath}: ${e}`);
+    }
+}
+
+export default native;
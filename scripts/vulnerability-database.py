@@ -124,6 +124,7 @@ class VulnerabilityDatabase:
         self.pkglist = set()
         self.database = defaultdict(list)
         self.releases: dict[str, dict[str, str]] = {}
+        self._native = None
 
         if database_file is not None:
             try:
@@ -137,6 +138,7 @@ class VulnerabilityDatabase:
             self.pkglist.update(self.database.keys())
 
     def fetch_missing(self, snyk=True, github_adv=True):
+        self._native = None
         for pkg in self.pkglist:
             if pkg not in self.releases:
                 self.releases[pkg] = NpmRegistry.fetch_package_meta(pkg)
@@ -169,6 +171,40 @@ class VulnerabilityDatabase:
 
         return vulnerabilities
 
+    def native_index(self):
+        """
+        Advisory index of dolospy, matches many identified versions at once.
+        Advisories with ranges semver cannot parse are left out, those without any range affect every version
+        like in get_vulnerabilities.
+        """
+        import dolospy
+
+        index = dolospy.AdvisoryIndex()
+        vulnerabilities = []
+        for pkg, advisories in self.database.items():
+            for advisory in advisories:
+                for vuln in advisory.pkg.vulnerabilities:
+                    try:
+                        number = index.add(pkg, vuln.id, vuln.level, vuln.versions)
+                    except ValueError:
+                        continue
+                    vulnerabilities.append(vuln)
+                    assert number == len(vulnerabilities) - 1
+        return index, vulnerabilities
+
+    def get_vulnerabilities_batch(self, pairs: list[tuple[str, str]], threads: int = 0) -> list[list[Vulnerability]]:
+        """
+        Vulnerabilities of every (pkg, version) pair, like get_vulnerabilities but in one native call.
+        Versions that are not valid semver match nothing.
+        """
+        if self._native is None:
+            self._native = self.native_index()
+        index, vulnerabilities = self._native
+        result = [[] for _ in pairs]
+        for query, advisory in index.matchBatch([p for p, _ in pairs], [v for _, v in pairs], threads):
+            result[query].append(vulnerabilities[advisory])
+        return result
+
 
 
 if __name__ == '__main__':